@@ -0,0 +1,269 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <memory>
+#include <omp.h>
+#include "NeuralNetwork.h"
+#include "IdxDataset.h"
+
+// Regression benchmark behind `make bench`. Times the matrix kernels, the
+// element-wise ops, inference, gradient computation, a full training step
+// and IDX loading at the shapes of the 784-128-64-10 network, for batch
+// sizes 1 to 1024 and thread counts 1 to OMP_NUM_THREADS. Every case is
+// warmed up, then repeated until it has both enough samples and enough
+// wall time; the table and the JSON file report the median and p99 time per
+// call and the throughput at the median. The IDX files are synthetic, so no
+// dataset is needed.
+//
+// Usage: bench [--json path] [--quick]
+
+struct BenchCase {
+    std::string name;
+    std::string dtype;
+    std::string shape;
+    double flops;
+    double bytes;
+    std::function <void()> run;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string dtype;
+    std::string shape;
+    int threads;
+    size_t reps;
+    double median_ns;
+    double p99_ns;
+    double gflops;
+    double gbps;
+};
+
+struct BenchOptions {
+    std::string json_path = "bench_results.json";
+    int min_reps = 30;
+    double min_seconds = 0.2;
+    int max_reps = 5000;
+};
+
+BenchResult Measure(const BenchCase &c, int threads, const BenchOptions &options) {
+    auto warm_start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 3 || std::chrono::duration <double> (std::chrono::steady_clock::now() - warm_start).count() < 0.02; r++) {
+        c.run();
+    }
+
+    std::vector <double> times;
+    times.reserve(options.max_reps);
+    double total = 0.0;
+    while ((int)times.size() < options.max_reps && ((int)times.size() < options.min_reps || total < options.min_seconds)) {
+        auto t0 = std::chrono::steady_clock::now();
+        c.run();
+        auto t1 = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration <double> (t1 - t0).count();
+        times.push_back(seconds * 1e9);
+        total += seconds;
+    }
+    std::sort(times.begin(), times.end());
+    double median = times[times.size() / 2];
+    double p99 = times[std::min(times.size() - 1, (size_t)(times.size() * 0.99))];
+    return { c.name, c.dtype, c.shape, threads, times.size(), median, p99,
+             c.flops / median, c.bytes / median };
+}
+
+// Writes an IDX file of unsigned bytes with the given dimensions.
+void WriteIdx(const std::string &path, const std::vector <int> &dims, const std::vector <uint8_t> &payload) {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        printf("Cannot write %s\n", path.c_str());
+        std::exit(1);
+    }
+    uint8_t magic[4] = { 0, 0, 0x08, (uint8_t)dims.size() };
+    fwrite(magic, 1, 4, f);
+    for (int d : dims) {
+        uint8_t be[4] = { (uint8_t)(d >> 24), (uint8_t)(d >> 16), (uint8_t)(d >> 8), (uint8_t)d };
+        fwrite(be, 1, 4, f);
+    }
+    fwrite(payload.data(), 1, payload.size(), f);
+    fclose(f);
+}
+
+const char *image_path = "bench-synthetic-images.idx3-ubyte";
+const char *label_path = "bench-synthetic-labels.idx1-ubyte";
+const int synthetic_count = 10000;
+
+void WriteSyntheticDataset() {
+    std::mt19937 rng(42);
+    std::vector <uint8_t> images((size_t)synthetic_count * 784);
+    std::vector <uint8_t> labels(synthetic_count);
+    for (uint8_t &x : images) x = (uint8_t)(rng() & 0xFF);
+    for (uint8_t &x : labels) x = (uint8_t)(rng() % 10);
+    WriteIdx(image_path, { synthetic_count, 28, 28 }, images);
+    WriteIdx(label_path, { synthetic_count }, labels);
+}
+
+// Every case for element type T. Operands are owned by `storage` so the
+// lambdas can refer to them for the whole run.
+template <typename T>
+void AddCases(std::vector <BenchCase> &cases, std::vector <std::shared_ptr <void>> &storage, const IdxDataset &images,
+              const IdxDataset &labels) {
+    const char *dtype = sizeof(T) == sizeof(float) ? "float" : "double";
+    const double size = sizeof(T);
+    const int layers[][2] = { { 784, 128 }, { 128, 64 }, { 64, 10 } };
+    const int batches[] = { 1, 64, 256, 1024 };
+
+    auto keep = [&](BasicMatrix<T> *m) {
+        storage.push_back(std::shared_ptr <void> (m, [](void *p) { delete (BasicMatrix<T> *)p; }));
+        return m;
+    };
+    auto shape_of = [](int a, int b, int c) {
+        return std::to_string(a) + "x" + std::to_string(b) + (c ? "x" + std::to_string(c) : std::string());
+    };
+
+    for (int batch : batches) {
+        for (const auto &layer : layers) {
+            int k = layer[0], n = layer[1];
+            BasicMatrix<T> *a = keep(new BasicMatrix<T>(batch, k, true));
+            BasicMatrix<T> *b = keep(new BasicMatrix<T>(k, n, true));
+            BasicMatrix<T> *c = keep(new BasicMatrix<T>(batch, n));
+            cases.push_back({ "operator*", dtype, shape_of(batch, k, n), 2.0 * batch * k * n,
+                              size * ((double)batch * k + (double)k * n + (double)batch * n),
+                              [=]() { *c = (*a) * (*b); } });
+            BasicMatrix<T> *t = keep(new BasicMatrix<T>(k, batch));
+            cases.push_back({ "Transpose", dtype, shape_of(batch, k, 0), 0.0, 2.0 * size * batch * k,
+                              [=]() { a -> TransposeInto(*t); } });
+        }
+
+        for (int width : { 10, 128, 784 }) {
+            BasicMatrix<T> *a = keep(new BasicMatrix<T>(batch, width, true));
+            BasicMatrix<T> *b = keep(new BasicMatrix<T>(batch, width, true));
+            double n = (double)batch * width;
+            std::string shape = shape_of(batch, width, 0);
+            cases.push_back({ "AddInPlace", dtype, shape, n, 3.0 * size * n, [=]() { a -> AddInPlace(*b); } });
+            cases.push_back({ "AddScaledInPlace", dtype, shape, 2.0 * n, 3.0 * size * n,
+                              [=]() { a -> AddScaledInPlace(*b, T(0)); } });
+            cases.push_back({ "ApplyReLU", dtype, shape, n, 2.0 * size * n, [=]() { a -> ApplyReLU(); } });
+            cases.push_back({ "ApplySigmoid", dtype, shape, 0.0, 2.0 * size * n, [=]() { b -> ApplySigmoid(); } });
+            if (width == 10) {
+                cases.push_back({ "ApplySoftmax", dtype, shape, 0.0, 2.0 * size * n, [=]() { b -> ApplySoftmax(); } });
+            }
+        }
+
+        // Network-level cases: one layer is 2 * in * out FLOPs per row forward
+        // and about twice that backward.
+        double forward_flops = 0.0, parameter_bytes = 0.0;
+        for (const auto &layer : layers) {
+            forward_flops += 2.0 * batch * layer[0] * layer[1];
+            parameter_bytes += size * (layer[0] + 1.0) * layer[1];
+        }
+        auto nn = std::make_shared <BasicNeuralNetwork<T>> (std::vector <int> { 784, 128, 64, 10 });
+        auto workspace = std::make_shared <BasicTrainingWorkspace<T>> ();
+        auto sgd = std::make_shared <BasicSgdOptimizer<T>> (0.0);
+        auto batch_labels = std::make_shared <std::vector <int>> (batch);
+        BasicMatrix<T> *inputs = keep(new BasicMatrix<T>(0, 0));
+        std::vector <size_t> indices(batch);
+        for (int i = 0; i < batch; i++) {
+            indices[i] = (size_t)i * 7919 % images.Count();
+            (*batch_labels)[i] = labels.Label(indices[i]);
+        }
+        images.Gather(indices.data(), indices.size(), *inputs);
+        workspace -> Reserve(nn -> GetLayerSizes(), batch);
+        storage.push_back(nn);
+        storage.push_back(workspace);
+        storage.push_back(sgd);
+        storage.push_back(batch_labels);
+
+        double input_bytes = size * batch * 784.0;
+        cases.push_back({ "FeedForward", dtype, shape_of(batch, 784, 0), forward_flops, input_bytes + parameter_bytes,
+                          [=]() { nn -> FeedForward(*inputs); } });
+        cases.push_back({ "ComputeGradients", dtype, shape_of(batch, 784, 0), 3.0 * forward_flops,
+                          input_bytes + 2.0 * parameter_bytes,
+                          [=]() { nn -> ComputeBatchGradients(*inputs, *batch_labels, *workspace); } });
+        cases.push_back({ "BackPropagateBatch", dtype, shape_of(batch, 784, 0), 3.0 * forward_flops,
+                          input_bytes + 4.0 * parameter_bytes,
+                          [=]() { nn -> BackPropagateBatch(*inputs, *batch_labels, *sgd, *workspace); } });
+    }
+
+    // Loading: mapping the IDX file and converting every image to T.
+    BasicMatrix<T> *all = keep(new BasicMatrix<T>(0, 0));
+    double image_bytes = (double)synthetic_count * 784;
+    cases.push_back({ "ReadImages", dtype, shape_of(synthetic_count, 784, 0), 0.0, image_bytes * (1.0 + size),
+                      [=]() {
+                          IdxDataset file(image_path);
+                          file.GatherRange(0, file.Count(), *all);
+                      } });
+}
+
+void WriteJson(const std::string &path, const std::vector <BenchResult> &results) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        printf("Cannot write %s\n", path.c_str());
+        return;
+    }
+    fprintf(f, "{\n  \"max_threads\": %d,\n  \"results\": [\n", omp_get_max_threads());
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"dtype\": \"%s\", \"shape\": \"%s\", \"threads\": %d, \"reps\": %zu, "
+                   "\"median_ns\": %.1f, \"p99_ns\": %.1f, \"gflops\": %.3f, \"gbps\": %.3f}%s\n",
+                r.name.c_str(), r.dtype.c_str(), r.shape.c_str(), r.threads, r.reps, r.median_ns, r.p99_ns,
+                r.gflops, r.gbps, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else if (arg == "--quick") {
+            options.min_reps = 5;
+            options.min_seconds = 0.02;
+            options.max_reps = 200;
+        } else {
+            printf("Usage: bench [--json path] [--quick]\n");
+            return 1;
+        }
+    }
+
+    WriteSyntheticDataset();
+    std::vector <BenchResult> results;
+    {
+        IdxDataset images(image_path);
+        IdxDataset labels(label_path);
+        std::vector <BenchCase> cases;
+        std::vector <std::shared_ptr <void>> storage;
+        AddCases<double>(cases, storage, images, labels);
+        AddCases<float>(cases, storage, images, labels);
+
+        int max_threads = omp_get_max_threads();
+        std::vector <int> thread_counts;
+        for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+        thread_counts.push_back(max_threads);
+
+        printf("%-18s %-6s %-14s %7s %12s %12s %9s %9s\n", "case", "dtype", "shape", "threads",
+               "median us", "p99 us", "GFLOP/s", "GB/s");
+        for (int threads : thread_counts) {
+            omp_set_num_threads(threads);
+            for (const BenchCase &c : cases) {
+                BenchResult r = Measure(c, threads, options);
+                printf("%-18s %-6s %-14s %7d %12.2f %12.2f %9.2f %9.2f\n", r.name.c_str(), r.dtype.c_str(),
+                       r.shape.c_str(), r.threads, r.median_ns * 1e-3, r.p99_ns * 1e-3, r.gflops, r.gbps);
+                results.push_back(r);
+            }
+        }
+        omp_set_num_threads(max_threads);
+    }
+    std::remove(image_path);
+    std::remove(label_path);
+
+    WriteJson(options.json_path, results);
+    printf("Wrote %zu results to %s\n", results.size(), options.json_path.c_str());
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "DataLoader.h"
+#include "IdxDataset.h"
+#include "Evaluator.h"
+#include "Parallel.h"
+
+struct Result {
+    double accuracy;
+    // Images per second.
+    double batched;
+    double single;
+};
+
+// Runs the test set through nn in batches of 1000 for accuracy and
+// throughput, then the first 1000 images one at a time.
+template <typename T>
+Result Evaluate(const BasicNeuralNetwork<T> &nn, const IdxDataset &test_images, const IdxDataset &test_labels) {
+    TestSetResult batched = EvaluateTestSet(nn, test_images, test_labels);
+
+    size_t singles = std::min <size_t> (1000, test_images.Count());
+    BasicMatrix<T> one(0, 0);
+    BasicInferenceBuffers<T> buffers;
+    std::vector <int> predicted;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < singles; i++) {
+        test_images.GatherRange(i, i + 1, one);
+        nn.PredictBatch(one, predicted, buffers);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    Result res;
+    res.accuracy = batched.Accuracy();
+    res.batched = batched.ImagesPerSecond();
+    res.single = singles / std::chrono::duration <double> (t1 - t0).count();
+    return res;
+}
+
+// Trains nn with Adam, data-parallel over every thread, and prints the
+// training rate, test accuracy and inference rates.
+template <typename T>
+void Run(const char *name, BasicNeuralNetwork<T> &nn, int epochs, int batch_size, double learning_rate,
+         const IdxDataset &train_images, const IdxDataset &train_labels,
+         const IdxDataset &test_images, const IdxDataset &test_labels) {
+    size_t parameters = 0;
+    for (size_t l = 0; l < nn.GetWeights().size(); l++) {
+        parameters += nn.GetWeights()[l].GetRows() * nn.GetWeights()[l].GetCols() + nn.GetBiases()[l].GetCols();
+    }
+    int threads = ParallelThreads();
+    BasicAdamOptimizer<T> optimizer(learning_rate);
+    BasicShardedWorkspace<T> workspace;
+    workspace.Reserve(nn.GetLayers(), batch_size, threads);
+    BasicDataLoader<T> loader(train_images, train_labels, batch_size, epochs, static_cast<unsigned int>(std::time(0)));
+    double loss = 0.0;
+    size_t samples = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    while (const BasicBatch<T> *batch = loader.Next()) {
+        loss = nn.BackPropagateBatch(batch -> inputs, batch -> labels, optimizer, workspace);
+        samples += batch -> labels.size();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double train_rate = samples / std::chrono::duration <double> (t1 - t0).count();
+    Result res = Evaluate(nn, test_images, test_labels);
+    printf("%-10s %8zu params  loss %.4f  accuracy %6.2f%%  train %8.0f img/s  infer %9.0f img/s (batch 1000) %8.0f img/s (batch 1)\n",
+           name, parameters, loss, res.accuracy, train_rate, res.batched, res.single);
+}
+
+// The CNN's inference rates with each Conv2D kernel forced in turn.
+template <typename T>
+void CompareConvAlgorithms(const BasicNeuralNetwork<T> &nn, const IdxDataset &test_images, const IdxDataset &test_labels) {
+    const ConvAlgorithm algorithms[] = { ConvAlgorithm::Im2Col, ConvAlgorithm::Direct, ConvAlgorithm::Auto };
+    for (ConvAlgorithm algorithm : algorithms) {
+        SetConvAlgorithm(algorithm);
+        Result res = Evaluate(nn, test_images, test_labels);
+        printf("  conv %-7s accuracy %6.2f%%  infer %9.0f img/s (batch 1000) %8.0f img/s (batch 1)\n",
+               ConvAlgorithmName(algorithm), res.accuracy, res.batched, res.single);
+    }
+    SetConvAlgorithm(ConvAlgorithm::Auto);
+}
+
+template <typename T>
+void RunAll(const char *name, int epochs, int batch_size, double learning_rate) {
+    IdxDataset train_images("dataset/train-images.idx3-ubyte");
+    IdxDataset train_labels("dataset/train-labels.idx1-ubyte");
+    IdxDataset test_images("dataset/t10k-images.idx3-ubyte");
+    IdxDataset test_labels("dataset/t10k-labels.idx1-ubyte");
+    printf("%s, %d epoch(s), batch %d, %d threads\n", name, epochs, batch_size, ParallelThreads());
+
+    BasicNeuralNetwork<T> mlp({ 784, 128, 64, 10 });
+    Run("mlp", mlp, epochs, batch_size, learning_rate, train_images, train_labels, test_images, test_labels);
+    BasicNeuralNetwork<T> cnn(NetworkTopology(28, 28, 1).Conv2D(8, 3).MaxPool(2).Conv2D(16, 3).MaxPool(2)
+                              .Flatten().Dense(64).Dense(10));
+    Run("cnn", cnn, epochs, batch_size, learning_rate, train_images, train_labels, test_images, test_labels);
+    CompareConvAlgorithms(cnn, test_images, test_labels);
+}
+
+// Usage: bench_cnn [float|double] [epochs=N] [batch=N] [lr=X]
+// Trains the 784-128-64-10 MLP and a small CNN (two 3x3 Conv2D + MaxPool
+// stages, then Dense 64 and 10) the same way and compares test accuracy,
+// training and inference throughput, and the im2col and direct conv kernels.
+int main(int argc, char **argv) {
+    bool use_float = false;
+    int epochs = 2;
+    int batch_size = 64;
+    double learning_rate = 1e-3;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "float") use_float = true;
+        else if (arg == "double") use_float = false;
+        else if (arg.compare(0, 7, "epochs=") == 0) epochs = std::max(1, std::atoi(arg.c_str() + 7));
+        else if (arg.compare(0, 6, "batch=") == 0) batch_size = std::max(1, std::atoi(arg.c_str() + 6));
+        else if (arg.compare(0, 3, "lr=") == 0) learning_rate = std::atof(arg.c_str() + 3);
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (use_float) RunAll<float>("float", epochs, batch_size, learning_rate);
+    else RunAll<double>("double", epochs, batch_size, learning_rate);
+    return 0;
+}
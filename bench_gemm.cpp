@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "Gemm.h"
+#include "Math.h"
+
+// The i-j-k loop Matrix::operator* used before the packed GEMM, kept as the baseline.
+void NaiveGemm(int m, int n, int k, const double *a, const double *b, double *c) {
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double sum = 0.0;
+            #pragma omp simd
+            for (int p = 0; p < k; p++) {
+                sum += a[i * k + p] * b[p * n + j];
+            }
+            c[i * n + j] = sum;
+        }
+    }
+}
+
+template <typename F>
+double BestSeconds(F run, double flops) {
+    run();
+    int reps = std::max(3, (int)(2e8 / std::max(flops, 1.0)));
+    double best = 1e30;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        run();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration <double> (t1 - t0).count());
+    }
+    return best;
+}
+
+int main() {
+    const int shapes[][2] = { { 784, 128 }, { 128, 64 }, { 64, 10 } };
+    const GemmIsa isas[] = { GemmIsa::Scalar, GemmIsa::Avx2, GemmIsa::Avx512 };
+
+    printf("%-10s %6s %10s", "shape", "batch", "naive");
+    for (GemmIsa isa : isas) printf(" %10s", GemmIsaName(isa));
+    printf("   (GFLOP/s)\n");
+
+    for (const auto &shape : shapes) {
+        int k = shape[0];
+        int n = shape[1];
+        std::vector <double> b(k * n);
+        for (double &x : b) x = Random();
+        for (int m = 1; m <= 1024; m *= 2) {
+            std::vector <double> a(m * k);
+            for (double &x : a) x = Random();
+            std::vector <double> expected(m * n);
+            std::vector <double> c(m * n);
+            double flops = 2.0 * m * n * k;
+
+            double naive = BestSeconds([&]() { NaiveGemm(m, n, k, a.data(), b.data(), expected.data()); }, flops);
+            printf("%4dx%-5d %6d %10.2f", k, n, m, flops / naive * 1e-9);
+
+            for (GemmIsa isa : isas) {
+                if (!GemmIsaSupported(isa)) {
+                    printf(" %10s", "-");
+                    continue;
+                }
+                SetGemmIsa(isa);
+                double t = BestSeconds([&]() { Gemm(m, n, k, a.data(), k, b.data(), n, c.data(), n); }, flops);
+                double err = 0.0;
+                for (int i = 0; i < m * n; i++) err = std::max(err, std::fabs(c[i] - expected[i]));
+                printf(" %10.2f", flops / t * 1e-9);
+                if (err > 1e-9) printf("!");
+            }
+            printf("\n");
+        }
+    }
+    SetGemmIsa(GemmIsa::Auto);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "HogwildTrainer.h"
+#include "DataLoader.h"
+#include "IdxDataset.h"
+#include "Evaluator.h"
+
+// Training throughput and final test accuracy of the synchronous sharded
+// step against Hogwild, from 1 to N threads (N = omp_get_max_threads(), set
+// with OMP_NUM_THREADS). Every run starts from the same initial weights.
+// Usage: bench_hogwild [sgd|momentum|nesterov|adam|adamw] [epochs]
+
+struct RunResult {
+    double samples_per_second;
+    double accuracy;
+};
+
+const unsigned int seed = 1234;
+const int batch_size = 64;
+
+template <typename T>
+RunResult Synchronous(const IdxDataset &images, const IdxDataset &labels, const IdxDataset &test_images,
+                      const IdxDataset &test_labels, const std::string &optimizer_name, int epochs, int threads) {
+    std::srand(seed);
+    BasicNeuralNetwork<T> nn({ 784, 128, 64, 10 });
+    std::unique_ptr <BasicOptimizer<T>> optimizer = MakeOptimizer<T>(optimizer_name);
+    BasicShardedWorkspace<T> workspace;
+    workspace.Reserve(nn.GetLayerSizes(), batch_size, threads);
+    BasicDataLoader<T> loader(images, labels, batch_size, epochs, seed);
+
+    auto t0 = std::chrono::steady_clock::now();
+    while (const BasicBatch<T> *batch = loader.Next()) {
+        nn.BackPropagateBatch(batch -> inputs, batch -> labels, *optimizer, workspace);
+    }
+    double seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - t0).count();
+    return { images.Count() * (double)epochs / seconds, EvaluateTestSet(nn, test_images, test_labels).Accuracy() };
+}
+
+template <typename T>
+RunResult Hogwild(const IdxDataset &images, const IdxDataset &labels, const IdxDataset &test_images,
+                  const IdxDataset &test_labels, const std::string &optimizer_name, int epochs, int threads) {
+    std::srand(seed);
+    BasicNeuralNetwork<T> nn({ 784, 128, 64, 10 });
+    std::unique_ptr <BasicOptimizer<T>> optimizer = MakeOptimizer<T>(optimizer_name);
+    BasicHogwildTrainer<T> trainer(nn, *optimizer, images, labels, batch_size, threads, seed);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int epoch = 0; epoch < epochs; epoch++) trainer.RunEpoch();
+    double seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - t0).count();
+    return { images.Count() * (double)epochs / seconds, EvaluateTestSet(nn, test_images, test_labels).Accuracy() };
+}
+
+template <typename T>
+void Run(const char *name, const std::string &optimizer_name, int epochs) {
+    IdxDataset images("dataset/train-images.idx3-ubyte");
+    IdxDataset labels("dataset/train-labels.idx1-ubyte");
+    IdxDataset test_images("dataset/t10k-images.idx3-ubyte");
+    IdxDataset test_labels("dataset/t10k-labels.idx1-ubyte");
+
+    int max_threads = omp_get_max_threads();
+    std::vector <int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    printf("%s, %s, %d epochs\n%7s %14s %9s %14s %9s %8s\n", name, optimizer_name.c_str(), epochs,
+           "threads", "sync samples/s", "accuracy", "hogwild samp/s", "accuracy", "speedup");
+    for (int t : thread_counts) {
+        // Caps the GEMM's own parallel regions too, so "1 thread" really is one.
+        omp_set_num_threads(t);
+        RunResult sync = Synchronous<T>(images, labels, test_images, test_labels, optimizer_name, epochs, t);
+        RunResult async = Hogwild<T>(images, labels, test_images, test_labels, optimizer_name, epochs, t);
+        printf("%7d %14.0f %8.2f%% %14.0f %8.2f%% %7.2fx\n", t, sync.samples_per_second, sync.accuracy,
+               async.samples_per_second, async.accuracy, async.samples_per_second / sync.samples_per_second);
+    }
+    omp_set_num_threads(max_threads);
+}
+
+int main(int argc, char **argv) {
+    std::string optimizer_name = argc > 1 ? argv[1] : "adam";
+    int epochs = argc > 2 ? std::atoi(argv[2]) : 2;
+    if (!IsOptimizerName(optimizer_name)) {
+        printf("Unknown optimizer %s\nUsage: bench_hogwild [sgd|momentum|nesterov|adam|adamw] [epochs]\n", optimizer_name.c_str());
+        return 1;
+    }
+    Run<float>("float", optimizer_name, epochs);
+    Run<double>("double", optimizer_name, epochs);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "Math.h"
+
+// Distance from value to the correctly rounded reference, in units of the
+// last place of T at the reference.
+template <typename T>
+double UlpError(T value, long double reference) {
+    T rounded = (T)reference;
+    T ulp = std::nextafter(rounded, std::numeric_limits <T>::infinity()) - rounded;
+    return (double)(std::fabs((long double)value - reference) / ulp);
+}
+
+template <typename T, typename Kernel, typename Reference>
+double MaxUlp(std::vector <T> inputs, Kernel kernel, Reference reference) {
+    std::vector <T> outputs = inputs;
+    kernel(outputs.data(), outputs.size());
+    double worst = 0.0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        worst = std::max(worst, UlpError(outputs[i], reference((long double)inputs[i])));
+    }
+    return worst;
+}
+
+template <typename F>
+double NanosecondsPerValue(F run, size_t n) {
+    run();
+    double best = 1e30;
+    for (int r = 0; r < 200; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        run();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration <double> (t1 - t0).count());
+    }
+    return best * 1e9 / n;
+}
+
+template <typename T>
+std::vector <T> Uniform(T lo, T hi, size_t n, std::mt19937 &rng) {
+    std::uniform_real_distribution <double> dist(lo, hi);
+    std::vector <T> values(n);
+    for (T &x : values) x = (T)dist(rng);
+    return values;
+}
+
+// Positive normal numbers with a uniformly distributed exponent.
+template <typename T>
+std::vector <T> LogUniform(size_t n, std::mt19937 &rng) {
+    std::uniform_real_distribution <double> mantissa(1.0, 2.0);
+    std::uniform_int_distribution <int> exponent(std::numeric_limits <T>::min_exponent, std::numeric_limits <T>::max_exponent - 1);
+    std::vector <T> values(n);
+    for (T &x : values) x = (T)std::ldexp(mantissa(rng), exponent(rng) - 1);
+    return values;
+}
+
+template <typename T>
+void Run(const char *name, T exp_lo, T exp_hi, T sigmoid_bound) {
+    std::mt19937 rng(42);
+    const size_t samples = 1 << 21;
+    auto exp_ref = [](long double x) { return std::exp(x); };
+    auto log_ref = [](long double x) { return std::log(x); };
+    auto sigmoid_ref = [](long double x) { return 1.0L / (1.0L + std::exp(-x)); };
+    auto exp_kernel = [](T *v, size_t n) { ExpInPlace(v, n); };
+    auto log_kernel = [](T *v, size_t n) { LogInPlace(v, n); };
+    auto sigmoid_kernel = [](T *v, size_t n) { SigmoidInPlace(v, n); };
+
+    double exp_ulp = MaxUlp(Uniform(exp_lo, exp_hi, samples, rng), exp_kernel, exp_ref);
+    double log_ulp = MaxUlp(LogUniform <T> (samples, rng), log_kernel, log_ref);
+    double sigmoid_ulp = MaxUlp(Uniform(-sigmoid_bound, sigmoid_bound, samples, rng), sigmoid_kernel, sigmoid_ref);
+
+    const size_t n = 4096;
+    std::vector <T> src = Uniform(T(-10), T(10), n, rng);
+    std::vector <T> src_pos = LogUniform <T> (n, rng);
+    std::vector <T> dst(n);
+    double exp_ns = NanosecondsPerValue([&]() { dst = src; ExpInPlace(dst.data(), n); }, n);
+    double std_exp_ns = NanosecondsPerValue([&]() { for (size_t i = 0; i < n; i++) dst[i] = std::exp(src[i]); }, n);
+    double log_ns = NanosecondsPerValue([&]() { dst = src_pos; LogInPlace(dst.data(), n); }, n);
+    double std_log_ns = NanosecondsPerValue([&]() { for (size_t i = 0; i < n; i++) dst[i] = std::log(src_pos[i]); }, n);
+    double sigmoid_ns = NanosecondsPerValue([&]() { dst = src; SigmoidInPlace(dst.data(), n); }, n);
+    double std_sigmoid_ns = NanosecondsPerValue([&]() { for (size_t i = 0; i < n; i++) dst[i] = Sigmoid(src[i]); }, n);
+
+    printf("%-7s %-8s %8s %12s %12s\n", name, "kernel", "max ulp", "ns/value", "std ns/value");
+    printf("%-7s %-8s %8.2f %12.3f %12.3f\n", "", "exp", exp_ulp, exp_ns, std_exp_ns);
+    printf("%-7s %-8s %8.2f %12.3f %12.3f\n", "", "log", log_ulp, log_ns, std_log_ns);
+    printf("%-7s %-8s %8.2f %12.3f %12.3f\n", "", "sigmoid", sigmoid_ulp, sigmoid_ns, std_sigmoid_ns);
+}
+
+int main() {
+    Run <double> ("double", -708.0, 709.0, 700.0);
+    Run <float> ("float", -87.0f, 88.0f, 80.0f);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <omp.h>
+#include "NeuralNetwork.h"
+#include "Parallel.h"
+
+// Median nanoseconds per call of run().
+template <typename F>
+double NanosecondsPerCall(F run) {
+    for (int r = 0; r < 10; r++) run();
+    const int reps = 201;
+    std::vector <double> times(reps);
+    for (int r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        run();
+        auto t1 = std::chrono::steady_clock::now();
+        times[r] = std::chrono::duration <double, std::nano> (t1 - t0).count();
+    }
+    std::nth_element(times.begin(), times.begin() + reps / 2, times.end());
+    return times[reps / 2];
+}
+
+struct Case {
+    std::string name;
+    std::function <void()> run;
+};
+
+// Element-wise ops at the shapes the 784-128-64-10 network produces, plus a
+// whole training step and a single-image prediction, timed with every loop
+// forking a team (the old behaviour) and with the adaptive policy.
+int main() {
+    printf("OpenMP threads: %d\n", omp_get_max_threads());
+    const int widths[] = { 10, 64, 128, 784 };
+    const int batches[] = { 1, 64 };
+
+    std::vector <Case> cases;
+    std::vector <Matrix *> owned;
+    for (int batch : batches) {
+        for (int width : widths) {
+            Matrix *a = new Matrix(batch, width, true);
+            Matrix *b = new Matrix(batch, width, true);
+            Matrix *row = new Matrix(1, width, true);
+            owned.push_back(a);
+            owned.push_back(b);
+            owned.push_back(row);
+            std::string shape = std::to_string(batch) + "x" + std::to_string(width);
+            cases.push_back({ "AddInPlace " + shape, [=]() { a -> AddInPlace(*b); } });
+            cases.push_back({ "AddRowInPlace " + shape, [=]() { a -> AddRowInPlace(*row); } });
+            cases.push_back({ "HadamardMul " + shape, [=]() { a -> HadamardMul(*b); } });
+            cases.push_back({ "ApplyReLU " + shape, [=]() { a -> ApplyReLU(); } });
+            cases.push_back({ "Transpose " + shape, [=]() { a -> Transpose(); } });
+        }
+    }
+
+    NeuralNetwork nn({ 784, 128, 64, 10 });
+    Matrix batch(64, 784, true);
+    Matrix single(1, 784, true);
+    std::vector <int> labels(64);
+    for (int i = 0; i < 64; i++) labels[i] = i % 10;
+    TrainingWorkspace workspace;
+    workspace.Reserve(nn.GetLayerSizes(), 64);
+    InferenceBuffers buffers;
+    std::vector <int> predicted;
+    cases.push_back({ "training step 64", [&]() { nn.BackPropagateBatch(batch, labels, 0.0, workspace); } });
+    cases.push_back({ "PredictBatch 1", [&]() { nn.PredictBatch(single, predicted, buffers); } });
+    cases.push_back({ "PredictBatch 64", [&]() { nn.PredictBatch(batch, predicted, buffers); } });
+
+    ParallelPolicy always;
+    always.min_work = 1;
+    ParallelPolicy adaptive;
+
+    printf("%-24s %14s %14s\n", "op", "always fork", "adaptive");
+    for (const Case &c : cases) {
+        SetParallelPolicy(always);
+        double forked = NanosecondsPerCall(c.run);
+        SetParallelPolicy(adaptive);
+        double inline_ns = NanosecondsPerCall(c.run);
+        printf("%-24s %11.0f ns %11.0f ns\n", c.name.c_str(), forked, inline_ns);
+    }
+    for (Matrix *m : owned) delete m;
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include "NeuralNetwork.h"
+#include "SparseNetwork.h"
+
+template <typename F>
+double BestSeconds(F run, double work) {
+    run();
+    int reps = std::max(5, (int)(2e7 / std::max(work, 1.0)));
+    double best = 1e30;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        run();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration <double> (t1 - t0).count());
+    }
+    return best;
+}
+
+// Prunes a random 784-128-64-10 network to each sparsity in turn (every
+// layer the same fraction, in whole blocks of the format under test) and
+// times each sparse format against dense PredictProbaBatch, whose cost does
+// not depend on the sparsity, then reports the lowest sparsity from which
+// each format wins. Timings do not depend on the weight values, so no model
+// is needed; the pruned network's dense output checks each result.
+template <typename T>
+void Run(const char *name, const std::vector <int> &batches) {
+    const double sparsities[] = { 0.0, 0.5, 0.7, 0.8, 0.9, 0.95, 0.98, 0.99 };
+    const SparseFormat formats[] = { SparseFormat::Csr, SparseFormat::Block4x4, SparseFormat::Block8x1 };
+    const int format_count = sizeof(formats) / sizeof(formats[0]);
+    BasicNeuralNetwork<T> reference({ 784, 128, 64, 10 });
+    size_t layers = reference.GetWeights().size();
+
+    for (int batch : batches) {
+        BasicMatrix<T> inputs(batch, 784, true);
+        BasicMatrix<T> dense_probs(0, 0), sparse_probs(0, 0);
+        BasicInferenceBuffers<T> dense_buffers;
+        BasicSparseBuffers<T> sparse_buffers;
+        double crossover[format_count];
+        std::fill(crossover, crossover + format_count, -1.0);
+
+        printf("%s, batch %d (us per batch; speedup over dense)\n", name, batch);
+        printf("%9s %10s", "sparsity", "dense");
+        for (SparseFormat format : formats) printf(" %18s", SparseFormatName(format));
+        printf("\n");
+        for (double sparsity : sparsities) {
+            double work = 2.0 * batch * (784 * 128 + 128 * 64 + 64 * 10) * (1.0 - sparsity);
+            double dense = BestSeconds([&]() { reference.PredictProbaBatch(inputs, dense_probs, dense_buffers); }, work);
+            printf("%9.2f %10.1f", sparsity, dense * 1e6);
+            for (int f = 0; f < format_count; f++) {
+                BasicNeuralNetwork<T> nn = reference;
+                std::vector <std::vector <T>> masks = MagnitudeMasks(nn, std::vector <double> (layers, sparsity), formats[f]);
+                for (size_t l = 0; l < layers; l++) nn.MaskWeights(l, masks[l].data());
+                nn.PredictProbaBatch(inputs, dense_probs, dense_buffers);
+                BasicSparseNetwork<T> sparse = BasicSparseNetwork<T>::FromNetwork(nn, formats[f]);
+                double t = BestSeconds([&]() { sparse.PredictProbaBatch(inputs, sparse_probs, sparse_buffers); }, work);
+                double err = 0.0;
+                for (size_t i = 0; i < dense_probs.GetRows() * dense_probs.GetCols(); i++) {
+                    err = std::max(err, (double)std::fabs(dense_probs.Data()[i] - sparse_probs.Data()[i]));
+                }
+                printf(" %10.1f (%4.2fx)%s", t * 1e6, dense / t, err > (sizeof(T) == sizeof(float) ? 1e-4 : 1e-9) ? "!" : " ");
+                if (t < dense && crossover[f] < 0.0) crossover[f] = sparsity;
+            }
+            printf("\n");
+        }
+        printf("crossover:");
+        for (int f = 0; f < format_count; f++) {
+            if (crossover[f] < 0.0) printf("  %s never", SparseFormatName(formats[f]));
+            else printf("  %s >= %.2f", SparseFormatName(formats[f]), crossover[f]);
+        }
+        printf("\n\n");
+    }
+}
+
+// Usage: bench_sparse [float|double] [batch=N ...]
+int main(int argc, char **argv) {
+    bool run_double = true, run_float = true;
+    std::vector <int> batches;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "float") run_double = false;
+        else if (arg == "double") run_float = false;
+        else if (arg.compare(0, 6, "batch=") == 0) batches.push_back(std::max(1, std::atoi(arg.c_str() + 6)));
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (batches.empty()) batches = { 1, 64 };
+    if (run_double) Run<double>("double", batches);
+    if (run_float) Run<float>("float", batches);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include "IdxDataset.h"
+#include "NeuralNetwork.h"
+#include "StaticNetwork.h"
+
+// Median nanoseconds per call of run(i) over a sweep of test images.
+template <typename F>
+double MedianNanoseconds(size_t images, F run) {
+    for (size_t i = 0; i < 100; i++) run(i % images);
+    const size_t reps = 2001;
+    std::vector <double> times(reps);
+    for (size_t r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        run(r % images);
+        auto t1 = std::chrono::steady_clock::now();
+        times[r] = std::chrono::duration <double, std::nano> (t1 - t0).count();
+    }
+    std::nth_element(times.begin(), times.begin() + reps / 2, times.end());
+    return times[reps / 2];
+}
+
+// Loads the saved model into both the runtime-shaped network and the
+// compile-time StaticNetwork<784, 128, 64, 10>, checks that they agree on
+// every test image, and times single-image inference through FeedForward,
+// PredictBatch with one row, and the static network.
+template <typename T>
+void Run(const char *name, const std::string &model_path, const IdxDataset &images) {
+    BasicNeuralNetwork<T> nn = BasicNeuralNetwork<T>::FromFile(model_path);
+    std::unique_ptr <BasicStaticNetwork<T, 784, 128, 64, 10>> fixed(new BasicStaticNetwork<T, 784, 128, 64, 10>());
+    fixed -> LoadModel(model_path);
+
+    size_t count = images.Count();
+    BasicMatrix<T> all(0, 0);
+    images.GatherRange(0, count, all);
+    BasicInferenceBuffers<T> buffers;
+    BasicMatrix<T> probs(0, 0);
+    nn.PredictProbaBatch(all, probs, buffers);
+
+    double max_diff = 0.0;
+    size_t same_label = 0;
+    T row[10];
+    for (size_t i = 0; i < count; i++) {
+        fixed -> PredictProba(all.Data() + i * 784, row);
+        const T *reference = probs.Data() + i * 10;
+        for (int c = 0; c < 10; c++) max_diff = std::max(max_diff, (double)std::fabs(row[c] - reference[c]));
+        same_label += std::max_element(row, row + 10) - row == std::max_element(reference, reference + 10) - reference;
+    }
+    printf("%s: %zu / %zu labels agree, max |probability difference| %.3g\n", name, same_label, count, max_diff);
+
+    std::vector <T> vector_input(784);
+    BasicMatrix<T> single(1, 784);
+    std::vector <int> predicted;
+    double feed_forward = MedianNanoseconds(count, [&](size_t i) {
+        std::copy(all.Data() + i * 784, all.Data() + (i + 1) * 784, vector_input.begin());
+        nn.FeedForward(vector_input);
+    });
+    double predict_batch = MedianNanoseconds(count, [&](size_t i) {
+        std::copy(all.Data() + i * 784, all.Data() + (i + 1) * 784, single.Data());
+        nn.PredictBatch(single, predicted, buffers);
+    });
+    double static_ns = MedianNanoseconds(count, [&](size_t i) {
+        fixed -> Predict(images.Item(i));
+    });
+    printf("  FeedForward %8.0f ns   PredictBatch(1) %8.0f ns   StaticNetwork %8.0f ns (from pixel bytes)\n",
+           feed_forward, predict_batch, static_ns);
+}
+
+// Usage: bench_static [model=file] [images=file]
+int main(int argc, char **argv) {
+    std::string model_path = "mnist_model.dat";
+    std::string images_path = "dataset/t10k-images.idx3-ubyte";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 6, "model=") == 0) model_path = arg.substr(6);
+        else if (arg.compare(0, 7, "images=") == 0) images_path = arg.substr(7);
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    IdxDataset images(images_path);
+    Run<double>("double", model_path, images);
+    Run<float>("float", model_path, images);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include <string>
+#include "NeuralNetwork.h"
+#include "Parallel.h"
+
+// Median seconds per BackPropagateBatch step on the sharded path.
+template <typename T>
+double StepSeconds(BasicNeuralNetwork<T> &nn, const BasicMatrix<T> &inputs, const std::vector <int> &labels, int threads) {
+    // Caps the GEMM's own parallel regions too, so "1 thread" really is one.
+    // The pool backend sizes itself from ConfigureGlobalThreadPool instead.
+    omp_set_num_threads(threads);
+    BasicSgdOptimizer<T> sgd(0.0);
+    BasicShardedWorkspace<T> workspace;
+    workspace.Reserve(nn.GetLayerSizes(), inputs.GetRows(), threads);
+    nn.PlaceParameters(sgd, threads);
+    for (int r = 0; r < 3; r++) nn.BackPropagateBatch(inputs, labels, sgd, workspace);
+
+    int reps = std::max(5, (int)(2e5 / inputs.GetRows()));
+    std::vector <double> times(reps);
+    for (int r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        nn.BackPropagateBatch(inputs, labels, sgd, workspace);
+        auto t1 = std::chrono::steady_clock::now();
+        times[r] = std::chrono::duration <double> (t1 - t0).count();
+    }
+    std::nth_element(times.begin(), times.begin() + reps / 2, times.end());
+    return times[reps / 2];
+}
+
+// Batch time of one training step for the 784-128-64-10 network from 1 to
+// N threads (N = omp_get_max_threads(), set with OMP_NUM_THREADS).
+template <typename T>
+void Run(const char *name) {
+    BasicNeuralNetwork<T> nn({ 784, 128, 64, 10 });
+    int max_threads = omp_get_max_threads();
+    std::vector <int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    printf("%s\n%6s", name, "batch");
+    for (int t : thread_counts) printf(" %9dT", t);
+    printf("   (ms per step, speedup vs 1 thread)\n");
+
+    for (int batch = 64; batch <= 1024; batch *= 4) {
+        BasicMatrix<T> inputs(batch, 784, true);
+        std::vector <int> labels(batch);
+        for (int i = 0; i < batch; i++) labels[i] = i % 10;
+
+        printf("%6d", batch);
+        double base = 0.0;
+        for (int t : thread_counts) {
+            double seconds = StepSeconds(nn, inputs, labels, t);
+            if (t == 1) base = seconds;
+            printf(" %7.3f/%-4.1f", seconds * 1e3, base / seconds);
+        }
+        printf("\n");
+    }
+    omp_set_num_threads(max_threads);
+}
+
+void SetBackend(ParallelBackend backend) {
+    ParallelPolicy policy = GetParallelPolicy();
+    policy.backend = backend;
+    SetParallelPolicy(policy);
+}
+
+// Step time at batch 256 on one thread, on every CPU of the first NUMA node
+// and on every CPU of all nodes, with OpenMP (placement left to the OS and
+// OMP_PROC_BIND) and with the pinned work-stealing pool. Speedups are
+// against OpenMP on one thread.
+template <typename T>
+void CompareBackends(const char *name) {
+    std::vector <NumaNode> nodes = DetectNumaNodes();
+    struct Config {
+        std::string label;
+        ThreadPoolOptions pool;
+    };
+    std::vector <Config> configs;
+    ThreadPoolOptions one;
+    one.threads = 1;
+    one.nodes = 1;
+    configs.push_back({ "1 thread", one });
+    ThreadPoolOptions first_node;
+    first_node.nodes = 1;
+    configs.push_back({ "node " + std::to_string(nodes[0].id) + " full", first_node });
+    if (nodes.size() > 1) configs.push_back({ std::to_string(nodes.size()) + " nodes full", ThreadPoolOptions() });
+
+    BasicNeuralNetwork<T> nn({ 784, 128, 64, 10 });
+    const int batch = 256;
+    BasicMatrix<T> inputs(batch, 784, true);
+    std::vector <int> labels(batch);
+    for (int i = 0; i < batch; i++) labels[i] = i % 10;
+
+    int max_threads = omp_get_max_threads();
+    printf("%s, batch %d\n%-16s %8s %19s %19s\n", name, batch, "config", "threads", "OpenMP", "pool");
+    double base = 0.0;
+    for (const Config &config : configs) {
+        ConfigureGlobalThreadPool(config.pool);
+        int threads = GlobalThreadPool().Threads();
+        SetBackend(ParallelBackend::OpenMP);
+        double openmp = StepSeconds(nn, inputs, labels, threads);
+        if (base == 0.0) base = openmp;
+        SetBackend(ParallelBackend::Pool);
+        double pool = StepSeconds(nn, inputs, labels, threads);
+        printf("%-16s %8d %9.3f ms %6.2fx %9.3f ms %6.2fx\n", config.label.c_str(), threads, openmp * 1e3, base / openmp,
+               pool * 1e3, base / pool);
+    }
+    if (nodes.size() == 1) printf("(one NUMA node: all nodes full is the same as node %d full)\n", nodes[0].id);
+    SetBackend(ParallelBackend::OpenMP);
+    omp_set_num_threads(max_threads);
+}
+
+int main() {
+    Run<double>("double");
+    Run<float>("float");
+    printf("\n");
+    CompareBackends<double>("double");
+    CompareBackends<float>("float");
+    return 0;
+}
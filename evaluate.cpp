@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "NeuralNetwork.h"
+#include "Evaluator.h"
+
+// Streams a test set through the saved model and prints accuracy, the
+// confusion matrix, per-class precision/recall and latency percentiles.
+// Memory stays bounded by the chunk size, so sets far larger than MNIST's
+// 10k test images can be evaluated; batches are spread over
+// ParallelThreads() threads (OMP_NUM_THREADS) unless threads= is given.
+// Usage: evaluate [float] [model=file] [images=file] [labels=file]
+//                 [batch=N] [chunk=N] [threads=N]
+
+static void PrintLatency(const char *name, const LatencyHistogram &histogram) {
+    printf("%-8s p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  p99.9 %9.1f us  max %9.1f us  (%llu)\n", name,
+           histogram.PercentileNs(0.5) * 1e-3, histogram.PercentileNs(0.9) * 1e-3, histogram.PercentileNs(0.99) * 1e-3,
+           histogram.PercentileNs(0.999) * 1e-3, histogram.MaxNs() * 1e-3, (unsigned long long)histogram.Count());
+}
+
+static void PrintReport(const EvaluationReport &report) {
+    printf("%llu / %llu correct, accuracy %.2f%%, %.0f samples/s\n\n", (unsigned long long)report.correct,
+           (unsigned long long)report.samples, report.Accuracy(), report.seconds > 0 ? report.samples / report.seconds : 0.0);
+
+    printf("Confusion matrix (rows: actual, columns: predicted)\n      ");
+    for (int p = 0; p < report.classes; p++) printf("%7d", p);
+    printf("\n");
+    for (int a = 0; a < report.classes; a++) {
+        printf("%5d ", a);
+        for (int p = 0; p < report.classes; p++) printf("%7llu", (unsigned long long)report.Confusion(a, p));
+        printf("\n");
+    }
+
+    printf("\nclass  precision  recall\n");
+    for (int c = 0; c < report.classes; c++) {
+        printf("%5d  %8.2f%%  %6.2f%%\n", c, 100.0 * report.Precision(c), 100.0 * report.Recall(c));
+    }
+
+    printf("\n");
+    PrintLatency("batch", report.batch_latency);
+    PrintLatency("sample", report.sample_latency);
+}
+
+template <typename T>
+EvaluationReport Run(const std::string &model_path, const std::string &images_path, const std::string &labels_path,
+                     const EvaluationOptions &options) {
+    BasicNeuralNetwork<T> nn = BasicNeuralNetwork<T>::FromFile(model_path);
+    BasicEvaluator<T> evaluator(nn, options);
+    return evaluator.Run(images_path, labels_path);
+}
+
+int main(int argc, char **argv) {
+    std::string model_path = "mnist_model.dat";
+    std::string images_path = "dataset/t10k-images.idx3-ubyte";
+    std::string labels_path = "dataset/t10k-labels.idx1-ubyte";
+    EvaluationOptions options;
+    bool use_float = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (arg == "float") use_float = true;
+        else if (key == "model") model_path = value;
+        else if (key == "images") images_path = value;
+        else if (key == "labels") labels_path = value;
+        else if (key == "batch") options.batch_size = (size_t)std::atol(value.c_str());
+        else if (key == "chunk") options.chunk_size = (size_t)std::atol(value.c_str());
+        else if (key == "threads") options.threads = std::atoi(value.c_str());
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (options.batch_size == 0 || options.chunk_size == 0) {
+        printf("batch and chunk must be positive\n");
+        return 1;
+    }
+
+    EvaluationReport report = use_float ? Run<float>(model_path, images_path, labels_path, options)
+                                        : Run<double>(model_path, images_path, labels_path, options);
+    printf("Evaluated %s with %s weights, batch %zu, chunk %zu.\n", images_path.c_str(), use_float ? "float" : "double",
+           options.batch_size, options.chunk_size);
+    PrintReport(report);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include "Matrix.h"
+#include "IdxDataset.h"
+
+// One training batch: inputs is N x item size, labels holds the N class indices.
+template <typename T>
+struct BasicBatch {
+    BasicMatrix<T> inputs = BasicMatrix<T>(0, 0);
+    std::vector <int> labels;
+    int epoch = 0;
+    size_t index = 0;
+};
+
+// Produces shuffled training batches on a background thread. It keeps up to
+// `prefetch` finished batches ahead of the consumer in a ring of reusable
+// slots, so gathering and converting the next batch overlaps with training
+// on the current one. Batches for all `epochs` are produced in order; the
+// data is reshuffled at the start of every epoch.
+//
+// With shards > 1 the loader only serves shard number `shard`: a contiguous
+// Count() / shards items (the remainder is dropped so that every shard has
+// the same number of batches, which lockstep data-parallel workers need).
+template <typename T>
+class BasicDataLoader {
+private:
+    const IdxDataset &images;
+    const IdxDataset &labels;
+    size_t batch_size;
+    int epochs;
+    std::mt19937 rng;
+    std::vector <size_t> order;
+    std::vector <BasicBatch<T>> slots;
+
+    std::mutex mutex;
+    std::condition_variable slot_free;
+    std::condition_variable slot_ready;
+    size_t produced;
+    size_t consumed;
+    size_t released;
+    bool holding;
+    bool stopping;
+    std::thread worker;
+
+    void Produce();
+public:
+    BasicDataLoader(const IdxDataset &images, const IdxDataset &labels, size_t batch_size,
+                    int epochs, unsigned int seed, size_t prefetch = 2, size_t shard = 0, size_t shards = 1);
+    ~BasicDataLoader();
+    BasicDataLoader(const BasicDataLoader &) = delete;
+    BasicDataLoader &operator=(const BasicDataLoader &) = delete;
+
+    // Returns the next batch, blocking until it is ready, or nullptr once every
+    // epoch has been delivered. The batch stays valid until the next call.
+    const BasicBatch<T> *Next();
+    size_t BatchesPerEpoch() const;
+};
+
+typedef BasicBatch<double> Batch;
+typedef BasicBatch<float> BatchF;
+typedef BasicDataLoader<double> DataLoader;
+typedef BasicDataLoader<float> DataLoaderF;
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include "NeuralNetwork.h"
+#include "IdxDataset.h"
+
+// Latency distribution in log-spaced buckets (8 per power of two, so any
+// percentile is within ~9% of the true value). Its size is fixed however many
+// samples it sees, which keeps evaluation of huge sets bounded in memory.
+class LatencyHistogram {
+private:
+    static const int BUCKETS_PER_OCTAVE = 8;
+    static const int OCTAVES = 48;
+    std::vector <uint64_t> counts;
+    uint64_t total;
+    double sum_ns;
+    uint64_t max_ns;
+
+public:
+    LatencyHistogram();
+    // Records count samples that each took ns nanoseconds.
+    void Add(uint64_t ns, uint64_t count = 1);
+    void Merge(const LatencyHistogram &other);
+    uint64_t Count() const;
+    double MeanNs() const;
+    uint64_t MaxNs() const;
+    // Upper edge of the bucket holding quantile p in [0, 1]; 0 when empty.
+    double PercentileNs(double p) const;
+};
+
+struct EvaluationOptions {
+    // Rows per PredictBatch call; also the unit of work handed to a thread.
+    size_t batch_size = 256;
+    // Items read from disk at a time. Two chunks are resident: the one being
+    // evaluated and the next one being read.
+    size_t chunk_size = 16384;
+    // 0 uses ParallelThreads(), the threads of the current backend.
+    int threads = 0;
+};
+
+struct EvaluationReport {
+    int classes = 0;
+    // confusion[actual * classes + predicted].
+    std::vector <uint64_t> confusion;
+    uint64_t samples = 0;
+    uint64_t correct = 0;
+    double seconds = 0.0;
+    // Wall time of each PredictBatch call.
+    LatencyHistogram batch_latency;
+    // Batch time divided by its rows, weighted by rows (the amortized cost
+    // of one sample; use batch_size = 1 for true single-sample latency).
+    LatencyHistogram sample_latency;
+
+    uint64_t Confusion(int actual, int predicted) const;
+    double Accuracy() const;
+    // Of the samples predicted as c, the fraction that are c; 0 if none were.
+    double Precision(int c) const;
+    // Of the samples labeled c, the fraction predicted as c; 0 if none are.
+    double Recall(int c) const;
+};
+
+// Streams an IDX image/label pair through a trained network and collects an
+// EvaluationReport. A reader thread loads the next chunk while the current
+// one is split into batches across a ParallelTeam; each member runs the
+// const PredictBatch path with its own buffers and counts into its own
+// confusion matrix and histograms, merged at the end. Instantiated for
+// float and double in src/Evaluator.cpp.
+template <typename T>
+class BasicEvaluator {
+private:
+    struct ThreadState {
+        BasicInferenceBuffers<T> buffers;
+        BasicMatrix<T> batch = BasicMatrix<T>(0, 0);
+        std::vector <int> predicted;
+        std::vector <uint64_t> confusion;
+        LatencyHistogram batch_latency;
+        LatencyHistogram sample_latency;
+    };
+
+    const BasicNeuralNetwork<T> &nn;
+    EvaluationOptions options;
+    std::vector <ThreadState> states;
+
+    void EvaluateChunk(const std::vector <uint8_t> &images, const std::vector <uint8_t> &labels, size_t count,
+                       size_t item_size, int classes);
+
+public:
+    BasicEvaluator(const BasicNeuralNetwork<T> &nn, const EvaluationOptions &options = EvaluationOptions());
+    BasicEvaluator(const BasicEvaluator &) = delete;
+    BasicEvaluator &operator=(const BasicEvaluator &) = delete;
+
+    EvaluationReport Run(const std::string &images_path, const std::string &labels_path);
+};
+
+// Accuracy and speed of one pass over an in-memory test set.
+struct TestSetResult {
+    size_t samples = 0;
+    size_t correct = 0;
+    // Time spent inside predict; gathering the batches is not counted.
+    double seconds = 0.0;
+
+    double Accuracy() const;
+    double ImagesPerSecond() const;
+};
+
+// Runs the test set through predict(batch, predicted) in batches of
+// batch_size rows and counts the predictions that match the labels. predict
+// may wrap any model that classifies a batch (dense, int8, sparse), so their
+// numbers all come from this one loop. For streaming a file too large to
+// gather, with latencies and a confusion matrix, use BasicEvaluator.
+template <typename T, typename F>
+TestSetResult EvaluateTestSet(const IdxDataset &images, const IdxDataset &labels, F predict, size_t batch_size = 1000) {
+    BasicMatrix<T> batch(0, 0);
+    std::vector <int> predicted;
+    TestSetResult res;
+    for (size_t start = 0; start < images.Count(); start += batch_size) {
+        size_t end = std::min(start + batch_size, images.Count());
+        images.GatherRange(start, end, batch);
+        auto t0 = std::chrono::steady_clock::now();
+        predict(batch, predicted);
+        res.seconds += std::chrono::duration <double> (std::chrono::steady_clock::now() - t0).count();
+        for (size_t i = start; i < end; i++) res.correct += predicted[i - start] == labels.Label(i);
+    }
+    res.samples = images.Count();
+    return res;
+}
+
+template <typename T>
+TestSetResult EvaluateTestSet(const BasicNeuralNetwork<T> &nn, const IdxDataset &images, const IdxDataset &labels,
+                              size_t batch_size = 1000) {
+    BasicInferenceBuffers<T> buffers;
+    return EvaluateTestSet<T>(images, labels, [&](const BasicMatrix<T> &batch, std::vector <int> &predicted) {
+        nn.PredictBatch(batch, predicted, buffers);
+    }, batch_size);
+}
+
+typedef BasicEvaluator<double> Evaluator;
+typedef BasicEvaluator<float> EvaluatorF;
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+
+// Instruction set used by the packed GEMM micro-kernel. Auto picks the widest
+// one the running CPU supports; forcing an unsupported one falls back to Auto.
+enum class GemmIsa { Auto, Scalar, Avx2, Avx512 };
+
+void SetGemmIsa(GemmIsa isa);
+GemmIsa GetGemmIsa();
+const char *GemmIsaName(GemmIsa isa);
+bool GemmIsaSupported(GemmIsa isa);
+
+enum class GemmActivation { None, ReLU };
+
+// Element-wise work folded into the GEMM and applied to each tile of C as soon
+// as it is final, while it is still in cache: c = act(c + bias[j]), then, if a
+// mask is given, c is zeroed wherever mask[i][j] <= 0 (the ReLU derivative of
+// the activations in mask).
+template <typename T>
+struct GemmEpilogue {
+    const T *bias = nullptr;
+    GemmActivation activation = GemmActivation::None;
+    const T *mask = nullptr;
+    size_t ldmask = 0;
+};
+
+// Which operands the product reads transposed, BLAS-style: with A, the a
+// argument holds A^T as a k x m matrix and op(A) = A (lda is still that
+// array's row stride); with B, b holds B^T as n x k. Nothing is copied.
+enum class GemmTranspose { None, A, B, Both };
+
+// C = A * B, all row-major: A is m x k, B is k x n, C is m x n.
+// lda/ldb/ldc are the row strides in elements. C is overwritten.
+void Gemm(size_t m, size_t n, size_t k,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc,
+          const GemmEpilogue<double> &epilogue = GemmEpilogue<double>());
+void Gemm(size_t m, size_t n, size_t k,
+          const float *a, size_t lda,
+          const float *b, size_t ldb,
+          float *c, size_t ldc,
+          const GemmEpilogue<float> &epilogue = GemmEpilogue<float>());
+// C = op(A) * op(B), with op(A) m x k and op(B) k x n as described above.
+void Gemm(GemmTranspose transpose, size_t m, size_t n, size_t k,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc,
+          const GemmEpilogue<double> &epilogue = GemmEpilogue<double>());
+void Gemm(GemmTranspose transpose, size_t m, size_t n, size_t k,
+          const float *a, size_t lda,
+          const float *b, size_t ldb,
+          float *c, size_t ldc,
+          const GemmEpilogue<float> &epilogue = GemmEpilogue<float>());
+
+// dst = src^T for a rows x cols row-major src; dst is cols x rows. lds/ldd
+// are the row strides. Tiled for cache and transposed in registers.
+void TransposeCopy(size_t rows, size_t cols, const double *src, size_t lds, double *dst, size_t ldd);
+void TransposeCopy(size_t rows, size_t cols, const float *src, size_t lds, float *dst, size_t ldd);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "IdxDataset.h"
+
+// Asynchronous (Hogwild) data-parallel training, an opt-in alternative to
+// the synchronous sharded BackPropagateBatch. Each of `threads` workers
+// claims the next mini-batch of the epoch from a shared atomic counter,
+// gathers it itself, computes gradients against the current shared weights
+// and applies its optimizer update straight to them, with no barrier or lock
+// between batches. Updates from different workers may interleave and
+// partly overwrite each other; that costs a little accuracy per epoch but
+// keeps every core busy. Threads only meet at epoch ends, where
+// the data is reshuffled. Instantiated for float and double in
+// src/HogwildTrainer.cpp.
+template <typename T>
+class BasicHogwildTrainer {
+private:
+    BasicNeuralNetwork<T> &nn;
+    BasicOptimizer<T> &optimizer;
+    const IdxDataset &images;
+    const IdxDataset &labels;
+    size_t batch_size;
+    int threads;
+    std::mt19937 rng;
+    std::vector <size_t> order;
+    // Per-worker scratch, reserved up front so steps never allocate.
+    std::vector <BasicTrainingWorkspace<T>> workspaces;
+    std::vector <BasicMatrix<T>> inputs;
+    std::vector <std::vector <int>> batch_labels;
+    std::vector <double> losses;
+
+public:
+    BasicHogwildTrainer(BasicNeuralNetwork<T> &nn, BasicOptimizer<T> &optimizer, const IdxDataset &images,
+                        const IdxDataset &labels, size_t batch_size, int threads, unsigned int seed);
+    BasicHogwildTrainer(const BasicHogwildTrainer &) = delete;
+    BasicHogwildTrainer &operator=(const BasicHogwildTrainer &) = delete;
+
+    // Trains one shuffled pass over the data and returns its mean loss.
+    double RunEpoch();
+    size_t BatchesPerEpoch() const;
+};
+
+typedef BasicHogwildTrainer<double> HogwildTrainer;
+typedef BasicHogwildTrainer<float> HogwildTrainerF;
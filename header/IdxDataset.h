@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include "Matrix.h"
+#include "MappedFile.h"
+
+// Prints "path: problem" and exits unless ok. The IDX readers check every
+// header field and size with it rather than assert, so that a malformed or
+// truncated file fails in release builds too instead of being read past its
+// end.
+void CheckIdxFile(bool ok, const std::string &path, const char *problem);
+
+// Read-only, memory-mapped view of an unsigned-byte IDX file (the MNIST
+// image and label format). The file is mapped once and never copied: Item()
+// returns a pointer straight into the mapping, and Gather() converts only the
+// requested items into a caller-owned batch matrix.
+class IdxDataset {
+private:
+    MappedFile file;
+    std::vector <int> dims;
+    const uint8_t *payload;
+    size_t item_size;
+
+public:
+    explicit IdxDataset(const std::string &path);
+    IdxDataset(const IdxDataset &) = delete;
+    IdxDataset &operator=(const IdxDataset &) = delete;
+
+    size_t Count() const;
+    size_t ItemSize() const;
+    const std::vector <int> &Dims() const;
+    const uint8_t *Item(size_t index) const;
+    int Label(size_t index) const;
+
+    // Writes items indices[0..n) into batch as rows scaled to [0, 1].
+    template <typename T>
+    void Gather(const size_t *indices, size_t n, BasicMatrix<T> &batch) const;
+    // Same for the contiguous range [start, end).
+    template <typename T>
+    void GatherRange(size_t start, size_t end, BasicMatrix<T> &batch) const;
+};
+
+// Sequential reader for IDX files too large to map or keep resident, e.g. a
+// multi-million-image evaluation set. Items are read in order into a
+// caller-owned buffer, so memory is bounded by the chunk size rather than
+// the file size.
+class IdxStream {
+private:
+    std::ifstream file;
+    std::string path;
+    std::vector <int> dims;
+    size_t item_size;
+    size_t position;
+
+public:
+    explicit IdxStream(const std::string &path);
+    IdxStream(const IdxStream &) = delete;
+    IdxStream &operator=(const IdxStream &) = delete;
+
+    size_t Count() const;
+    size_t ItemSize() const;
+    const std::vector <int> &Dims() const;
+    // Reads the next min(max_items, remaining) items into bytes, resized to
+    // hold them, and returns how many were read; 0 at the end of the file.
+    size_t Read(size_t max_items, std::vector <uint8_t> &bytes);
+};
+
+// Writes rows consecutive items of item_size bytes from src into batch,
+// scaled to [0, 1]. Shared by IdxDataset and IdxStream callers.
+template <typename T>
+void BytesToRows(const uint8_t *src, size_t rows, size_t item_size, BasicMatrix<T> &batch);
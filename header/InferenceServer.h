@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "NeuralNetwork.h"
+
+// Wire protocol over a Unix domain stream socket, in host byte order (both
+// ends are on the same machine):
+//   on connect, server -> client:  InferenceHello
+//   client -> server, per image:   uint32 id, then hello.input_size pixel bytes
+//                                  (0..255, e.g. a 28 x 28 MNIST image)
+//   server -> client, per image:   InferenceResponse with the same id
+// A client may pipeline any number of requests; responses come back in the
+// order their batches finish, which is not necessarily request order.
+struct InferenceHello {
+    uint32_t input_size;
+    uint32_t classes;
+};
+
+struct InferenceResponse {
+    uint32_t id;
+    int32_t label;
+    float probability;
+};
+
+struct InferenceServerOptions {
+    // Largest micro-batch handed to PredictProbaBatch.
+    size_t max_batch = 64;
+    // How long the oldest queued request may wait for others to join its
+    // batch. 0 runs whatever is queued as soon as a worker is free.
+    uint32_t max_delay_us = 500;
+    // Batches run concurrently on this many threads, a ParallelTeam of the
+    // current backend; the pool runs at most its own thread count of them at
+    // once. With 1 the GEMMs of a batch may use every thread instead.
+    int workers = 1;
+    // Requests buffered before the server stops reading from clients.
+    size_t max_pending = 4096;
+};
+
+// Long-running inference daemon for a loaded network. An I/O thread accepts
+// clients and reads requests with poll() into a bounded queue; worker threads
+// take the oldest request, wait up to max_delay_us for up to max_batch - 1
+// more, run them through the network as one batch, and write each response
+// back to its connection. The queue and batch buffers are sized up front, so
+// serving allocates nothing per request. POSIX only. Instantiated for float
+// and double in src/InferenceServer.cpp.
+template <typename T>
+class BasicInferenceServer {
+private:
+    struct Connection;
+    struct Pending {
+        std::shared_ptr <Connection> connection;
+        uint32_t id;
+        uint64_t arrival_ns;
+    };
+
+    const BasicNeuralNetwork<T> &nn;
+    InferenceServerOptions options;
+    std::string socket_path;
+    int listen_fd;
+    size_t input_size;
+
+    // Ring of pending requests; pixels[slot * input_size] holds slot's image.
+    std::vector <Pending> pending;
+    std::vector <uint8_t> pixels;
+    size_t head;
+    size_t count;
+    std::mutex mutex;
+    std::condition_variable request_ready;
+    bool stopping;
+    std::atomic <bool> stop_requested;
+    std::atomic <uint64_t> served;
+    std::atomic <uint64_t> batches;
+
+    void ServeConnections();
+    void RunWorker();
+    size_t FreeSlots();
+    void Enqueue(const std::shared_ptr <Connection> &connection, const uint8_t *frame);
+public:
+    // Binds and listens on socket_path, replacing a stale socket file.
+    BasicInferenceServer(const BasicNeuralNetwork<T> &nn, const std::string &socket_path,
+                         const InferenceServerOptions &options = InferenceServerOptions());
+    ~BasicInferenceServer();
+    BasicInferenceServer(const BasicInferenceServer &) = delete;
+    BasicInferenceServer &operator=(const BasicInferenceServer &) = delete;
+
+    // Serves until RequestStop(); returns once every worker has finished.
+    void Run();
+    // Only sets a flag, so it is safe from a signal handler or another thread.
+    void RequestStop();
+    uint64_t RequestsServed() const;
+    uint64_t BatchesRun() const;
+};
+
+// Blocking client for the protocol above.
+class InferenceClient {
+private:
+    int fd;
+    InferenceHello hello;
+
+public:
+    explicit InferenceClient(const std::string &socket_path);
+    ~InferenceClient();
+    InferenceClient(const InferenceClient &) = delete;
+    InferenceClient &operator=(const InferenceClient &) = delete;
+
+    const InferenceHello &Hello() const;
+    // Sends one request of Hello().input_size pixels.
+    bool Send(uint32_t id, const uint8_t *image);
+    // Blocks for the next response.
+    bool Receive(InferenceResponse &response);
+    // Send followed by Receive; returns the predicted label or -1.
+    int Predict(const uint8_t *image);
+};
+
+typedef BasicInferenceServer<double> InferenceServer;
+typedef BasicInferenceServer<float> InferenceServerF;
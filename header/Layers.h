@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Activations hold one sample per row. A feature map is stored height x
+// width x channels with the channels innermost (NHWC). For an N-row batch a
+// Conv2D is then one (N * out_h * out_w) x (kernel^2 * in_c) by
+// (kernel^2 * in_c) x out_c GEMM over the im2col patches, and the GEMM's
+// output is already the next layer's activation. Flattening a feature map
+// for a dense layer moves no data.
+enum class LayerKind : int32_t { Dense = 0, Conv2D = 1, MaxPool = 2 };
+
+struct LayerSpec {
+    LayerKind kind = LayerKind::Dense;
+    // Input and output shapes; a dense layer's are 1 x 1 x size.
+    int in_h = 1, in_w = 1, in_c = 0;
+    int out_h = 1, out_w = 1, out_c = 0;
+    // Window of a Conv2D or MaxPool. MaxPool windows do not overlap
+    // (stride == kernel) and are never padded.
+    int kernel = 0;
+    int stride = 1;
+    int padding = 0;
+
+    int InputSize() const;
+    int OutputSize() const;
+    // Dense weights are in x out, Conv2D weights (kernel^2 * in_c) x out_c
+    // with rows ordered (ky, kx, channel) like an im2col patch. MaxPool has
+    // no parameters (0 x 0 weights, 0 biases).
+    int WeightRows() const;
+    int WeightCols() const;
+    int BiasSize() const;
+    bool operator==(const LayerSpec &other) const;
+    bool operator!=(const LayerSpec &other) const;
+};
+
+// Builds the layers of a network from its input shape, e.g. a small CNN:
+//   NetworkTopology(28, 28, 1).Conv2D(8, 3).MaxPool(2).Conv2D(16, 3).MaxPool(2).Flatten().Dense(64).Dense(10)
+// Conv2D pads to keep the size ("same") unless told otherwise. Flatten ends
+// the feature maps; it is required before the first Dense and is not a layer
+// of its own.
+class NetworkTopology {
+private:
+    std::vector <LayerSpec> layers;
+    int h, w, c;
+    bool flat;
+public:
+    NetworkTopology(int height, int width, int channels);
+    NetworkTopology &Conv2D(int filters, int kernel, int stride = 1, int padding = -1);
+    NetworkTopology &MaxPool(int size);
+    NetworkTopology &Flatten();
+    NetworkTopology &Dense(int size);
+    const std::vector <LayerSpec> &Layers() const;
+};
+
+// The layers of a plain multilayer perceptron with these sizes.
+std::vector <LayerSpec> DenseLayers(const std::vector <int> &layer_sizes);
+// Flattened activation widths: the input size, then each layer's output.
+std::vector <int> LayerSizes(const std::vector <LayerSpec> &layers);
+
+// Which kernel inference uses for a Conv2D. Auto picks Direct for 3x3
+// stride-1 layers of up to 32 filters and Im2Col otherwise; forcing Direct
+// on a layer it cannot run (more than 64 filters, another kernel size or a
+// stride) falls back to Im2Col. Training always uses Im2Col, since the
+// patches are reused for the weight gradient.
+enum class ConvAlgorithm { Auto, Im2Col, Direct };
+
+void SetConvAlgorithm(ConvAlgorithm algorithm);
+ConvAlgorithm GetConvAlgorithm();
+const char *ConvAlgorithmName(ConvAlgorithm algorithm);
+// Whether inference runs this Conv2D with the direct kernel.
+bool UseDirectConv(const LayerSpec &spec);
+
+// columns ((n * out_h * out_w) x (kernel^2 * in_c)) = the patch under every
+// output pixel of n input feature maps, zero where it hangs over the edge.
+template <typename T>
+void Im2Col(const LayerSpec &spec, const T *input, size_t n, T *columns);
+// The adjoint of Im2Col: adds every patch gradient back onto the input
+// pixels it was read from. input_grad must start zeroed.
+template <typename T>
+void Col2Im(const LayerSpec &spec, const T *columns, size_t n, T *input_grad);
+// A 3x3 stride-1 Conv2D straight from the NHWC input, vectorized across the
+// output channels, with bias and optional ReLU.
+template <typename T>
+void Conv3x3Direct(const LayerSpec &spec, const T *input, size_t n, const T *weights, const T *bias, bool relu, T *output);
+// bias_grad (out_c) = the sum over every output pixel of n Conv2D output
+// gradients (n * out_h * out_w rows of out_c).
+template <typename T>
+void ConvBiasGradient(const LayerSpec &spec, const T *delta, size_t n, T *bias_grad);
+template <typename T>
+void MaxPoolForward(const LayerSpec &spec, const T *input, size_t n, T *output);
+// Routes each output gradient to the first maximum of its window, the one
+// MaxPoolForward picked. input_grad must start zeroed.
+template <typename T>
+void MaxPoolBackward(const LayerSpec &spec, const T *input, const T *output_grad, size_t n, T *input_grad);
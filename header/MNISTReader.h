@@ -6,6 +6,7 @@
 #include <string>
 #include "Matrix.h"
 #include "Math.h"
+#include "IdxDataset.h"
 
 int ReverseInt(int i);
 std::vector <Matrix> ReadImages(std::string fullPath);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file, unmapped on destruction. Used by
+// IdxDataset for the MNIST files and by LoadModel(ModelLoad::Map) for weights.
+class MappedFile {
+private:
+    const uint8_t *mapping;
+    size_t mapping_size;
+    void *file_handle;
+    void *map_handle;
+
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *Data() const;
+    size_t Size() const;
+};
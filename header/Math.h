@@ -6,8 +6,41 @@
 #include <cstdlib>
 
 double Sigmoid(double x);
+float Sigmoid(float x);
 double SigmoidDerivative(double y);
+float SigmoidDerivative(float y);
 double Random();
 double ReLU(double x);
+float ReLU(float x);
 double ReLUDerivative(double x);
-std::vector <double> Softmax(const std::vector <double> &vec);
\ No newline at end of file
+float ReLUDerivative(float x);
+std::vector <double> Softmax(const std::vector <double> &vec);
+
+// Vectorized element-wise kernels over n contiguous values, overwritten in
+// place. Largest error against the exact result seen by bench_math over 2^21
+// random inputs per function (a correctly rounded result scores 0.5 ulp):
+//
+//   ExpInPlace      double 1.01 ulp, float 1.00 ulp   on [-708, 709] / [-87, 88]
+//   LogInPlace      double 1.86 ulp, float 1.77 ulp   on all positive normal numbers
+//   SigmoidInPlace  double 2.26 ulp, float 2.41 ulp   on [-700, 700] / [-80, 80]
+//
+// exp returns 0 below the lower bound and saturates at exp(bound) above the
+// upper one, so denormal results are flushed to 0. log(0) is -inf, log of a
+// negative number is NaN, and denormal inputs are treated as the smallest
+// normal number.
+void ExpInPlace(double *values, size_t n);
+void ExpInPlace(float *values, size_t n);
+void LogInPlace(double *values, size_t n);
+void LogInPlace(float *values, size_t n);
+void SigmoidInPlace(double *values, size_t n);
+void SigmoidInPlace(float *values, size_t n);
+
+// Softmax of one row of n values, in place.
+void SoftmaxInPlace(double *values, size_t n);
+void SoftmaxInPlace(float *values, size_t n);
+
+// Fused log-softmax + cross-entropy for one row of logits: returns
+// -log softmax(logits)[label] and overwrites the row with its gradient,
+// softmax(logits) - onehot(label).
+double SoftmaxCrossEntropyInPlace(double *logits, size_t n, int label);
+float SoftmaxCrossEntropyInPlace(float *logits, size_t n, int label);
\ No newline at end of file
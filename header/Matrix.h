@@ -1,37 +1,68 @@
 #pragma once
 
 #include "Math.h"
+#include "Gemm.h"
 #include <vector>
 #include <iostream>
 #include <cstdlib>
 #include <ctime>
-class Matrix {
+
+// Dense row-major matrix. Instantiated for float and double in src/Matrix.cpp;
+// use the Matrix (double) and MatrixF (float) aliases below.
+template <typename T>
+class BasicMatrix {
 private:
-    std::vector <double> data;
+    std::vector <T> data;
     size_t rows; size_t cols;
 
 public:
-    Matrix(int rows, int cols, bool rand = false);
-    Matrix(int rows, int cols, const std::vector <double> &values);
-    double &operator()(int row, int col);
-    const double &operator()(int row, int col) const;
-    Matrix operator=(const Matrix &other);
-    Matrix Flatten(int axis = 0) const;
-    Matrix operator+(const Matrix &other) const;
-    Matrix operator*(const Matrix &other) const;
-    Matrix operator-(const Matrix &other) const;
-    void AddInPlace(const Matrix &other);
-    void Fill(double value);
-    Matrix HadamardMul(const Matrix &other) const;
-    Matrix ScalarMul(double scalar) const;
-    Matrix Transpose() const;
+    typedef T Scalar;
+
+    BasicMatrix(int rows, int cols, bool rand = false);
+    BasicMatrix(int rows, int cols, const std::vector <T> &values);
+    T &operator()(int row, int col);
+    const T &operator()(int row, int col) const;
+    BasicMatrix operator=(const BasicMatrix &other);
+    BasicMatrix Flatten(int axis = 0) const;
+    BasicMatrix operator+(const BasicMatrix &other) const;
+    BasicMatrix operator*(const BasicMatrix &other) const;
+    void MultiplyInto(const BasicMatrix &other, BasicMatrix &res) const;
+    void LinearInto(const BasicMatrix &weights, const BasicMatrix &bias, GemmActivation activation, BasicMatrix &res) const;
+    void LinearInto(const T *weights, const T *bias, int out_cols, GemmActivation activation, BasicMatrix &res) const;
+    void MultiplyMaskedInto(const BasicMatrix &other, const BasicMatrix &mask, BasicMatrix &res) const;
+    void TransposeMultiplyInto(const BasicMatrix &other, BasicMatrix &res) const;
+    void MultiplyTransposedInto(const BasicMatrix &other, BasicMatrix &res) const;
+    void MultiplyTransposedMaskedInto(const BasicMatrix &other, const BasicMatrix &mask, BasicMatrix &res) const;
+    BasicMatrix operator-(const BasicMatrix &other) const;
+    void AddInPlace(const BasicMatrix &other);
+    void AddScaledInPlace(const BasicMatrix &other, T scale);
+    void AddRowInPlace(const BasicMatrix &row);
+    BasicMatrix ColumnSum() const;
+    void ColumnSumInto(BasicMatrix &res) const;
+    void SetRow(int row, const BasicMatrix &values);
+    void Resize(int rows, int cols);
+    void Reserve(int rows, int cols);
+    int RowArgMax(int row) const;
+    void Fill(T value);
+    BasicMatrix HadamardMul(const BasicMatrix &other) const;
+    BasicMatrix ScalarMul(T scalar) const;
+    BasicMatrix Transpose() const;
+    void TransposeInto(BasicMatrix &res) const;
     void ApplySigmoid();
     void ApplySigmoidDerivative();
     void ApplyReLU();
     void ApplyReLUDerivative();
     void ApplySoftmax();
+    T ApplySoftmaxCrossEntropy(const std::vector <int> &labels);
+    template <typename U>
+    BasicMatrix<U> Cast() const;
     size_t GetRows() const;
     size_t GetCols() const;
+    T *Data();
+    const T *Data() const;
 
     void Print();
-};
\ No newline at end of file
+};
+
+typedef BasicMatrix<double> Matrix;
+typedef BasicMatrix<float> MatrixF;
\ No newline at end of file
@@ -1,28 +1,196 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <initializer_list>
 #include "Matrix.h"
+#include "MappedFile.h"
+#include "Optimizer.h"
+#include "Layers.h"
 #include <string>
 #include <fstream>
 #include <cassert>
 
-class NeuralNetwork {
+// Scratch space for PredictBatch/PredictProbaBatch. Each thread keeps its own;
+// after the first call with a given batch size no further allocation happens.
+template <typename T>
+struct BasicInferenceBuffers {
+    std::vector <BasicMatrix<T>> activations;
+    BasicMatrix<T> output = BasicMatrix<T>(0, 0);
+    // im2col patches of the Conv2D layer being run.
+    BasicMatrix<T> columns = BasicMatrix<T>(0, 0);
+};
+
+// Scratch space for one training step: every layer's activations, the
+// backward deltas and the summed gradients. Reserve() sizes it from the layers
+// once; after that a step with at most batch_size rows allocates nothing.
+template <typename T>
+struct BasicTrainingWorkspace {
+    std::vector <BasicMatrix<T>> activations;
+    std::vector <BasicMatrix<T>> weight_grads;
+    std::vector <BasicMatrix<T>> bias_grads;
+    BasicMatrix<T> delta = BasicMatrix<T>(0, 0);
+    // Each Conv2D layer's im2col patches from the forward pass, reused for
+    // its weight gradient, and the patch gradient of the layer being run back.
+    std::vector <BasicMatrix<T>> columns;
+    BasicMatrix<T> column_grad = BasicMatrix<T>(0, 0);
+    size_t batch_size = 0;
+    // Summed cross-entropy of the last step; only the label overloads set it.
+    double loss = 0.0;
+
+    void Reserve(const std::vector <LayerSpec> &layers, size_t batch_size);
+    // For a network of dense layers only.
+    void Reserve(const std::vector <int> &layer_sizes, size_t batch_size);
+};
+
+// Per-thread workspaces for data-parallel training: thread t trains on its
+// own contiguous slice of the batch and then reduces one slice of the
+// parameters across all threads. Everything persists across batches.
+template <typename T>
+struct BasicShardedWorkspace {
+    std::vector <BasicTrainingWorkspace<T>> shards;
+    std::vector <BasicMatrix<T>> shard_inputs;
+    std::vector <std::vector <int>> shard_labels;
+    // Mean cross-entropy of the last step.
+    double loss = 0.0;
+
+    void Reserve(const std::vector <LayerSpec> &layers, size_t batch_size, int threads);
+    // For a network of dense layers only.
+    void Reserve(const std::vector <int> &layer_sizes, size_t batch_size, int threads);
+};
+
+// Told about each layer as soon as the backward pass has finished its
+// weight and bias gradients, last layer first. The pass never touches those
+// gradients again, so the receiver may work on them (e.g. start reducing
+// them across processes) while earlier layers are still being computed.
+template <typename T>
+class BasicGradientSink {
+public:
+    virtual ~BasicGradientSink() = default;
+    virtual void LayerReady(BasicTrainingWorkspace<T> &workspace, size_t layer) = 0;
+};
+
+// How LoadModel gets the parameters. Copy reads them into the network's own
+// matrices and accepts every model format in either precision. Map keeps the
+// file mapped and runs inference straight from it: the file must be in the
+// current format with the network's precision, and the network is read-only.
+enum class ModelLoad { Copy, Map };
+
+// Prints "filepath: problem" and exits unless ok. Model loaders check what
+// they read from a file with it rather than assert, so that a truncated,
+// corrupt or mismatched file fails in release builds too instead of being
+// read past its end; SaveModel checks its writes with it, so that a full
+// disk does not leave a silently truncated model.
+void CheckModelFile(bool ok, const std::string &filepath, const char *problem);
+
+// ReLU/softmax network of dense layers, optionally preceded by Conv2D and
+// MaxPool layers (see Layers.h). Every layer but the last is followed by a
+// ReLU; MaxPool layers have no activation of their own. Instantiated for
+// float and double in src/NeuralNetwork.cpp; use the NeuralNetwork (double)
+// and NeuralNetworkF (float) aliases below.
+template <typename T>
+class BasicNeuralNetwork {
 private:
-    std::vector <Matrix> weights;
-    std::vector <Matrix> biases;
+    std::vector <BasicMatrix<T>> weights;
+    std::vector <BasicMatrix<T>> biases;
+    std::vector <LayerSpec> layers;
     std::vector <int> layer_sizes;
-    std::vector <Matrix> layer_outputs;
+    std::vector <BasicMatrix<T>> layer_outputs;
+    std::vector <BasicMatrix<T>> layer_columns;
+    BasicTrainingWorkspace<T> workspace;
+    std::shared_ptr <MappedFile> mapped_file;
+    std::vector <const T *> mapped_weights;
+    std::vector <const T *> mapped_biases;
 
-    Matrix FeedForwardWithCache(const Matrix &input, std::vector <Matrix> &cache) const;
-    void InitGradientBuffers(std::vector <Matrix> &weight_grads, std::vector <Matrix> &bias_grads) const;
-    void ComputeGradients(const Matrix &input, const Matrix &target,
-                          std::vector <Matrix> &weight_grads, std::vector <Matrix> &bias_grads) const;
+    const T *LayerWeights(size_t layer) const;
+    const T *LayerBias(size_t layer) const;
+    void InitParameters();
+    void LoadLegacyModel(const std::string &filepath);
+
+    // Runs layer `layer` on in into out. A Conv2D builds its im2col patches
+    // in columns; for_training always does, so the backward pass can reuse
+    // them, where inference may take the direct kernel instead.
+    void LayerForward(size_t layer, const BasicMatrix<T> &in, BasicMatrix<T> &out, BasicMatrix<T> &columns, bool for_training) const;
+    const BasicMatrix<T> &ForwardPass(const BasicMatrix<T> &input, std::vector <BasicMatrix<T>> &activations,
+                                      std::vector <BasicMatrix<T>> &columns, bool for_training, bool softmax = true) const;
+    void ComputeGradients(const BasicMatrix<T> &input, const BasicMatrix<T> &target, BasicTrainingWorkspace<T> &workspace) const;
+    void ComputeGradients(const BasicMatrix<T> &input, const std::vector <int> &labels, BasicTrainingWorkspace<T> &workspace,
+                          BasicGradientSink<T> *sink = nullptr) const;
+    void BackwardPass(const BasicMatrix<T> &input, BasicTrainingWorkspace<T> &workspace, BasicGradientSink<T> *sink = nullptr) const;
+    void ApplyGradients(const BasicTrainingWorkspace<T> &workspace, BasicOptimizer<T> &optimizer, double grad_scale);
+    template <typename F>
+    void ForEachParameterSlice(int part, int parts, F fn);
+    void ApplyShardGradients(BasicShardedWorkspace<T> &workspace, int shards, int part, int parts,
+                             BasicOptimizer<T> &optimizer, double grad_scale);
 public:
-    NeuralNetwork(const std::vector <int> &layer_sizes);
-    Matrix FeedForward(const Matrix &input);
-    Matrix FeedForward(const std::vector <double> &input);
-    void BackPropagate(const Matrix &input, const Matrix &target, double learning_rate);
-    void BackPropagateBatch(const std::vector <Matrix> &inputs, const std::vector <Matrix> &targets, double learning_rate);
-    void SaveModel(const std::string &filepath);
-    void LoadModel(const std::string &filepath);
-};
\ No newline at end of file
+    // A multilayer perceptron: layer_sizes[0] inputs, then one dense layer per size.
+    BasicNeuralNetwork(const std::vector <int> &layer_sizes);
+    // Makes a braced list of three sizes, e.g. { 784, 128, 10 }, an MLP
+    // rather than an ambiguous NetworkTopology(height, width, channels).
+    BasicNeuralNetwork(std::initializer_list <int> layer_sizes);
+    BasicNeuralNetwork(const NetworkTopology &topology);
+    BasicMatrix<T> FeedForward(const BasicMatrix<T> &input);
+    BasicMatrix<T> FeedForward(const std::vector <T> &input);
+    void PredictProbaBatch(const BasicMatrix<T> &inputs, BasicMatrix<T> &probs, BasicInferenceBuffers<T> &buffers) const;
+    void PredictBatch(const BasicMatrix<T> &inputs, std::vector <int> &labels, BasicInferenceBuffers<T> &buffers) const;
+    std::vector <int> PredictBatch(const BasicMatrix<T> &inputs) const;
+    void BackPropagate(const BasicMatrix<T> &input, const BasicMatrix<T> &target, double learning_rate);
+    void BackPropagateBatch(const BasicMatrix<T> &inputs, const BasicMatrix<T> &targets, double learning_rate);
+    // The label overloads return the batch's mean cross-entropy loss.
+    double BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, double learning_rate);
+    double BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, double learning_rate,
+                              BasicTrainingWorkspace<T> &workspace);
+    double BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, double learning_rate,
+                              BasicShardedWorkspace<T> &workspace);
+    // The learning-rate overloads take a plain SGD step; these hand the
+    // batch's mean gradient to the optimizer instead.
+    double BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, BasicOptimizer<T> &optimizer,
+                              BasicTrainingWorkspace<T> &workspace);
+    double BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, BasicOptimizer<T> &optimizer,
+                              BasicShardedWorkspace<T> &workspace);
+    // The two halves of an optimizer step, for callers that combine gradients
+    // from elsewhere in between. ComputeBatchGradients leaves the batch's
+    // summed gradients in the workspace and returns the mean loss; sink, if
+    // given, sees each layer as soon as it is done. ApplyBatchGradients
+    // hands the workspace's gradients times grad_scale to the optimizer.
+    double ComputeBatchGradients(const BasicMatrix<T> &inputs, const std::vector <int> &labels,
+                                 BasicTrainingWorkspace<T> &workspace, BasicGradientSink<T> *sink = nullptr) const;
+    void ApplyBatchGradients(const BasicTrainingWorkspace<T> &workspace, BasicOptimizer<T> &optimizer, double grad_scale);
+    // Sizes the optimizer's state for this network. The optimizer overloads do
+    // it on their first call; call it up front before stepping from several
+    // threads at once, after which those overloads are safe to run
+    // concurrently (Hogwild: updates race on the parameters without locks).
+    void ReserveOptimizer(BasicOptimizer<T> &optimizer) const;
+    // Reserves the optimizer and, with the pool backend spanning several
+    // NUMA nodes, moves the parameters and optimizer state that sharded
+    // training member t updates to member t's node. Call it once with the
+    // workspace's thread count before training.
+    void PlaceParameters(BasicOptimizer<T> &optimizer, int parts);
+    void BackPropagateBatch(const std::vector <BasicMatrix<T>> &inputs, const std::vector <BasicMatrix<T>> &targets, double learning_rate);
+    const std::vector <BasicMatrix<T>> &GetWeights() const;
+    const std::vector <BasicMatrix<T>> &GetBiases() const;
+    // Flattened widths of the input and of every layer's output.
+    const std::vector <int> &GetLayerSizes() const;
+    const std::vector <LayerSpec> &GetLayers() const;
+    // Whether every layer is dense, as the quantized, sparse and static copies require.
+    bool IsDenseOnly() const;
+    // Multiplies the weights of `layer` element-wise by mask, which is laid
+    // out like them; a 0 prunes that weight. Not for a mapped network.
+    void MaskWeights(size_t layer, const T *mask);
+    bool IsMapped() const;
+    void SaveModel(const std::string &filepath) const;
+    void LoadModel(const std::string &filepath, ModelLoad mode = ModelLoad::Copy);
+    // Builds a network with whatever shape the file holds.
+    static BasicNeuralNetwork FromFile(const std::string &filepath, ModelLoad mode = ModelLoad::Copy);
+};
+
+typedef BasicInferenceBuffers<double> InferenceBuffers;
+typedef BasicInferenceBuffers<float> InferenceBuffersF;
+typedef BasicTrainingWorkspace<double> TrainingWorkspace;
+typedef BasicTrainingWorkspace<float> TrainingWorkspaceF;
+typedef BasicShardedWorkspace<double> ShardedWorkspace;
+typedef BasicShardedWorkspace<float> ShardedWorkspaceF;
+typedef BasicGradientSink<double> GradientSink;
+typedef BasicGradientSink<float> GradientSinkF;
+typedef BasicNeuralNetwork<double> NeuralNetwork;
+typedef BasicNeuralNetwork<float> NeuralNetworkF;
\ No newline at end of file
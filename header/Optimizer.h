@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <atomic>
+
+// Turns summed gradients into parameter updates. The network numbers its
+// parameter tensors 2 * layer (weights) and 2 * layer + 1 (bias) and, once
+// per training step, calls BeginStep() and then Update() for every tensor,
+// possibly split into disjoint slices handled by different threads.
+//
+// Optimizer state (velocities, moment estimates) lives in one contiguous
+// buffer per state kind and tensor, laid out exactly like the tensor, so an
+// update is a single fused pass over parameters, gradients and state. The
+// buffers are sized on the first step; later steps allocate nothing.
+// Instantiated for float and double in src/Optimizer.cpp.
+//
+// Once every tensor is reserved, BeginStep() and Update() may also be called
+// from several threads stepping at once (Hogwild training). Overlapping
+// updates then race on parameters and state; that is accepted by design.
+template <typename T>
+class BasicOptimizer {
+protected:
+    // state[k][tensor] is the k-th state buffer of one parameter tensor.
+    std::vector <std::vector <std::vector <T>>> state;
+    double learning_rate;
+    double weight_decay;
+
+    BasicOptimizer(double learning_rate, double weight_decay, int state_buffers);
+public:
+    virtual ~BasicOptimizer() = default;
+    BasicOptimizer(const BasicOptimizer &) = delete;
+    BasicOptimizer &operator=(const BasicOptimizer &) = delete;
+
+    // Sizes (and zeroes) the state of one tensor. A no-op once it is sized.
+    // Not thread-safe: the network calls it before splitting the update.
+    virtual void Reserve(size_t tensor, size_t size);
+    // Called once per step, before any Update().
+    virtual void BeginStep() {}
+    // Updates params[0, count), which start at element `offset` of `tensor`,
+    // using the gradient grads[i] * grad_scale. Disjoint slices may be
+    // updated concurrently.
+    virtual void Update(size_t tensor, size_t offset, T *params, const T *grads, size_t count, T grad_scale) = 0;
+
+    double GetLearningRate() const;
+    void SetLearningRate(double learning_rate);
+    // State buffers per tensor (0 for SGD) and buffer `k` of `tensor`, e.g.
+    // for placing them in memory next to the parameters they follow.
+    virtual size_t StateBuffers() const;
+    virtual T *StateData(size_t k, size_t tensor);
+};
+
+// p -= lr * (g + wd * p)
+template <typename T>
+class BasicSgdOptimizer : public BasicOptimizer<T> {
+public:
+    explicit BasicSgdOptimizer(double learning_rate, double weight_decay = 0.0);
+    void Update(size_t tensor, size_t offset, T *params, const T *grads, size_t count, T grad_scale) override;
+};
+
+// Heavy-ball momentum: v = mu * v + g, p -= lr * v. With nesterov the step
+// looks ahead along the new velocity: p -= lr * (g + mu * v).
+template <typename T>
+class BasicMomentumOptimizer : public BasicOptimizer<T> {
+private:
+    double momentum;
+    bool nesterov;
+public:
+    BasicMomentumOptimizer(double learning_rate, double momentum = 0.9, bool nesterov = false, double weight_decay = 0.0);
+    void Update(size_t tensor, size_t offset, T *params, const T *grads, size_t count, T grad_scale) override;
+};
+
+// Adam with bias-corrected first and second moments. weight_decay is an L2
+// term folded into the gradient; with decoupled (AdamW) it is applied to the
+// parameters directly, p -= lr * wd * p, and never reaches the moments.
+template <typename T>
+class BasicAdamOptimizer : public BasicOptimizer<T> {
+private:
+    double beta1;
+    double beta2;
+    double epsilon;
+    bool decoupled;
+    // Bumped by every BeginStep(); Update() derives the bias corrections
+    // from it, so concurrent steps need no lock.
+    std::atomic <long long> steps;
+public:
+    BasicAdamOptimizer(double learning_rate = 1e-3, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8,
+                       double weight_decay = 0.0, bool decoupled = false);
+    void BeginStep() override;
+    void Update(size_t tensor, size_t offset, T *params, const T *grads, size_t count, T grad_scale) override;
+};
+
+// Fine-tuning under a fixed sparsity mask. Forwards every step to `inner`
+// and then multiplies the updated weights by their mask, so pruned weights
+// stay exactly zero whatever the gradient or the inner optimizer's state.
+// weight_masks[layer] is laid out like that layer's weights (0 drops a
+// weight, 1 keeps it); biases are never masked. The learning rate, the state
+// and the schedule all belong to `inner`, which must outlive this object.
+template <typename T>
+class BasicMaskedOptimizer : public BasicOptimizer<T> {
+private:
+    BasicOptimizer<T> &inner;
+    std::vector <std::vector <T>> weight_masks;
+public:
+    BasicMaskedOptimizer(BasicOptimizer<T> &inner, std::vector <std::vector <T>> weight_masks);
+    void Reserve(size_t tensor, size_t size) override;
+    void BeginStep() override;
+    void Update(size_t tensor, size_t offset, T *params, const T *grads, size_t count, T grad_scale) override;
+    size_t StateBuffers() const override;
+    T *StateData(size_t k, size_t tensor) override;
+};
+
+// Whether MakeOptimizer knows this name; check user input with it first.
+bool IsOptimizerName(const std::string &name);
+// Builds an optimizer by name: "sgd", "momentum", "nesterov", "adam" or
+// "adamw". A learning rate <= 0 picks that optimizer's usual default. An
+// unknown name prints the valid ones and exits; it never returns null.
+template <typename T>
+std::unique_ptr <BasicOptimizer<T>> MakeOptimizer(const std::string &name, double learning_rate = 0.0);
+
+typedef BasicOptimizer<double> Optimizer;
+typedef BasicOptimizer<float> OptimizerF;
+typedef BasicSgdOptimizer<double> SgdOptimizer;
+typedef BasicSgdOptimizer<float> SgdOptimizerF;
+typedef BasicMomentumOptimizer<double> MomentumOptimizer;
+typedef BasicMomentumOptimizer<float> MomentumOptimizerF;
+typedef BasicAdamOptimizer<double> AdamOptimizer;
+typedef BasicAdamOptimizer<float> AdamOptimizerF;
+typedef BasicMaskedOptimizer<double> MaskedOptimizer;
+typedef BasicMaskedOptimizer<float> MaskedOptimizerF;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <omp.h>
+#include "ThreadPool.h"
+
+// Decides when a loop is worth an OpenMP team. Forking costs microseconds, so
+// loops over a few thousand elements (a 1 x 10 bias row, a 64 x 10 batch of
+// logits) are faster inline, and a loop already running inside a parallel
+// region (e.g. one shard of a data-parallel training step) must not fork
+// again. Every parallel loop in src/ goes through ParallelFor below, and
+// every per-thread team (sharded training, Hogwild, the Evaluator's batch
+// workers, the InferenceServer's workers) through ParallelTeam; nothing in
+// src/ opens an OpenMP region of its own.
+//
+// The threads come from OpenMP or from the persistent work-stealing
+// ThreadPool (header/ThreadPool.h), whose workers are pinned per NUMA node.
+enum class ParallelBackend { OpenMP, Pool };
+
+struct ParallelPolicy {
+    // Loops with less estimated work than this run inline on the caller.
+    // Work is roughly the number of scalar operations in the loop.
+    size_t min_work = 32 * 1024;
+    // false runs every loop inline, e.g. when the caller parallelizes itself.
+    bool enabled = true;
+    // Allow forking from inside an active parallel region.
+    bool nested = false;
+    ParallelBackend backend = ParallelBackend::OpenMP;
+};
+
+// The global policy. Set it before starting work; call sites may still pass
+// their own threshold to ParallelFor.
+void SetParallelPolicy(const ParallelPolicy &policy);
+ParallelPolicy GetParallelPolicy();
+
+// min_work == 0 uses the global threshold.
+bool ShouldParallelize(size_t work, size_t min_work = 0);
+bool UsingThreadPool();
+// Threads a loop or team gets from the current backend.
+int ParallelThreads();
+
+namespace parallel_detail {
+
+template <typename F>
+void RunRange(void *body, size_t begin, size_t end) {
+    (*static_cast <F *> (body))(begin, end);
+}
+
+template <typename F>
+struct TeamCall {
+    F *body;
+    int members;
+};
+
+template <typename F>
+void RunMember(void *call, size_t t, size_t) {
+    TeamCall<F> *team = static_cast <TeamCall<F> *> (call);
+    (*team -> body)((int)t, team -> members);
+}
+
+}
+
+// Calls body(begin, end) on disjoint contiguous chunks covering [0, n): one
+// chunk per thread when ShouldParallelize(work, min_work), otherwise a single
+// inline call body(0, n) with no OpenMP runtime involvement at all.
+template <typename F>
+void ParallelFor(size_t n, size_t work, F body, size_t min_work = 0) {
+    if (n < 2 || !ShouldParallelize(work, min_work)) {
+        body((size_t)0, n);
+        return;
+    }
+    if (UsingThreadPool()) {
+        GlobalThreadPool().Run(n, &parallel_detail::RunRange<F>, &body);
+        return;
+    }
+    #pragma omp parallel
+    {
+        size_t threads = (size_t)omp_get_num_threads();
+        size_t t = (size_t)omp_get_thread_num();
+        size_t begin = n * t / threads;
+        size_t end = n * (t + 1) / threads;
+        if (begin < end) body(begin, end);
+    }
+}
+
+// Calls body(t, nt) once for each member t of a team of nt <= threads, all
+// running at once. OpenMP may hand out fewer threads than asked for; the
+// pool always runs exactly `threads` members, member t on worker
+// t % Threads(), so what a member allocates and first touches stays on that
+// worker's NUMA node from one call to the next.
+template <typename F>
+void ParallelTeam(int threads, F body) {
+    if (UsingThreadPool()) {
+        parallel_detail::TeamCall<F> call = { &body, threads };
+        GlobalThreadPool().Team(threads, &parallel_detail::RunMember<F>, &call);
+        return;
+    }
+    #pragma omp parallel num_threads(threads)
+    {
+        body(omp_get_thread_num(), omp_get_num_threads());
+    }
+}
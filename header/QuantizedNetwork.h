@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Matrix.h"
+#include "NeuralNetwork.h"
+
+// One dense layer in int8 form. Weights are symmetric int8 with one scale per
+// output channel, stored transposed (out x in_padded) so every output is a
+// contiguous dot product. The layer input is unsigned 7-bit (0..127) with a
+// single calibrated scale: ReLU outputs and pixels are never negative, and
+// 7 bits keep vpmaddubsw's pairwise int16 sums from saturating.
+struct QuantizedLayer {
+    int in;
+    int out;
+    int in_padded;
+    float input_scale;
+    std::vector <float> weight_scales;
+    std::vector <float> biases;
+    std::vector <int8_t> weights;
+};
+
+// Scratch space for QuantizedNetwork inference, one per thread.
+struct QuantizedBuffers {
+    std::vector <uint8_t> input;
+    std::vector <uint8_t> output;
+    std::vector <int32_t> accumulators;
+    std::vector <float> logits;
+};
+
+enum class Int8Isa { Auto, Scalar, Avx2, Avx512Vnni };
+
+void SetInt8Isa(Int8Isa isa);
+Int8Isa GetInt8Isa();
+const char *Int8IsaName(Int8Isa isa);
+bool Int8IsaSupported(Int8Isa isa);
+
+class QuantizedNetwork {
+private:
+    std::vector <int> layer_sizes;
+    std::vector <QuantizedLayer> layers;
+
+    void Forward(const Matrix &inputs, QuantizedBuffers &buffers) const;
+public:
+    QuantizedNetwork();
+    // Quantizes every layer of nn. Activation scales come from the largest
+    // value each layer sees while running calibration (N x 784) through nn.
+    static QuantizedNetwork Quantize(const NeuralNetwork &nn, const Matrix &calibration);
+    void PredictProbaBatch(const Matrix &inputs, Matrix &probs, QuantizedBuffers &buffers) const;
+    void PredictBatch(const Matrix &inputs, std::vector <int> &labels, QuantizedBuffers &buffers) const;
+    size_t ParameterBytes() const;
+    void SaveModel(const std::string &filepath) const;
+    void LoadModel(const std::string &filepath);
+};
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include "NeuralNetwork.h"
+
+// Sum all-reduce across `size` processes connected in a ring: each rank
+// holds a stream socket to the next rank (send_fd) and one from the
+// previous rank (recv_fd). AllReduce runs the bandwidth-optimal ring
+// algorithm: size - 1 reduce-scatter steps leave every rank owning the full
+// sum of one chunk of the buffer, then size - 1 all-gather steps pass the
+// finished chunks around. Every rank sends and receives 2 * (size - 1) / size
+// of the buffer, independent of size, and ends with bitwise identical sums.
+// Sending and receiving overlap through poll(), so large chunks cannot
+// deadlock on full socket buffers. The sockets may be Unix domain sockets
+// (CreateLocalRing) or any connected stream sockets, e.g. TCP between hosts.
+// POSIX only. Instantiated for float and double in src/RingAllReduce.cpp.
+template <typename T>
+class BasicRingAllReduce {
+private:
+    int rank;
+    int size;
+    int send_fd;
+    int recv_fd;
+    std::vector <T> scratch;
+
+    void Exchange(const T *send, size_t send_count, T *recv, size_t recv_count);
+public:
+    // Takes ownership of both descriptors.
+    BasicRingAllReduce(int rank, int size, int send_fd, int recv_fd);
+    ~BasicRingAllReduce();
+    BasicRingAllReduce(const BasicRingAllReduce &) = delete;
+    BasicRingAllReduce &operator=(const BasicRingAllReduce &) = delete;
+
+    // Sizes the scratch space for buffers of up to n elements, so later
+    // AllReduce calls of that size allocate nothing.
+    void Reserve(size_t n);
+    // Replaces data[0, n) with its element-wise sum over all ranks. Every
+    // rank must make the same sequence of calls with the same n. If a
+    // neighbour's connection fails it prints the problem and exits rather
+    // than return a partially reduced buffer.
+    void AllReduce(T *data, size_t n);
+    int Rank() const;
+    int Size() const;
+};
+
+// Creates the Unix domain socket pairs for a ring of `size` processes on this
+// host, to be shared by fork(): rank r uses send_fds[r] and recv_fds[r] and
+// must close every other descriptor in both vectors.
+void CreateLocalRing(int size, std::vector <int> &send_fds, std::vector <int> &recv_fds);
+
+// Overlaps the gradient all-reduce with the backward pass. As the network
+// reports each finished layer, a communication thread sums that layer's
+// weight and bias gradients across the ring while the backward pass moves
+// on to the earlier layers. Wait() returns once every reported layer holds
+// the global sum. One step at a time; no allocation after the first.
+template <typename T>
+class BasicGradientExchange : public BasicGradientSink<T> {
+private:
+    BasicRingAllReduce<T> &ring;
+    BasicTrainingWorkspace<T> *workspace;
+    std::vector <size_t> queue;
+    size_t queued;
+    size_t reduced;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable layer_ready;
+    std::condition_variable layer_reduced;
+    std::thread worker;
+
+    void Run();
+public:
+    BasicGradientExchange(BasicRingAllReduce<T> &ring, size_t layers);
+    ~BasicGradientExchange();
+    BasicGradientExchange(const BasicGradientExchange &) = delete;
+    BasicGradientExchange &operator=(const BasicGradientExchange &) = delete;
+
+    void LayerReady(BasicTrainingWorkspace<T> &workspace, size_t layer) override;
+    // Blocks until every layer reported since the last Wait() is reduced.
+    void Wait();
+};
+
+typedef BasicRingAllReduce<double> RingAllReduce;
+typedef BasicRingAllReduce<float> RingAllReduceF;
+typedef BasicGradientExchange<double> GradientExchange;
+typedef BasicGradientExchange<float> GradientExchangeF;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "Matrix.h"
+#include "NeuralNetwork.h"
+#include "IdxDataset.h"
+
+// How a pruned layer stores its weights. All three index the transposed
+// weights (out x in), so each stored row produces one or more outputs:
+//   Csr       one row per output, listing the inputs it still reads
+//   Block4x4  4 outputs x 4 inputs tiles, kept when any of the 16 is nonzero
+//   Block8x1  8 outputs x 1 input tiles, kept when any of the 8 is nonzero
+// Blocks store some zeros, but each loaded input feeds 4 or 8 accumulators.
+enum class SparseFormat { Csr, Block4x4, Block8x1 };
+
+const char *SparseFormatName(SparseFormat format);
+
+// Keep masks (1 keep, 0 prune) laid out like each layer's weights, dropping
+// the sparsity[layer] fraction of that layer's weights with the smallest
+// magnitude. Weights that are already zero go first. With a block format the
+// unit is that format's block, ranked by mean magnitude, so the format stores
+// none of the pruned weights; unstructured pruning at 90% still leaves most
+// 4x4 blocks with a nonzero weight in them.
+template <typename T>
+std::vector <std::vector <T>> MagnitudeMasks(const BasicNeuralNetwork<T> &nn, const std::vector <double> &sparsity,
+                                              SparseFormat blocks = SparseFormat::Csr);
+
+// Clears the rows of a first-layer mask (in x out) whose input is zero in
+// every image of the dataset, such as the MNIST border pixels: those weights
+// can never contribute to an output.
+template <typename T>
+void MaskDeadInputs(const IdxDataset &images, int out, std::vector <T> &mask);
+
+// Fraction of exactly zero values in a weight matrix.
+template <typename T>
+double Sparsity(const BasicMatrix<T> &weights);
+
+template <typename T>
+struct BasicSparseLayer {
+    int in;
+    int out;
+    // Stored rows: outputs for Csr, blocks of 4 or 8 outputs otherwise.
+    int rows;
+    // Entries of row r are [row_start[r], row_start[r + 1]).
+    std::vector <int> row_start;
+    // First input of each entry.
+    std::vector <int> columns;
+    // 1, 16 (row-major 4 x 4) or 8 values per entry.
+    std::vector <T> values;
+    // Padded to rows * block height with zeros.
+    std::vector <T> bias;
+};
+
+// Scratch space for BasicSparseNetwork inference, one per thread.
+// Activations are kept feature-major (features x batch).
+template <typename T>
+struct BasicSparseBuffers {
+    std::vector <T> input;
+    std::vector <T> output;
+};
+
+// Inference-only copy of a pruned network in one of the sparse formats. The
+// kernels multiply each stored weight (block) by a contiguous row of
+// feature-major activations, so they vectorize across the batch; bias and
+// ReLU are applied while the accumulators are still in registers.
+// Instantiated for float and double in src/SparseNetwork.cpp.
+template <typename T>
+class BasicSparseNetwork {
+private:
+    SparseFormat format;
+    std::vector <int> layer_sizes;
+    std::vector <BasicSparseLayer<T>> layers;
+
+    // Leaves the logits, feature-major, in buffers.input.
+    void Forward(const BasicMatrix<T> &inputs, BasicSparseBuffers<T> &buffers) const;
+public:
+    BasicSparseNetwork();
+    // Stores the nonzero weights of every layer of nn in `format`.
+    static BasicSparseNetwork FromNetwork(const BasicNeuralNetwork<T> &nn, SparseFormat format);
+    void PredictProbaBatch(const BasicMatrix<T> &inputs, BasicMatrix<T> &probs, BasicSparseBuffers<T> &buffers) const;
+    void PredictBatch(const BasicMatrix<T> &inputs, std::vector <int> &labels, BasicSparseBuffers<T> &buffers) const;
+    SparseFormat Format() const;
+    // Weight values stored, including the zeros inside kept blocks.
+    size_t StoredValues() const;
+    size_t ParameterBytes() const;
+};
+
+typedef BasicSparseLayer<double> SparseLayer;
+typedef BasicSparseLayer<float> SparseLayerF;
+typedef BasicSparseBuffers<double> SparseBuffers;
+typedef BasicSparseBuffers<float> SparseBuffersF;
+typedef BasicSparseNetwork<double> SparseNetwork;
+typedef BasicSparseNetwork<float> SparseNetworkF;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "NeuralNetwork.h"
+
+// Inference-only copy of a ReLU/softmax network whose layer sizes are
+// template arguments, e.g. StaticNetwork<784, 128, 64, 10>. Every loop bound
+// is a compile-time constant, so each layer compiles to fully unrolled
+// vector code with its accumulators held in registers, and the parameters
+// live inside the object in one 64-byte aligned array (every weight and bias
+// block starts on a cache line). Prediction uses only stack scratch and
+// never touches the heap.
+//
+// The object holds every parameter (about 400 KB in float and 800 KB in
+// double for 784-128-64-10), so keep it static or on the heap, not on a
+// thread's stack. Instantiated in src/StaticNetwork.cpp for float and double
+// with the 784-128-64-10 topology; add a line there for other shapes.
+template <typename T, int... Sizes>
+class BasicStaticNetwork {
+    static_assert(sizeof...(Sizes) >= 2, "A network needs an input and an output layer.");
+
+public:
+    static constexpr int LAYERS = (int)sizeof...(Sizes) - 1;
+    static constexpr int SIZES[sizeof...(Sizes)] = { Sizes... };
+    static constexpr int INPUTS = SIZES[0];
+    static constexpr int OUTPUTS = SIZES[LAYERS];
+
+private:
+    static constexpr size_t ALIGN = 64 / sizeof(T);
+    // Output columns per accumulator block: the sixteen 256-bit registers of
+    // AVX2, so the first layer streams the input once per 128 float columns.
+    static constexpr int COLUMN_BLOCK = 16 * 32 / (int)sizeof(T);
+
+    static constexpr size_t Padded(size_t n) {
+        return (n + ALIGN - 1) / ALIGN * ALIGN;
+    }
+    static constexpr size_t WeightOffset(int layer) {
+        size_t offset = 0;
+        for (int i = 0; i < layer; i++) offset += Padded((size_t)SIZES[i] * SIZES[i + 1]) + Padded(SIZES[i + 1]);
+        return offset;
+    }
+    static constexpr size_t BiasOffset(int layer) {
+        return WeightOffset(layer) + Padded((size_t)SIZES[layer] * SIZES[layer + 1]);
+    }
+    static constexpr int Widest() {
+        int widest = 1;
+        for (int i = 1; i <= LAYERS; i++) widest = SIZES[i] > widest ? SIZES[i] : widest;
+        return widest;
+    }
+    static constexpr size_t PARAMETERS = WeightOffset(LAYERS);
+    static constexpr int WIDEST = Widest();
+
+    // Layer l's weights are SIZES[l] x SIZES[l + 1], row-major like the
+    // network's matrices, at WeightOffset(l); its bias follows.
+    alignas(64) T params[PARAMETERS];
+
+    template <int In, int Out, int Column>
+    static void DenseColumns(const T *__restrict weights, const T *__restrict input, T *__restrict output);
+    template <int In, int Out, int Column = 0>
+    static void Dense(const T *__restrict weights, const T *__restrict input, T *__restrict output);
+    template <int Layer>
+    void Forward(const T *input, T *probs, T (*scratch)[WIDEST]) const;
+
+public:
+    // All parameters zero.
+    BasicStaticNetwork();
+    // Copies the parameters of a network with exactly this topology.
+    void CopyFrom(const BasicNeuralNetwork<T> &nn);
+    // Reads any model file BasicNeuralNetwork::LoadModel accepts.
+    void LoadModel(const std::string &filepath);
+
+    // Softmax probabilities of one input row of INPUTS values.
+    void PredictProba(const T *input, T *probs) const;
+    int Predict(const T *input) const;
+    // One image of INPUTS pixel bytes, scaled by 1/255 like the datasets.
+    int Predict(const uint8_t *pixels) const;
+};
+
+template <int... Sizes>
+using StaticNetwork = BasicStaticNetwork<double, Sizes...>;
+template <int... Sizes>
+using StaticNetworkF = BasicStaticNetwork<float, Sizes...>;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Low-overhead instrumentation for training. Build with -DMNIST_TELEMETRY=1
+// (`make TELEMETRY=1 train`) to enable it; otherwise every TELEMETRY_* macro
+// expands to nothing and the functions below are empty inlines, so release
+// builds carry no cost at all.
+//
+// When enabled, each thread accumulates into its own counter block (plain
+// relaxed stores, no shared cache lines or atomic read-modify-writes on the
+// hot path); Snapshot() sums the blocks. Timed scopes also append Chrome
+// trace events to a per-thread buffer while a trace is running, and
+// StopTrace() writes them as JSON that chrome://tracing or Perfetto opens.
+#ifndef MNIST_TELEMETRY
+#define MNIST_TELEMETRY 0
+#endif
+
+namespace telemetry {
+
+// Where training time goes. Forward and Backward are also broken down per
+// layer (up to MAX_LAYERS).
+enum class Phase { Data, Forward, Backward, Reduce, Update, Count };
+
+enum class Metric { GemmFlops, Samples, Correct, LossMilli, Count };
+
+const int MAX_LAYERS = 8;
+const char *PhaseName(Phase phase);
+
+// Process-wide totals since start.
+struct Snapshot {
+    uint64_t phase_ns[(int)Phase::Count] = {};
+    uint64_t layer_forward_ns[MAX_LAYERS] = {};
+    uint64_t layer_backward_ns[MAX_LAYERS] = {};
+    uint64_t metrics[(int)Metric::Count] = {};
+};
+
+#if MNIST_TELEMETRY
+
+uint64_t NowNs();
+void AddTime(Phase phase, int layer, uint64_t start_ns, uint64_t end_ns);
+void Add(Metric metric, uint64_t value);
+Snapshot TakeSnapshot();
+// Starts buffering trace events (at most max_events per thread) and writes
+// them to path on StopTrace().
+void StartTrace(const std::string &path, size_t max_events = 1 << 20);
+void StopTrace();
+
+// Times its enclosing block. layer < 0 charges the phase total; otherwise
+// the per-layer slot.
+class Scope {
+private:
+    Phase phase;
+    int layer;
+    uint64_t start;
+public:
+    explicit Scope(Phase phase, int layer = -1) : phase(phase), layer(layer), start(NowNs()) {}
+    ~Scope() { AddTime(phase, layer, start, NowNs()); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+};
+
+#define TELEMETRY_CONCAT_(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_(a, b)
+#define TELEMETRY_SCOPE(phase) telemetry::Scope TELEMETRY_CONCAT(telemetry_scope_, __LINE__)(phase)
+#define TELEMETRY_LAYER_SCOPE(phase, layer) telemetry::Scope TELEMETRY_CONCAT(telemetry_scope_, __LINE__)(phase, (int)(layer))
+#define TELEMETRY_ADD(metric, value) telemetry::Add(metric, (uint64_t)(value))
+
+#else
+
+inline Snapshot TakeSnapshot() { return Snapshot(); }
+inline void StartTrace(const std::string &, size_t = 0) {}
+inline void StopTrace() {}
+
+#define TELEMETRY_SCOPE(phase) ((void)0)
+#define TELEMETRY_LAYER_SCOPE(phase, layer) ((void)0)
+#define TELEMETRY_ADD(metric, value) ((void)0)
+
+#endif
+
+// One stats line for the interval between two snapshots: samples/s, loss
+// and accuracy of the samples seen, GEMM GFLOP/s, and the share of thread
+// time per phase. Writes into line[0, size) without allocating.
+void FormatStats(const Snapshot &before, const Snapshot &now, double seconds, char *line, size_t size);
+
+}
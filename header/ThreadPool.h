@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+// CPUs of one NUMA node as listed in /sys/devices/system/node. Machines
+// without that directory, and non-Linux builds, report one node holding
+// every CPU.
+struct NumaNode {
+    int id;
+    std::vector <int> cpus;
+};
+
+std::vector <NumaNode> DetectNumaNodes();
+
+struct ThreadPoolOptions {
+    // Workers to start; 0 starts one per CPU of the selected nodes.
+    int threads = 0;
+    // Use the first `nodes` NUMA nodes; 0 uses all of them.
+    int nodes = 0;
+    // Pin each worker to one CPU (Linux only). Workers fill the CPUs of one
+    // node before moving on to the next, so worker w's node is fixed.
+    bool pin = true;
+};
+
+// Persistent work-stealing pool. Every worker owns a queue of stealable
+// tasks and a queue of tasks bound to it. A worker runs its own newest task
+// first and, when it runs dry, steals the oldest task of another worker,
+// trying workers on its own NUMA node before remote ones. Idle workers spin
+// briefly and then sleep until new work is submitted.
+//
+// Run() and Team() block until their tasks are done and allocate nothing:
+// the job lives on the caller's stack and the queues are sized up front. A
+// call made from inside a pool task runs inline on that task's thread, the
+// same rule ParallelFor applies to nested OpenMP regions.
+class ThreadPool {
+public:
+    // Runs items [begin, end) of a job.
+    typedef void (*TaskFunction)(void *context, size_t begin, size_t end);
+
+private:
+    struct Job {
+        TaskFunction function;
+        void *context;
+        std::atomic <size_t> remaining;
+    };
+    struct Task {
+        Job *job;
+        size_t begin;
+        size_t end;
+    };
+    // Fixed-capacity deque guarded by its worker's mutex.
+    struct TaskQueue {
+        std::vector <Task> slots;
+        size_t head = 0;
+        size_t count = 0;
+
+        bool Push(const Task &task);
+        bool PopNewest(Task &task);
+        bool PopOldest(Task &task);
+    };
+    struct Worker {
+        std::thread thread;
+        int cpu = -1;
+        int node = 0;
+        std::mutex mutex;
+        TaskQueue stealable;
+        TaskQueue bound;
+    };
+
+    std::vector <std::unique_ptr <Worker>> workers;
+    // steal_order[w] lists the other workers, same node first.
+    std::vector <std::vector <int>> steal_order;
+    std::vector <int> nodes;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic <uint64_t> generation;
+    std::atomic <int> sleeping;
+    std::atomic <bool> stopping;
+
+    void WorkerLoop(int index);
+    bool FindTask(int index, Task &task);
+    bool StealTask(int thief, Task &task);
+    void Submit(Job &job, size_t items, size_t chunks, bool bind);
+    void Wait(Job &job, bool help);
+    static void Execute(const Task &task);
+
+public:
+    explicit ThreadPool(const ThreadPoolOptions &options = ThreadPoolOptions());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int Threads() const;
+    // Number of distinct NUMA nodes the workers run on.
+    int Nodes() const;
+    // NUMA node of worker w, and of team member t in Team().
+    int WorkerNode(int w) const;
+    int TeamNode(int t) const;
+
+    // Splits [0, items) into `chunks` contiguous ranges (0: one per worker)
+    // and calls function(context, begin, end) on each. Chunk c is queued on
+    // worker c % Threads(); idle workers and the caller steal the rest.
+    void Run(size_t items, TaskFunction function, void *context, size_t chunks = 0);
+    // Calls function(context, t, t + 1) for t in [0, members), member t on
+    // worker t % Threads() and nowhere else. Nothing is stolen, so memory a
+    // member first touches lands on TeamNode(t).
+    void Team(int members, TaskFunction function, void *context);
+
+    // Moves the whole pages of [data, data + bytes) to NUMA node `node`, for
+    // memory allocated before its owner was known. A no-op on one node.
+    void MoveToNode(const void *data, size_t bytes, int node) const;
+
+    // Worker index of the calling thread, -1 outside the pool.
+    static int CurrentWorker();
+    // True while the calling thread runs a pool task (the caller of Run()
+    // included, when it helps).
+    static bool InsideTask();
+};
+
+// The pool behind ParallelBackend::Pool, started on first use with default
+// options.
+ThreadPool &GlobalThreadPool();
+// Replaces the global pool. Call it while no work is running.
+void ConfigureGlobalThreadPool(const ThreadPoolOptions &options);
@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "NeuralNetwork.h"
+#include "InferenceServer.h"
+#include "Parallel.h"
+#include "Evaluator.h"
+#include "IdxDataset.h"
+
+// Load generator for the inference server. For every batching window in
+// windows= it starts an in-process server with that max_delay_us, then for
+// every client count in clients= runs that many concurrent connections, each
+// sending test images one at a time and waiting for the answer (closed
+// loop). Prints throughput, mean batch size, accuracy and p50/p99 latency.
+// With socket= it drives an already running `serve` instead and windows= is
+// ignored.
+// Usage: loadgen [float] [pool] [model=file] [images=file] [labels=file]
+//                [windows=0,100,500,2000] [clients=1,4,16,64] [requests=N]
+//                [batch=N] [workers=N] [socket=path]
+// pool runs the in-process server on the ThreadPool backend, as in serve.
+
+struct LoadResult {
+    double seconds;
+    uint64_t correct;
+    LatencyHistogram latency;
+};
+
+static std::vector <long> ParseList(const std::string &value) {
+    std::vector <long> list;
+    for (size_t start = 0; start <= value.size();) {
+        size_t comma = value.find(',', start);
+        if (comma == std::string::npos) comma = value.size();
+        if (comma > start) list.push_back(std::atol(value.substr(start, comma - start).c_str()));
+        start = comma + 1;
+    }
+    return list;
+}
+
+static LoadResult RunClients(const std::string &socket_path, const IdxDataset &images, const IdxDataset &labels,
+                             int clients, size_t requests) {
+    std::vector <LatencyHistogram> latencies(clients);
+    std::vector <uint64_t> correct(clients, 0);
+    std::vector <std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&, c]() {
+            InferenceClient client(socket_path);
+            // Client c sends images c, c + clients, ... so the set is covered once.
+            for (size_t i = (size_t)c; i < requests; i += (size_t)clients) {
+                size_t index = i % images.Count();
+                auto begin = std::chrono::steady_clock::now();
+                InferenceResponse response;
+                bool ok = client.Send((uint32_t)i, images.Item(index)) && client.Receive(response);
+                uint64_t ns = (uint64_t)std::chrono::duration_cast <std::chrono::nanoseconds> (
+                    std::chrono::steady_clock::now() - begin).count();
+                if (!ok) break;
+                latencies[c].Add(ns);
+                correct[c] += response.label == labels.Label(index);
+            }
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+
+    LoadResult result;
+    result.seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - start).count();
+    result.correct = 0;
+    for (int c = 0; c < clients; c++) {
+        result.latency.Merge(latencies[c]);
+        result.correct += correct[c];
+    }
+    return result;
+}
+
+static void PrintRow(long window, int clients, const LoadResult &result, double mean_batch) {
+    uint64_t done = result.latency.Count();
+    printf("%9ld %8d %12.0f %10.1f %8.2f%% %10.1f %10.1f\n", window, clients, done / result.seconds, mean_batch,
+           done > 0 ? 100.0 * result.correct / done : 0.0, result.latency.PercentileNs(0.5) * 1e-3,
+           result.latency.PercentileNs(0.99) * 1e-3);
+    fflush(stdout);
+}
+
+template <typename T>
+void Sweep(const std::string &model_path, const IdxDataset &images, const IdxDataset &labels,
+           const std::vector <long> &windows, const std::vector <long> &client_counts, size_t requests,
+           InferenceServerOptions options) {
+    BasicNeuralNetwork<T> nn = BasicNeuralNetwork<T>::FromFile(model_path);
+    std::string socket_path = "/tmp/mnist-loadgen-" + std::to_string((long)getpid()) + ".sock";
+    for (long window : windows) {
+        options.max_delay_us = (uint32_t)window;
+        BasicInferenceServer<T> server(nn, socket_path, options);
+        std::thread serving([&]() { server.Run(); });
+        for (long clients : client_counts) {
+            uint64_t served = server.RequestsServed();
+            uint64_t batches = server.BatchesRun();
+            LoadResult result = RunClients(socket_path, images, labels, (int)clients, requests);
+            uint64_t batch_count = server.BatchesRun() - batches;
+            PrintRow(window, (int)clients, result,
+                     batch_count > 0 ? (double)(server.RequestsServed() - served) / batch_count : 0.0);
+        }
+        server.RequestStop();
+        serving.join();
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string model_path = "mnist_model.dat";
+    std::string images_path = "dataset/t10k-images.idx3-ubyte";
+    std::string labels_path = "dataset/t10k-labels.idx1-ubyte";
+    std::string socket_path;
+    std::vector <long> windows = { 0, 100, 500, 2000 };
+    std::vector <long> client_counts = { 1, 4, 16, 64 };
+    size_t requests = 20000;
+    InferenceServerOptions options;
+    bool use_float = false;
+    bool pool = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (arg == "float") use_float = true;
+        else if (arg == "pool") pool = true;
+        else if (key == "model") model_path = value;
+        else if (key == "images") images_path = value;
+        else if (key == "labels") labels_path = value;
+        else if (key == "socket") socket_path = value;
+        else if (key == "windows") windows = ParseList(value);
+        else if (key == "clients") client_counts = ParseList(value);
+        else if (key == "requests") requests = (size_t)std::atol(value.c_str());
+        else if (key == "batch") options.max_batch = (size_t)std::atol(value.c_str());
+        else if (key == "workers") options.workers = std::atoi(value.c_str());
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (pool) {
+        ParallelPolicy policy = GetParallelPolicy();
+        policy.backend = ParallelBackend::Pool;
+        SetParallelPolicy(policy);
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    IdxDataset images(images_path);
+    IdxDataset labels(labels_path);
+
+    printf("%9s %8s %12s %10s %9s %10s %10s\n", "window_us", "clients", "requests/s", "mean_batch", "accuracy",
+           "p50_us", "p99_us");
+    if (!socket_path.empty()) {
+        for (long clients : client_counts) {
+            PrintRow(-1, (int)clients, RunClients(socket_path, images, labels, (int)clients, requests), 0.0);
+        }
+        return 0;
+    }
+    if (use_float) {
+        Sweep<float>(model_path, images, labels, windows, client_counts, requests, options);
+    } else {
+        Sweep<double>(model_path, images, labels, windows, client_counts, requests, options);
+    }
+    return 0;
+}
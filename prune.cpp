@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "NeuralNetwork.h"
+#include "SparseNetwork.h"
+#include "Optimizer.h"
+#include "DataLoader.h"
+#include "IdxDataset.h"
+#include "Evaluator.h"
+#include "Parallel.h"
+
+// A single value prunes the first layer only, which holds most of the
+// weights (784 x 128 of MNIST's 784-128-64-10); the small layers after it
+// lose accuracy fast, the 64 x 10 output layer above all. A comma-separated
+// list gives every layer its own value.
+std::vector <double> ParseSparsity(const std::string &text, size_t layers) {
+    std::vector <double> res;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        res.push_back(std::atof(text.substr(start, comma - start).c_str()));
+        start = comma + 1;
+    }
+    if (res.size() == 1) {
+        double first = res[0];
+        res.assign(layers, 0.0);
+        res[0] = first;
+    }
+    return res;
+}
+
+// Usage: prune [model=file] [out=file] [sparsity=0.9 | sparsity=0.9,0.8,0.5] [blocks=csr|block4x4|block8x1]
+//              [dead_inputs] [finetune=epochs] [lr=1e-4]
+// Zeroes the smallest-magnitude weights (whole blocks with blocks=) of the
+// first layer, or of each layer with a comma-separated sparsity= list; the
+// default prunes 90% of the first layer and leaves the rest dense.
+// Optionally drops the inputs that are zero in every training image,
+// fine-tunes with the pruned weights held at zero, and saves the result as
+// an ordinary model file. Then compares every sparse format
+// against the dense network on the test set.
+int main(int argc, char **argv) {
+    std::string model_path = "mnist_model.dat";
+    std::string output_path = "mnist_model.pruned.dat";
+    std::string sparsity_text = "0.9";
+    SparseFormat blocks = SparseFormat::Csr;
+    bool dead_inputs = false;
+    int finetune_epochs = 0;
+    double learning_rate = 1e-4;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 6, "model=") == 0) model_path = arg.substr(6);
+        else if (arg.compare(0, 4, "out=") == 0) output_path = arg.substr(4);
+        else if (arg.compare(0, 9, "sparsity=") == 0) sparsity_text = arg.substr(9);
+        else if (arg == "blocks=csr") blocks = SparseFormat::Csr;
+        else if (arg == "blocks=block4x4") blocks = SparseFormat::Block4x4;
+        else if (arg == "blocks=block8x1") blocks = SparseFormat::Block8x1;
+        else if (arg == "dead_inputs") dead_inputs = true;
+        else if (arg.compare(0, 9, "finetune=") == 0) finetune_epochs = std::atoi(arg.c_str() + 9);
+        else if (arg.compare(0, 3, "lr=") == 0) learning_rate = std::atof(arg.c_str() + 3);
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    NeuralNetwork nn = NeuralNetwork::FromFile(model_path);
+    size_t layers = nn.GetWeights().size();
+    std::vector <double> sparsity = ParseSparsity(sparsity_text, layers);
+    if (sparsity.size() != layers) {
+        printf("sparsity= needs one value or %zu comma-separated values\n", layers);
+        return 1;
+    }
+
+    IdxDataset train_images("dataset/train-images.idx3-ubyte");
+    IdxDataset train_labels("dataset/train-labels.idx1-ubyte");
+    IdxDataset test_images("dataset/t10k-images.idx3-ubyte");
+    IdxDataset test_labels("dataset/t10k-labels.idx1-ubyte");
+
+    // Prints one test-set pass and returns its accuracy.
+    auto report = [&](const char *name, const TestSetResult &res) {
+        printf("%-18s accuracy %6.2f%%  %10.0f images/s\n", name, res.Accuracy(), res.ImagesPerSecond());
+        return res.Accuracy();
+    };
+    double reference = report("dense", EvaluateTestSet(nn, test_images, test_labels));
+
+    // Dead inputs are zeroed first so that magnitude pruning counts them
+    // toward the target; the dead-input mask is then kept on top.
+    std::vector <double> dead_mask;
+    if (dead_inputs) {
+        dead_mask.assign(nn.GetWeights()[0].GetRows() * nn.GetWeights()[0].GetCols(), 1.0);
+        MaskDeadInputs(train_images, (int)nn.GetWeights()[0].GetCols(), dead_mask);
+        nn.MaskWeights(0, dead_mask.data());
+    }
+    std::vector <std::vector <double>> masks = MagnitudeMasks(nn, sparsity, blocks);
+    if (dead_inputs) {
+        for (size_t i = 0; i < dead_mask.size(); i++) masks[0][i] *= dead_mask[i];
+    }
+    for (size_t l = 0; l < layers; l++) {
+        nn.MaskWeights(l, masks[l].data());
+        const Matrix &w = nn.GetWeights()[l];
+        printf("Layer %zu: %zux%zu, %.1f%% of weights zero\n", l, w.GetRows(), w.GetCols(), Sparsity(w) * 100.0);
+    }
+    double pruned = report("pruned", EvaluateTestSet(nn, test_images, test_labels));
+    printf("%-18s accuracy delta %+.2f%%\n", "", pruned - reference);
+
+    if (finetune_epochs > 0) {
+        int batch_size = 64;
+        int threads = ParallelThreads();
+        AdamOptimizer adam(learning_rate);
+        MaskedOptimizer optimizer(adam, masks);
+        DataLoader loader(train_images, train_labels, batch_size, finetune_epochs, static_cast<unsigned int>(std::time(0)));
+        ShardedWorkspace workspace;
+        workspace.Reserve(nn.GetLayerSizes(), batch_size, threads);
+        double epoch_loss = 0.0;
+        size_t epoch_samples = 0;
+        while (const Batch *batch = loader.Next()) {
+            double loss = nn.BackPropagateBatch(batch -> inputs, batch -> labels, optimizer, workspace);
+            epoch_loss += loss * batch -> labels.size();
+            epoch_samples += batch -> labels.size();
+            if (batch -> index + 1 == loader.BatchesPerEpoch()) {
+                printf("Fine-tune epoch %02d/%d, loss %.4f\n", batch -> epoch + 1, finetune_epochs, epoch_loss / epoch_samples);
+                epoch_loss = 0.0;
+                epoch_samples = 0;
+            }
+        }
+        double tuned = report("fine-tuned", EvaluateTestSet(nn, test_images, test_labels));
+        printf("%-18s accuracy delta %+.2f%%\n", "", tuned - reference);
+    }
+    nn.SaveModel(output_path);
+    printf("Saved %s\n", output_path.c_str());
+
+    size_t dense_bytes = 0;
+    for (size_t l = 0; l < layers; l++) {
+        dense_bytes += (nn.GetWeights()[l].GetRows() + 1) * nn.GetWeights()[l].GetCols() * sizeof(double);
+    }
+    printf("%-18s %10zu bytes\n", "dense", dense_bytes);
+    const SparseFormat formats[] = { SparseFormat::Csr, SparseFormat::Block4x4, SparseFormat::Block8x1 };
+    for (SparseFormat format : formats) {
+        SparseNetwork sparse = SparseNetwork::FromNetwork(nn, format);
+        SparseBuffers sparse_buffers;
+        printf("%-18s %10zu bytes, %zu stored weights\n", SparseFormatName(format), sparse.ParameterBytes(), sparse.StoredValues());
+        auto predict = [&](const Matrix &batch, std::vector <int> &labels) {
+            sparse.PredictBatch(batch, labels, sparse_buffers);
+        };
+        report(SparseFormatName(format), EvaluateTestSet<double>(test_images, test_labels, predict));
+    }
+    return 0;
+}
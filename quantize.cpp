@@ -0,0 +1,54 @@
+#include <cstdio>
+#include "NeuralNetwork.h"
+#include "QuantizedNetwork.h"
+#include "IdxDataset.h"
+#include "Evaluator.h"
+
+// Prints the accuracy and throughput of one test-set pass.
+double Report(const char *name, const TestSetResult &res) {
+    printf("%-18s accuracy %6.2f%%  %10.0f images/s\n", name, res.Accuracy(), res.ImagesPerSecond());
+    return res.Accuracy();
+}
+
+int main(int argc, char **argv) {
+    std::string model_path = argc > 1 ? argv[1] : "mnist_model.dat";
+    std::string output_path = argc > 2 ? argv[2] : "mnist_model.q8";
+    const size_t calibration_size = 1000;
+
+    NeuralNetwork nn = NeuralNetwork::FromFile(model_path);
+
+    IdxDataset train_images("dataset/train-images.idx3-ubyte");
+    Matrix calibration(0, 0);
+    train_images.GatherRange(0, std::min(calibration_size, train_images.Count()), calibration);
+
+    QuantizedNetwork qnn = QuantizedNetwork::Quantize(nn, calibration);
+    qnn.SaveModel(output_path);
+
+    size_t float_bytes = 0;
+    for (size_t l = 0; l < nn.GetWeights().size(); l++) {
+        float_bytes += (nn.GetWeights()[l].GetRows() + 1) * nn.GetWeights()[l].GetCols() * sizeof(float);
+    }
+    printf("Quantized %s -> %s using %zu calibration images\n", model_path.c_str(), output_path.c_str(), calibration.GetRows());
+    printf("Parameters: %zu bytes as float32, %zu bytes as int8 (%.2fx smaller)\n",
+           float_bytes, qnn.ParameterBytes(), (double)float_bytes / qnn.ParameterBytes());
+
+    IdxDataset test_images("dataset/t10k-images.idx3-ubyte");
+    IdxDataset test_labels("dataset/t10k-labels.idx1-ubyte");
+
+    double reference = Report("double", EvaluateTestSet(nn, test_images, test_labels));
+
+    QuantizedBuffers qbuffers;
+    const Int8Isa isas[] = { Int8Isa::Scalar, Int8Isa::Avx2, Int8Isa::Avx512Vnni };
+    for (Int8Isa isa : isas) {
+        if (!Int8IsaSupported(isa)) continue;
+        SetInt8Isa(isa);
+        std::string name = std::string("int8 ") + Int8IsaName(isa);
+        auto predict = [&](const Matrix &batch, std::vector <int> &labels) {
+            qnn.PredictBatch(batch, labels, qbuffers);
+        };
+        double accuracy = Report(name.c_str(), EvaluateTestSet<double>(test_images, test_labels, predict));
+        printf("%-18s accuracy delta %+.2f%%\n", "", accuracy - reference);
+    }
+    SetInt8Isa(Int8Isa::Auto);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include "NeuralNetwork.h"
+#include "InferenceServer.h"
+#include "Parallel.h"
+
+// Inference daemon: loads the model once and serves predictions over a Unix
+// domain socket (protocol in header/InferenceServer.h) until SIGINT/SIGTERM.
+// Concurrent requests are coalesced into batches of up to batch= images,
+// waiting at most delay_us= microseconds for a batch to fill.
+// Usage: serve [float] [pool] [model=file] [socket=path] [batch=N] [delay_us=N]
+//              [workers=N] [queue=N]
+// pool runs the workers and the GEMMs on the pinned work-stealing ThreadPool
+// instead of OpenMP.
+
+static volatile std::sig_atomic_t stop_signal = 0;
+
+static void OnSignal(int) {
+    stop_signal = 1;
+}
+
+template <typename T>
+int Serve(const std::string &model_path, const std::string &socket_path, const InferenceServerOptions &options) {
+    BasicNeuralNetwork<T> nn = BasicNeuralNetwork<T>::FromFile(model_path);
+    BasicInferenceServer<T> server(nn, socket_path, options);
+    printf("Serving %s (%s) on %s: batch %zu, delay %u us, %d workers.\n", model_path.c_str(),
+           sizeof(T) == sizeof(float) ? "float" : "double", socket_path.c_str(), options.max_batch, options.max_delay_us,
+           options.workers);
+    fflush(stdout);
+
+    // The handler only sets a flag; this thread turns it into RequestStop().
+    std::thread watcher([&]() {
+        while (!stop_signal) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        server.RequestStop();
+    });
+    server.Run();
+    watcher.join();
+    printf("Served %llu requests in %llu batches.\n", (unsigned long long)server.RequestsServed(),
+           (unsigned long long)server.BatchesRun());
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string model_path = "mnist_model.dat";
+    std::string socket_path = "/tmp/mnist.sock";
+    InferenceServerOptions options;
+    bool use_float = false;
+    bool pool = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (arg == "float") use_float = true;
+        else if (arg == "pool") pool = true;
+        else if (key == "model") model_path = value;
+        else if (key == "socket") socket_path = value;
+        else if (key == "batch") options.max_batch = (size_t)std::atol(value.c_str());
+        else if (key == "delay_us") options.max_delay_us = (uint32_t)std::atol(value.c_str());
+        else if (key == "workers") options.workers = std::atoi(value.c_str());
+        else if (key == "queue") options.max_pending = (size_t)std::atol(value.c_str());
+        else {
+            printf("Unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (options.max_batch == 0 || options.workers <= 0 || options.max_pending < options.max_batch) {
+        printf("batch and workers must be positive and queue at least batch\n");
+        return 1;
+    }
+
+    if (pool) {
+        ParallelPolicy policy = GetParallelPolicy();
+        policy.backend = ParallelBackend::Pool;
+        SetParallelPolicy(policy);
+    }
+
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+    return use_float ? Serve<float>(model_path, socket_path, options) : Serve<double>(model_path, socket_path, options);
+}
@@ -0,0 +1,102 @@
+#include "DataLoader.h"
+#include <numeric>
+#include <algorithm>
+#include <cassert>
+
+template <typename T>
+BasicDataLoader<T>::BasicDataLoader(const IdxDataset &images, const IdxDataset &labels, size_t batch_size,
+                                    int epochs, unsigned int seed, size_t prefetch, size_t shard, size_t shards)
+    : images(images), labels(labels), batch_size(batch_size), epochs(epochs), rng(seed) {
+    assert(images.Count() == labels.Count() && "Image and label counts must match.");
+    assert(batch_size > 0 && prefetch > 0 && "Batch size and prefetch depth must be positive.");
+    assert(shard < shards && "Shard index must be below the shard count.");
+    size_t shard_size = images.Count() / shards;
+    order.resize(shard_size);
+    std::iota(order.begin(), order.end(), shard * shard_size);
+
+    // One slot more than the prefetch depth: the consumer holds one while the
+    // worker fills the others.
+    slots.resize(prefetch + 1);
+    for (BasicBatch<T> &slot : slots) {
+        slot.inputs.Resize((int)batch_size, (int)images.ItemSize());
+        slot.labels.reserve(batch_size);
+    }
+    produced = 0;
+    consumed = 0;
+    released = 0;
+    holding = false;
+    stopping = false;
+    worker = std::thread(&BasicDataLoader<T>::Produce, this);
+}
+
+template <typename T>
+BasicDataLoader<T>::~BasicDataLoader() {
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        stopping = true;
+    }
+    slot_free.notify_all();
+    worker.join();
+}
+
+template <typename T>
+size_t BasicDataLoader<T>::BatchesPerEpoch() const {
+    return (order.size() + batch_size - 1) / batch_size;
+}
+
+template <typename T>
+void BasicDataLoader<T>::Produce() {
+    size_t per_epoch = BatchesPerEpoch();
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        std::shuffle(order.begin(), order.end(), rng);
+        for (size_t b = 0; b < per_epoch; b++) {
+            size_t slot_index;
+            {
+                std::unique_lock <std::mutex> lock(mutex);
+                // Batches are released in order, so the slot for batch
+                // `produced` is free once fewer than slots.size() are unreleased.
+                slot_free.wait(lock, [&]() { return stopping || produced - released < slots.size(); });
+                if (stopping) return;
+                slot_index = produced % slots.size();
+            }
+
+            // Filled outside the lock; the consumer never touches an unpublished slot.
+            BasicBatch<T> &slot = slots[slot_index];
+            size_t start = b * batch_size;
+            size_t end = std::min(start + batch_size, order.size());
+            images.Gather(order.data() + start, end - start, slot.inputs);
+            slot.labels.resize(end - start);
+            for (size_t i = start; i < end; i++) {
+                slot.labels[i - start] = labels.Label(order[i]);
+            }
+            slot.epoch = epoch;
+            slot.index = b;
+
+            {
+                std::lock_guard <std::mutex> lock(mutex);
+                produced++;
+            }
+            slot_ready.notify_one();
+        }
+    }
+}
+
+template <typename T>
+const BasicBatch<T> *BasicDataLoader<T>::Next() {
+    std::unique_lock <std::mutex> lock(mutex);
+    if (holding) {
+        released++;
+        holding = false;
+        slot_free.notify_one();
+    }
+    size_t total = BatchesPerEpoch() * (size_t)epochs;
+    if (consumed == total) return nullptr;
+    slot_ready.wait(lock, [&]() { return produced > consumed; });
+    const BasicBatch<T> *batch = &slots[consumed % slots.size()];
+    consumed++;
+    holding = true;
+    return batch;
+}
+
+template class BasicDataLoader<float>;
+template class BasicDataLoader<double>;
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "Evaluator.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+LatencyHistogram::LatencyHistogram()
+    : counts(BUCKETS_PER_OCTAVE * OCTAVES, 0), total(0), sum_ns(0.0), max_ns(0) {}
+
+void LatencyHistogram::Add(uint64_t ns, uint64_t count) {
+    int bucket = ns <= 1 ? 0 : (int)(std::log2((double)ns) * BUCKETS_PER_OCTAVE);
+    bucket = std::min(bucket, (int)counts.size() - 1);
+    counts[bucket] += count;
+    total += count;
+    sum_ns += (double)ns * (double)count;
+    max_ns = std::max(max_ns, ns);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+    total += other.total;
+    sum_ns += other.sum_ns;
+    max_ns = std::max(max_ns, other.max_ns);
+}
+
+uint64_t LatencyHistogram::Count() const {
+    return total;
+}
+
+double LatencyHistogram::MeanNs() const {
+    return total > 0 ? sum_ns / (double)total : 0.0;
+}
+
+uint64_t LatencyHistogram::MaxNs() const {
+    return max_ns;
+}
+
+double LatencyHistogram::PercentileNs(double p) const {
+    if (total == 0) return 0.0;
+    uint64_t rank = (uint64_t)std::ceil(std::min(std::max(p, 0.0), 1.0) * (double)total);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // The top bucket's edge can exceed anything actually recorded.
+            return std::min(std::exp2((double)(i + 1) / BUCKETS_PER_OCTAVE), (double)max_ns);
+        }
+    }
+    return (double)max_ns;
+}
+
+uint64_t EvaluationReport::Confusion(int actual, int predicted) const {
+    return confusion[(size_t)actual * classes + predicted];
+}
+
+double EvaluationReport::Accuracy() const {
+    return samples > 0 ? 100.0 * (double)correct / (double)samples : 0.0;
+}
+
+double EvaluationReport::Precision(int c) const {
+    uint64_t predicted = 0;
+    for (int actual = 0; actual < classes; actual++) predicted += Confusion(actual, c);
+    return predicted > 0 ? (double)Confusion(c, c) / (double)predicted : 0.0;
+}
+
+double EvaluationReport::Recall(int c) const {
+    uint64_t labeled = 0;
+    for (int predicted = 0; predicted < classes; predicted++) labeled += Confusion(c, predicted);
+    return labeled > 0 ? (double)Confusion(c, c) / (double)labeled : 0.0;
+}
+
+double TestSetResult::Accuracy() const {
+    return samples > 0 ? 100.0 * (double)correct / (double)samples : 0.0;
+}
+
+double TestSetResult::ImagesPerSecond() const {
+    return seconds > 0.0 ? (double)samples / seconds : 0.0;
+}
+
+template <typename T>
+BasicEvaluator<T>::BasicEvaluator(const BasicNeuralNetwork<T> &nn, const EvaluationOptions &options)
+    : nn(nn), options(options) {
+    assert(options.batch_size > 0 && options.chunk_size > 0 && "Batch and chunk sizes must be positive.");
+    if (this -> options.threads <= 0) this -> options.threads = ParallelThreads();
+    states.resize(this -> options.threads);
+}
+
+// Team members claim batches from a shared counter, so a thread slowed by
+// the reader or the OS does not hold up the chunk. The GEMMs inside
+// PredictBatch see that they run inside a team and stay on their thread.
+template <typename T>
+void BasicEvaluator<T>::EvaluateChunk(const std::vector <uint8_t> &images, const std::vector <uint8_t> &labels, size_t count,
+                                      size_t item_size, int classes) {
+    size_t batch_size = options.batch_size;
+    size_t batches = (count + batch_size - 1) / batch_size;
+    std::atomic <size_t> next(0);
+    ParallelTeam(options.threads, [&](int t, int) {
+        ThreadState &state = states[t];
+        for (size_t b = next.fetch_add(1, std::memory_order_relaxed); b < batches;
+             b = next.fetch_add(1, std::memory_order_relaxed)) {
+            size_t start = b * batch_size;
+            size_t rows = std::min(batch_size, count - start);
+            BytesToRows(images.data() + start * item_size, rows, item_size, state.batch);
+
+            auto begin = std::chrono::steady_clock::now();
+            nn.PredictBatch(state.batch, state.predicted, state.buffers);
+            uint64_t ns = (uint64_t)std::chrono::duration_cast <std::chrono::nanoseconds> (
+                std::chrono::steady_clock::now() - begin).count();
+            state.batch_latency.Add(ns);
+            state.sample_latency.Add(ns / rows, rows);
+
+            for (size_t i = 0; i < rows; i++) {
+                int label = labels[start + i];
+                assert(label < classes && "Run checks every label before the chunk is evaluated.");
+                state.confusion[(size_t)label * classes + state.predicted[i]]++;
+            }
+        }
+    });
+}
+
+template <typename T>
+EvaluationReport BasicEvaluator<T>::Run(const std::string &images_path, const std::string &labels_path) {
+    IdxStream images(images_path);
+    IdxStream labels(labels_path);
+    CheckIdxFile(images.Count() == labels.Count(), labels_path, "Image and label counts must match.");
+    CheckIdxFile(labels.ItemSize() == 1, labels_path, "Label IDX files hold one byte per item.");
+    CheckIdxFile((int)images.ItemSize() == nn.GetLayerSizes().front(), images_path, "Image size must match the network's first layer.");
+
+    EvaluationReport report;
+    report.classes = nn.GetLayerSizes().back();
+    for (ThreadState &state : states) {
+        state.confusion.assign((size_t)report.classes * report.classes, 0);
+        state.batch_latency = LatencyHistogram();
+        state.sample_latency = LatencyHistogram();
+    }
+
+    // Double-buffered: chunk `current` is evaluated while the reader thread
+    // fills the other one.
+    std::vector <uint8_t> image_chunks[2];
+    std::vector <uint8_t> label_chunks[2];
+    size_t counts[2] = { 0, 0 };
+    size_t label_counts[2] = { 0, 0 };
+    auto read_chunk = [&](int slot) {
+        counts[slot] = images.Read(options.chunk_size, image_chunks[slot]);
+        label_counts[slot] = labels.Read(options.chunk_size, label_chunks[slot]);
+    };
+    // The labels index the confusion matrix, so a chunk is checked on this
+    // thread before any team member sees it.
+    auto check_chunk = [&](int slot) {
+        CheckIdxFile(label_counts[slot] == counts[slot], labels_path, "Label stream ended before the image stream.");
+        for (uint8_t label : label_chunks[slot]) {
+            CheckIdxFile(label < report.classes, labels_path, "Label is outside the network's output classes.");
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    read_chunk(0);
+    for (int current = 0; counts[current] > 0; current ^= 1) {
+        check_chunk(current);
+        std::thread reader(read_chunk, current ^ 1);
+        EvaluateChunk(image_chunks[current], label_chunks[current], counts[current], images.ItemSize(), report.classes);
+        reader.join();
+    }
+    report.seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - start).count();
+
+    report.confusion.assign((size_t)report.classes * report.classes, 0);
+    for (const ThreadState &state : states) {
+        for (size_t i = 0; i < report.confusion.size(); i++) report.confusion[i] += state.confusion[i];
+        report.batch_latency.Merge(state.batch_latency);
+        report.sample_latency.Merge(state.sample_latency);
+    }
+    for (int c = 0; c < report.classes; c++) report.correct += report.Confusion(c, c);
+    for (uint64_t n : report.confusion) report.samples += n;
+    return report;
+}
+
+template class BasicEvaluator<float>;
+template class BasicEvaluator<double>;
@@ -0,0 +1,566 @@
+#include "Gemm.h"
+#include "Parallel.h"
+#include "Telemetry.h"
+#include <vector>
+#include <algorithm>
+#include <immintrin.h>
+
+// Blocked GEMM in the usual Goto/BLIS layout: B is packed into KC x NR column
+// panels, A into MR x KC row panels, and a register-tiled micro-kernel computes
+// one MR x NR tile of C per call. Small or skinny products skip packing.
+//
+// Internally A and B are addressed through a row and a column stride, so a
+// transposed operand is just the other stride pair: packing reads it in place
+// and no transposed copy is ever made.
+
+namespace {
+
+const size_t KC = 256;
+const size_t MC = 96;
+const size_t NC = 2048;
+
+// Below this many multiply-adds packing costs more than it saves.
+const size_t DIRECT_GEMM_WORK = 16 * 1024;
+
+// Largest MR * NR among the kernels below, for the edge-tile scratch buffer.
+const size_t MAX_TILE = 8 * 32;
+
+template <typename T>
+struct GemmKernel {
+    GemmIsa isa;
+    size_t mr;
+    size_t nr;
+    void (*run)(size_t kc, const T *a, const T *b, T *c, size_t ldc, bool accumulate);
+};
+
+template <typename T>
+void MicroKernelScalar(size_t kc, const T *a, const T *b, T *c, size_t ldc, bool accumulate) {
+    T acc[4][4] = {};
+    for (size_t p = 0; p < kc; p++) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += 4;
+        b += 4;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            c[i * ldc + j] = accumulate ? c[i * ldc + j] + acc[i][j] : acc[i][j];
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void MicroKernelAvx2(size_t kc, const double *a, const double *b, double *c, size_t ldc, bool accumulate) {
+    __m256d acc[6][2];
+    for (int i = 0; i < 6; i++) {
+        acc[i][0] = _mm256_setzero_pd();
+        acc[i][1] = _mm256_setzero_pd();
+    }
+    for (size_t p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_loadu_pd(b);
+        __m256d b1 = _mm256_loadu_pd(b + 4);
+        for (int i = 0; i < 6; i++) {
+            __m256d ai = _mm256_broadcast_sd(a + i);
+            acc[i][0] = _mm256_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_pd(ai, b1, acc[i][1]);
+        }
+        a += 6;
+        b += 8;
+    }
+    for (int i = 0; i < 6; i++) {
+        double *row = c + i * ldc;
+        if (accumulate) {
+            acc[i][0] = _mm256_add_pd(acc[i][0], _mm256_loadu_pd(row));
+            acc[i][1] = _mm256_add_pd(acc[i][1], _mm256_loadu_pd(row + 4));
+        }
+        _mm256_storeu_pd(row, acc[i][0]);
+        _mm256_storeu_pd(row + 4, acc[i][1]);
+    }
+}
+
+__attribute__((target("avx512f")))
+void MicroKernelAvx512(size_t kc, const double *a, const double *b, double *c, size_t ldc, bool accumulate) {
+    __m512d acc[8][2];
+    for (int i = 0; i < 8; i++) {
+        acc[i][0] = _mm512_setzero_pd();
+        acc[i][1] = _mm512_setzero_pd();
+    }
+    for (size_t p = 0; p < kc; p++) {
+        __m512d b0 = _mm512_loadu_pd(b);
+        __m512d b1 = _mm512_loadu_pd(b + 8);
+        for (int i = 0; i < 8; i++) {
+            __m512d ai = _mm512_set1_pd(a[i]);
+            acc[i][0] = _mm512_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_pd(ai, b1, acc[i][1]);
+        }
+        a += 8;
+        b += 16;
+    }
+    for (int i = 0; i < 8; i++) {
+        double *row = c + i * ldc;
+        if (accumulate) {
+            acc[i][0] = _mm512_add_pd(acc[i][0], _mm512_loadu_pd(row));
+            acc[i][1] = _mm512_add_pd(acc[i][1], _mm512_loadu_pd(row + 8));
+        }
+        _mm512_storeu_pd(row, acc[i][0]);
+        _mm512_storeu_pd(row + 8, acc[i][1]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void MicroKernelAvx2(size_t kc, const float *a, const float *b, float *c, size_t ldc, bool accumulate) {
+    __m256 acc[6][2];
+    for (int i = 0; i < 6; i++) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+    for (size_t p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (int i = 0; i < 6; i++) {
+            __m256 ai = _mm256_broadcast_ss(a + i);
+            acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 6;
+        b += 16;
+    }
+    for (int i = 0; i < 6; i++) {
+        float *row = c + i * ldc;
+        if (accumulate) {
+            acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(row));
+            acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(row + 8));
+        }
+        _mm256_storeu_ps(row, acc[i][0]);
+        _mm256_storeu_ps(row + 8, acc[i][1]);
+    }
+}
+
+__attribute__((target("avx512f")))
+void MicroKernelAvx512(size_t kc, const float *a, const float *b, float *c, size_t ldc, bool accumulate) {
+    __m512 acc[8][2];
+    for (int i = 0; i < 8; i++) {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+    for (size_t p = 0; p < kc; p++) {
+        __m512 b0 = _mm512_loadu_ps(b);
+        __m512 b1 = _mm512_loadu_ps(b + 16);
+        for (int i = 0; i < 8; i++) {
+            __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += 8;
+        b += 32;
+    }
+    for (int i = 0; i < 8; i++) {
+        float *row = c + i * ldc;
+        if (accumulate) {
+            acc[i][0] = _mm512_add_ps(acc[i][0], _mm512_loadu_ps(row));
+            acc[i][1] = _mm512_add_ps(acc[i][1], _mm512_loadu_ps(row + 16));
+        }
+        _mm512_storeu_ps(row, acc[i][0]);
+        _mm512_storeu_ps(row + 16, acc[i][1]);
+    }
+}
+
+// float kernels have the same register budget as the double ones, so their NR doubles.
+template <typename T>
+struct KernelTable;
+
+template <>
+struct KernelTable<double> {
+    static constexpr GemmKernel<double> kernels[] = {
+        { GemmIsa::Scalar, 4, 4, MicroKernelScalar<double> },
+        { GemmIsa::Avx2, 6, 8, MicroKernelAvx2 },
+        { GemmIsa::Avx512, 8, 16, MicroKernelAvx512 },
+    };
+};
+
+template <>
+struct KernelTable<float> {
+    static constexpr GemmKernel<float> kernels[] = {
+        { GemmIsa::Scalar, 4, 4, MicroKernelScalar<float> },
+        { GemmIsa::Avx2, 6, 16, MicroKernelAvx2 },
+        { GemmIsa::Avx512, 8, 32, MicroKernelAvx512 },
+    };
+};
+
+GemmIsa requested_isa = GemmIsa::Auto;
+
+GemmIsa ResolveIsa(GemmIsa isa) {
+    if (isa != GemmIsa::Auto && GemmIsaSupported(isa)) return isa;
+    if (GemmIsaSupported(GemmIsa::Avx512)) return GemmIsa::Avx512;
+    if (GemmIsaSupported(GemmIsa::Avx2)) return GemmIsa::Avx2;
+    return GemmIsa::Scalar;
+}
+
+template <typename T>
+const GemmKernel<T> &SelectKernel() {
+    GemmIsa isa = ResolveIsa(requested_isa);
+    for (const GemmKernel<T> &kernel : KernelTable<T>::kernels) {
+        if (kernel.isa == isa) return kernel;
+    }
+    return KernelTable<T>::kernels[0];
+}
+
+template <typename T>
+bool HasEpilogue(const GemmEpilogue<T> &epilogue) {
+    return epilogue.bias || epilogue.activation != GemmActivation::None || epilogue.mask;
+}
+
+// Applies the epilogue to the height x width block of C at (row0, col0).
+template <typename T>
+void ApplyEpilogue(T *c, size_t ldc, size_t height, size_t width, size_t row0, size_t col0,
+                   const GemmEpilogue<T> &epilogue) {
+    for (size_t i = 0; i < height; i++) {
+        T *row = c + i * ldc;
+        if (epilogue.bias) {
+            const T *bias = epilogue.bias + col0;
+            #pragma omp simd
+            for (size_t j = 0; j < width; j++) row[j] += bias[j];
+        }
+        if (epilogue.activation == GemmActivation::ReLU) {
+            #pragma omp simd
+            for (size_t j = 0; j < width; j++) row[j] = row[j] > T(0) ? row[j] : T(0);
+        }
+        if (epilogue.mask) {
+            const T *mask = epilogue.mask + (row0 + i) * epilogue.ldmask + col0;
+            #pragma omp simd
+            for (size_t j = 0; j < width; j++) row[j] = mask[j] > T(0) ? row[j] : T(0);
+        }
+    }
+}
+
+// Kernels for GEMV-like shapes. With B untransposed every row of B is read
+// once, contiguously, and the inner loop vectorizes over the columns of C;
+// with B transposed each C element is a contiguous dot product instead.
+// Element (i, p) of A is a[i * rsa + p * csa]; likewise for B.
+template <typename T>
+void GemmDirect(size_t m, size_t n, size_t k, const T *a, size_t rsa, size_t csa,
+                const T *b, size_t rsb, size_t csb, T *c, size_t ldc, const GemmEpilogue<T> &epilogue) {
+    bool has_epilogue = HasEpilogue(epilogue);
+    ParallelFor(m, m * n * k, [&](size_t row_begin, size_t row_end) {
+        for (size_t i = row_begin; i < row_end; i++) {
+            T *c_row = c + i * ldc;
+            const T *a_row = a + i * rsa;
+            if (csb == 1) {
+                std::fill(c_row, c_row + n, T(0));
+                for (size_t p = 0; p < k; p++) {
+                    T aip = a_row[p * csa];
+                    const T *b_row = b + p * rsb;
+                    #pragma omp simd
+                    for (size_t j = 0; j < n; j++) {
+                        c_row[j] += aip * b_row[j];
+                    }
+                }
+            } else if (csa == 1 && rsb == 1) {
+                for (size_t j = 0; j < n; j++) {
+                    const T *b_col = b + j * csb;
+                    T sum = T(0);
+                    #pragma omp simd reduction(+:sum)
+                    for (size_t p = 0; p < k; p++) {
+                        sum += a_row[p] * b_col[p];
+                    }
+                    c_row[j] = sum;
+                }
+            } else {
+                for (size_t j = 0; j < n; j++) {
+                    T sum = T(0);
+                    for (size_t p = 0; p < k; p++) sum += a_row[p * csa] * b[p * rsb + j * csb];
+                    c_row[j] = sum;
+                }
+            }
+            if (has_epilogue) ApplyEpilogue(c_row, ldc, 1, n, i, 0, epilogue);
+        }
+    }, DIRECT_GEMM_WORK * 16);
+}
+
+// Packs a kc x nc block of B into NR-wide panels, zero-padding the last one.
+// A transposed B is walked along its contiguous k axis instead.
+template <typename T>
+void PackB(size_t kc, size_t nc, size_t nr, const T *b, size_t rsb, size_t csb, T *packed) {
+    size_t panels = (nc + nr - 1) / nr;
+    ParallelFor(panels, kc * nc, [&](size_t panel_begin, size_t panel_end) {
+        for (size_t panel = panel_begin; panel < panel_end; panel++) {
+            size_t j0 = panel * nr;
+            size_t width = std::min(nr, nc - j0);
+            T *dst = packed + panel * kc * nr;
+            if (csb == 1) {
+                for (size_t p = 0; p < kc; p++) {
+                    const T *src = b + p * rsb + j0;
+                    for (size_t j = 0; j < width; j++) dst[j] = src[j];
+                    for (size_t j = width; j < nr; j++) dst[j] = T(0);
+                    dst += nr;
+                }
+            } else {
+                for (size_t j = 0; j < nr; j++) {
+                    const T *src = b + (j0 + j) * csb;
+                    if (j < width) {
+                        for (size_t p = 0; p < kc; p++) dst[p * nr + j] = src[p * rsb];
+                    } else {
+                        for (size_t p = 0; p < kc; p++) dst[p * nr + j] = T(0);
+                    }
+                }
+            }
+        }
+    }, DIRECT_GEMM_WORK);
+}
+
+// Packs an mc x kc block of A into MR-tall panels stored column by column.
+// A transposed A is already column-major, so that copy is contiguous.
+template <typename T>
+void PackA(size_t mc, size_t kc, size_t mr, const T *a, size_t rsa, size_t csa, T *packed) {
+    size_t panels = (mc + mr - 1) / mr;
+    ParallelFor(panels, mc * kc, [&](size_t panel_begin, size_t panel_end) {
+        for (size_t panel = panel_begin; panel < panel_end; panel++) {
+            size_t i0 = panel * mr;
+            size_t height = std::min(mr, mc - i0);
+            T *dst = packed + panel * kc * mr;
+            for (size_t p = 0; p < kc; p++) {
+                for (size_t i = 0; i < height; i++) dst[i] = a[(i0 + i) * rsa + p * csa];
+                for (size_t i = height; i < mr; i++) dst[i] = T(0);
+                dst += mr;
+            }
+        }
+    }, DIRECT_GEMM_WORK);
+}
+
+template <typename T>
+void GemmPacked(const GemmKernel<T> &kernel, size_t m, size_t n, size_t k,
+                const T *a, size_t rsa, size_t csa, const T *b, size_t rsb, size_t csb, T *c, size_t ldc,
+                const GemmEpilogue<T> &epilogue) {
+    const bool has_epilogue = HasEpilogue(epilogue);
+    const size_t mr = kernel.mr;
+    const size_t nr = kernel.nr;
+    const size_t mc_max = (MC / mr) * mr;
+
+    thread_local std::vector <T> packed_a;
+    thread_local std::vector <T> packed_b;
+    packed_a.resize(mc_max * KC);
+    packed_b.resize(KC * (NC + nr));
+
+    for (size_t jc = 0; jc < n; jc += NC) {
+        size_t nc = std::min(NC, n - jc);
+        size_t n_panels = (nc + nr - 1) / nr;
+        for (size_t pc = 0; pc < k; pc += KC) {
+            size_t kc = std::min(KC, k - pc);
+            bool accumulate = pc > 0;
+            bool last_k = pc + kc >= k;
+            PackB(kc, nc, nr, b + pc * rsb + jc * csb, rsb, csb, packed_b.data());
+
+            for (size_t ic = 0; ic < m; ic += mc_max) {
+                size_t mc = std::min(mc_max, m - ic);
+                size_t m_panels = (mc + mr - 1) / mr;
+                PackA(mc, kc, mr, a + ic * rsa + pc * csa, rsa, csa, packed_a.data());
+
+                const T *pa = packed_a.data();
+                const T *pb = packed_b.data();
+                // Tiles are numbered column-panel-major, the order collapse(2) used.
+                ParallelFor(n_panels * m_panels, mc * nc * kc, [&](size_t tile_begin, size_t tile_end) {
+                    for (size_t t = tile_begin; t < tile_end; t++) {
+                        size_t jr = t / m_panels;
+                        size_t ir = t % m_panels;
+                        size_t i0 = ir * mr;
+                        size_t j0 = jr * nr;
+                        size_t height = std::min(mr, mc - i0);
+                        size_t width = std::min(nr, nc - j0);
+                        T *c_tile = c + (ic + i0) * ldc + jc + j0;
+                        const T *a_panel = pa + ir * kc * mr;
+                        const T *b_panel = pb + jr * kc * nr;
+                        if (height == mr && width == nr) {
+                            kernel.run(kc, a_panel, b_panel, c_tile, ldc, accumulate);
+                        } else {
+                            T tile[MAX_TILE];
+                            kernel.run(kc, a_panel, b_panel, tile, nr, false);
+                            for (size_t i = 0; i < height; i++) {
+                                for (size_t j = 0; j < width; j++) {
+                                    T val = tile[i * nr + j];
+                                    c_tile[i * ldc + j] = accumulate ? c_tile[i * ldc + j] + val : val;
+                                }
+                            }
+                        }
+                        if (has_epilogue && last_k) {
+                            ApplyEpilogue(c_tile, ldc, height, width, ic + i0, jc + j0, epilogue);
+                        }
+                    }
+                }, DIRECT_GEMM_WORK * 16);
+            }
+        }
+    }
+}
+
+// Cache-tiled transpose: the matrix is walked in TRANSPOSE_TILE squares so
+// both the rows read and the rows written stay in L1, and each square is done
+// as in-register 8x8 (float) or 4x4 (double) transposes where AVX2 allows.
+const size_t TRANSPOSE_TILE = 32;
+
+__attribute__((target("avx2")))
+void TransposeMicroAvx2(const float *src, size_t lds, float *dst, size_t ldd) {
+    __m256 r[8], t[8];
+    for (int i = 0; i < 8; i++) r[i] = _mm256_loadu_ps(src + i * lds);
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        r[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xEE);
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xEE);
+    }
+    for (int i = 0; i < 4; i++) {
+        _mm256_storeu_ps(dst + i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+        _mm256_storeu_ps(dst + (i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+    }
+}
+
+__attribute__((target("avx2")))
+void TransposeMicroAvx2(const double *src, size_t lds, double *dst, size_t ldd) {
+    __m256d r0 = _mm256_loadu_pd(src);
+    __m256d r1 = _mm256_loadu_pd(src + lds);
+    __m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+    __m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+// Transposes the rows x cols block at src into dst, one micro block at a time
+// and scalar along the ragged edges.
+template <typename T>
+void TransposeTile(size_t rows, size_t cols, const T *src, size_t lds, T *dst, size_t ldd, bool simd) {
+    const size_t micro = 32 / sizeof(T);
+    size_t i = 0;
+    if (simd) {
+        for (; i + micro <= rows; i += micro) {
+            size_t j = 0;
+            for (; j + micro <= cols; j += micro) {
+                TransposeMicroAvx2(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+            }
+            for (; j < cols; j++) {
+                for (size_t ii = i; ii < i + micro; ii++) dst[j * ldd + ii] = src[ii * lds + j];
+            }
+        }
+    }
+    for (; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) dst[j * ldd + i] = src[i * lds + j];
+    }
+}
+
+template <typename T>
+void TransposeImpl(size_t rows, size_t cols, const T *src, size_t lds, T *dst, size_t ldd) {
+    bool simd = ResolveIsa(requested_isa) != GemmIsa::Scalar;
+    size_t col_tiles = (cols + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    // Split over column tiles of src, i.e. row bands of dst, so each thread
+    // writes a contiguous block.
+    ParallelFor(col_tiles, rows * cols, [&](size_t tile_begin, size_t tile_end) {
+        for (size_t tile = tile_begin; tile < tile_end; tile++) {
+            size_t j0 = tile * TRANSPOSE_TILE;
+            size_t width = std::min(TRANSPOSE_TILE, cols - j0);
+            for (size_t i0 = 0; i0 < rows; i0 += TRANSPOSE_TILE) {
+                size_t height = std::min(TRANSPOSE_TILE, rows - i0);
+                TransposeTile(height, width, src + i0 * lds + j0, lds, dst + j0 * ldd + i0, ldd, simd);
+            }
+        }
+    });
+}
+
+}
+
+void SetGemmIsa(GemmIsa isa) {
+    requested_isa = isa;
+}
+
+GemmIsa GetGemmIsa() {
+    return ResolveIsa(requested_isa);
+}
+
+const char *GemmIsaName(GemmIsa isa) {
+    switch (isa) {
+        case GemmIsa::Scalar: return "scalar";
+        case GemmIsa::Avx2: return "avx2";
+        case GemmIsa::Avx512: return "avx512";
+        default: return "auto";
+    }
+}
+
+bool GemmIsaSupported(GemmIsa isa) {
+    switch (isa) {
+        case GemmIsa::Scalar: return true;
+        case GemmIsa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case GemmIsa::Avx512: return __builtin_cpu_supports("avx512f");
+        default: return true;
+    }
+}
+
+template <typename T>
+void GemmImpl(GemmTranspose transpose, size_t m, size_t n, size_t k, const T *a, size_t lda, const T *b, size_t ldb,
+              T *c, size_t ldc, const GemmEpilogue<T> &epilogue) {
+    if (m == 0 || n == 0) return;
+    bool transpose_a = transpose == GemmTranspose::A || transpose == GemmTranspose::Both;
+    bool transpose_b = transpose == GemmTranspose::B || transpose == GemmTranspose::Both;
+    size_t rsa = transpose_a ? 1 : lda, csa = transpose_a ? lda : 1;
+    size_t rsb = transpose_b ? 1 : ldb, csb = transpose_b ? ldb : 1;
+    TELEMETRY_ADD(telemetry::Metric::GemmFlops, 2 * m * n * k);
+    const GemmKernel<T> &kernel = SelectKernel<T>();
+    if (k == 0) {
+        for (size_t i = 0; i < m; i++) std::fill(c + i * ldc, c + i * ldc + n, T(0));
+        if (HasEpilogue(epilogue)) ApplyEpilogue(c, ldc, m, n, 0, 0, epilogue);
+        return;
+    }
+    if (m < kernel.mr || m * n * k < DIRECT_GEMM_WORK) {
+        GemmDirect(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, epilogue);
+        return;
+    }
+    GemmPacked(kernel, m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, epilogue);
+}
+
+void Gemm(size_t m, size_t n, size_t k,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc,
+          const GemmEpilogue<double> &epilogue) {
+    GemmImpl(GemmTranspose::None, m, n, k, a, lda, b, ldb, c, ldc, epilogue);
+}
+
+void Gemm(size_t m, size_t n, size_t k,
+          const float *a, size_t lda,
+          const float *b, size_t ldb,
+          float *c, size_t ldc,
+          const GemmEpilogue<float> &epilogue) {
+    GemmImpl(GemmTranspose::None, m, n, k, a, lda, b, ldb, c, ldc, epilogue);
+}
+
+void Gemm(GemmTranspose transpose, size_t m, size_t n, size_t k,
+          const double *a, size_t lda,
+          const double *b, size_t ldb,
+          double *c, size_t ldc,
+          const GemmEpilogue<double> &epilogue) {
+    GemmImpl(transpose, m, n, k, a, lda, b, ldb, c, ldc, epilogue);
+}
+
+void Gemm(GemmTranspose transpose, size_t m, size_t n, size_t k,
+          const float *a, size_t lda,
+          const float *b, size_t ldb,
+          float *c, size_t ldc,
+          const GemmEpilogue<float> &epilogue) {
+    GemmImpl(transpose, m, n, k, a, lda, b, ldb, c, ldc, epilogue);
+}
+
+void TransposeCopy(size_t rows, size_t cols, const double *src, size_t lds, double *dst, size_t ldd) {
+    TransposeImpl(rows, cols, src, lds, dst, ldd);
+}
+
+void TransposeCopy(size_t rows, size_t cols, const float *src, size_t lds, float *dst, size_t ldd) {
+    TransposeImpl(rows, cols, src, lds, dst, ldd);
+}
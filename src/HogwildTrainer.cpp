@@ -0,0 +1,75 @@
+#include "HogwildTrainer.h"
+#include "Telemetry.h"
+#include "Parallel.h"
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <cassert>
+
+template <typename T>
+BasicHogwildTrainer<T>::BasicHogwildTrainer(BasicNeuralNetwork<T> &nn, BasicOptimizer<T> &optimizer, const IdxDataset &images,
+                                            const IdxDataset &labels, size_t batch_size, int threads, unsigned int seed)
+    : nn(nn), optimizer(optimizer), images(images), labels(labels), batch_size(batch_size), threads(threads), rng(seed) {
+    assert(images.Count() == labels.Count() && "Image and label counts must match.");
+    assert(batch_size > 0 && threads > 0 && "Batch size and thread count must be positive.");
+    assert(!nn.IsMapped() && "A mapped model is read-only and cannot be trained.");
+    order.resize(images.Count());
+    std::iota(order.begin(), order.end(), 0);
+
+    // Optimizer state must exist before workers step concurrently.
+    nn.ReserveOptimizer(optimizer);
+    workspaces.resize(threads);
+    inputs.resize(threads, BasicMatrix<T>(0, 0));
+    batch_labels.resize(threads);
+    losses.resize(threads);
+    // Allocated by the member that uses them (first touch on its node).
+    ParallelTeam(threads, [&](int member, int members) {
+        for (int t = member; t < threads; t += members) {
+            workspaces[t].Reserve(nn.GetLayers(), batch_size);
+            inputs[t].Reserve((int)batch_size, (int)images.ItemSize());
+            batch_labels[t].reserve(batch_size);
+        }
+    });
+}
+
+template <typename T>
+size_t BasicHogwildTrainer<T>::BatchesPerEpoch() const {
+    return (order.size() + batch_size - 1) / batch_size;
+}
+
+template <typename T>
+double BasicHogwildTrainer<T>::RunEpoch() {
+    std::shuffle(order.begin(), order.end(), rng);
+    size_t per_epoch = BatchesPerEpoch();
+    std::atomic <size_t> next(0);
+    std::fill(losses.begin(), losses.end(), 0.0);
+
+    ParallelTeam(threads, [&](int t, int) {
+        BasicMatrix<T> &input = inputs[t];
+        std::vector <int> &label = batch_labels[t];
+        double loss = 0.0;
+        for (size_t b = next.fetch_add(1, std::memory_order_relaxed); b < per_epoch;
+             b = next.fetch_add(1, std::memory_order_relaxed)) {
+            size_t start = b * batch_size;
+            size_t end = std::min(start + batch_size, order.size());
+            {
+                TELEMETRY_SCOPE(telemetry::Phase::Data);
+                images.Gather(order.data() + start, end - start, input);
+                label.resize(end - start);
+                for (size_t i = start; i < end; i++) {
+                    label[i - start] = labels.Label(order[i]);
+                }
+            }
+            // Reads the shared weights while other workers update them.
+            loss += nn.BackPropagateBatch(input, label, optimizer, workspaces[t]) * (end - start);
+        }
+        losses[t] = loss;
+    });
+
+    double total = 0.0;
+    for (double loss : losses) total += loss;
+    return total / static_cast<double>(order.size());
+}
+
+template class BasicHogwildTrainer<float>;
+template class BasicHogwildTrainer<double>;
@@ -0,0 +1,155 @@
+#include "IdxDataset.h"
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+
+// IDX header: two zero bytes, a type code, the number of dimensions, then
+// one big-endian int32 per dimension.
+static const uint8_t IDX_UNSIGNED_BYTE = 0x08;
+
+static int ReadBigEndian(const uint8_t *p) {
+    return (int)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+}
+
+void CheckIdxFile(bool ok, const std::string &path, const char *problem) {
+    if (ok) return;
+    fprintf(stderr, "%s: %s\n", path.c_str(), problem);
+    std::exit(1);
+}
+
+// Checks the type byte and dimension count of a header.
+static void CheckIdxMagic(const uint8_t *magic, const std::string &path) {
+    CheckIdxFile(magic[0] == 0 && magic[1] == 0, path, "Bad IDX magic number.");
+    CheckIdxFile(magic[2] == IDX_UNSIGNED_BYTE, path, "Only unsigned-byte IDX files are supported.");
+    CheckIdxFile(magic[3] >= 1, path, "IDX files need at least one dimension.");
+}
+
+// Returns the bytes per item (the product of every dimension after the
+// first) and checks that the dims fill exactly payload_size bytes. Each
+// factor is bounded by the payload before it is multiplied in, so hostile
+// dimensions cannot overflow the product.
+static size_t IdxItemSize(const std::vector <int> &dims, size_t payload_size, const std::string &path) {
+    size_t item_size = 1;
+    for (size_t i = 0; i < dims.size(); i++) {
+        CheckIdxFile(dims[i] > 0, path, "IDX dimensions must be positive.");
+        CheckIdxFile((size_t)dims[i] <= payload_size / item_size, path, "IDX file size does not match its dimensions.");
+        if (i > 0) item_size *= (size_t)dims[i];
+    }
+    CheckIdxFile(item_size <= INT_MAX, path, "IDX items are too large.");
+    CheckIdxFile((size_t)dims[0] * item_size == payload_size, path, "IDX file size does not match its dimensions.");
+    return item_size;
+}
+
+IdxDataset::IdxDataset(const std::string &path) : file(path) {
+    const uint8_t *mapping = file.Data();
+    size_t mapping_size = file.Size();
+    CheckIdxFile(mapping_size >= 4, path, "Truncated IDX header.");
+    CheckIdxMagic(mapping, path);
+    int num_dims = mapping[3];
+    CheckIdxFile(mapping_size >= 4 + 4 * (size_t)num_dims, path, "Truncated IDX header.");
+    for (int i = 0; i < num_dims; i++) {
+        dims.push_back(ReadBigEndian(mapping + 4 + 4 * i));
+    }
+    payload = mapping + 4 + 4 * num_dims;
+    item_size = IdxItemSize(dims, mapping_size - (payload - mapping), path);
+}
+
+size_t IdxDataset::Count() const {
+    return (size_t)dims[0];
+}
+
+size_t IdxDataset::ItemSize() const {
+    return item_size;
+}
+
+const std::vector <int> &IdxDataset::Dims() const {
+    return dims;
+}
+
+const uint8_t *IdxDataset::Item(size_t index) const {
+    return payload + index * item_size;
+}
+
+int IdxDataset::Label(size_t index) const {
+    return (int)payload[index * item_size];
+}
+
+template <typename T>
+void IdxDataset::Gather(const size_t *indices, size_t n, BasicMatrix<T> &batch) const {
+    batch.Resize((int)n, (int)item_size);
+    const T scale = T(1) / T(255);
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *src = Item(indices[i]);
+        T *dst = batch.Data() + i * item_size;
+        #pragma omp simd
+        for (size_t j = 0; j < item_size; j++) {
+            dst[j] = static_cast <T> (src[j]) * scale;
+        }
+    }
+}
+
+template <typename T>
+void IdxDataset::GatherRange(size_t start, size_t end, BasicMatrix<T> &batch) const {
+    BytesToRows(Item(start), end - start, item_size, batch);
+}
+
+template <typename T>
+void BytesToRows(const uint8_t *src, size_t rows, size_t item_size, BasicMatrix<T> &batch) {
+    batch.Resize((int)rows, (int)item_size);
+    const T scale = T(1) / T(255);
+    T *dst = batch.Data();
+    size_t count = rows * item_size;
+    #pragma omp simd
+    for (size_t j = 0; j < count; j++) {
+        dst[j] = static_cast <T> (src[j]) * scale;
+    }
+}
+
+IdxStream::IdxStream(const std::string &path) : file(path, std::ios::binary | std::ios::ate), path(path), position(0) {
+    CheckIdxFile(file.is_open(), path, "Failed to open IDX file.");
+    size_t file_size = (size_t)file.tellg();
+    file.seekg(0);
+    uint8_t magic[4] = {};
+    file.read((char *)magic, 4);
+    CheckIdxFile((bool)file, path, "Truncated IDX header.");
+    CheckIdxMagic(magic, path);
+    int num_dims = magic[3];
+    CheckIdxFile(file_size >= 4 + 4 * (size_t)num_dims, path, "Truncated IDX header.");
+    for (int i = 0; i < num_dims; i++) {
+        uint8_t raw[4] = {};
+        file.read((char *)raw, 4);
+        CheckIdxFile((bool)file, path, "Truncated IDX header.");
+        dims.push_back(ReadBigEndian(raw));
+    }
+    item_size = IdxItemSize(dims, file_size - 4 - 4 * (size_t)num_dims, path);
+}
+
+size_t IdxStream::Count() const {
+    return (size_t)dims[0];
+}
+
+size_t IdxStream::ItemSize() const {
+    return item_size;
+}
+
+const std::vector <int> &IdxStream::Dims() const {
+    return dims;
+}
+
+size_t IdxStream::Read(size_t max_items, std::vector <uint8_t> &bytes) {
+    size_t n = std::min(max_items, Count() - position);
+    bytes.resize(n * item_size);
+    if (n == 0) return 0;
+    file.read((char *)bytes.data(), (std::streamsize)bytes.size());
+    CheckIdxFile((bool)file, path, "Failed to read IDX file.");
+    position += n;
+    return n;
+}
+
+template void IdxDataset::Gather<float>(const size_t *, size_t, BasicMatrix<float> &) const;
+template void IdxDataset::Gather<double>(const size_t *, size_t, BasicMatrix<double> &) const;
+template void IdxDataset::GatherRange<float>(size_t, size_t, BasicMatrix<float> &) const;
+template void IdxDataset::GatherRange<double>(size_t, size_t, BasicMatrix<double> &) const;
+template void BytesToRows<float>(const uint8_t *, size_t, size_t, BasicMatrix<float> &);
+template void BytesToRows<double>(const uint8_t *, size_t, size_t, BasicMatrix<double> &);
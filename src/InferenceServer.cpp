@@ -0,0 +1,356 @@
+#ifndef _WIN32
+
+#include "InferenceServer.h"
+#include "IdxDataset.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static uint64_t SteadyNs() {
+    return (uint64_t)std::chrono::duration_cast <std::chrono::nanoseconds> (
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Writes all of data, waiting for the socket to drain when it is full.
+static bool WriteAll(int fd, const void *data, size_t size) {
+    const char *out = (const char *)data;
+    while (size > 0) {
+        ssize_t sent = ::send(fd, out, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            pollfd pfd = { fd, POLLOUT, 0 };
+            if (poll(&pfd, 1, 1000) <= 0) return false;
+            continue;
+        }
+        out += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t size) {
+    char *in = (char *)data;
+    while (size > 0) {
+        ssize_t got = ::recv(fd, in, size, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        in += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+static sockaddr_un SocketAddress(const std::string &path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    assert(path.size() < sizeof(address.sun_path) && "Socket path is too long.");
+    memcpy(address.sun_path, path.c_str(), std::min(path.size(), sizeof(address.sun_path) - 1));
+    return address;
+}
+
+// Owned by the I/O thread's list and by every queued request from it, so the
+// descriptor is closed only after the last response has been written.
+template <typename T>
+struct BasicInferenceServer<T>::Connection {
+    int fd;
+    std::vector <uint8_t> frame;
+    size_t filled = 0;
+    std::mutex write_mutex;
+    // Set, under write_mutex, once a write gave up part-way through a frame.
+    bool broken = false;
+
+    Connection(int fd, size_t frame_size) : fd(fd), frame(frame_size) {}
+    ~Connection() { close(fd); }
+};
+
+template <typename T>
+BasicInferenceServer<T>::BasicInferenceServer(const BasicNeuralNetwork<T> &nn, const std::string &socket_path,
+                                              const InferenceServerOptions &options)
+    : nn(nn), options(options), socket_path(socket_path), input_size((size_t)nn.GetLayerSizes().front()),
+      head(0), count(0), stopping(false), stop_requested(false), served(0), batches(0) {
+    assert(options.max_batch > 0 && options.workers > 0 && "Batch size and worker count must be positive.");
+    assert(options.max_pending >= options.max_batch && "The queue must hold at least one full batch.");
+    pending.resize(options.max_pending);
+    pixels.resize(options.max_pending * input_size);
+
+    sockaddr_un address = SocketAddress(socket_path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(listen_fd >= 0 && "socket failed.");
+    unlink(socket_path.c_str());
+    int ok = bind(listen_fd, (const sockaddr *)&address, sizeof(address));
+    assert(ok == 0 && "Cannot bind the server socket.");
+    ok = listen(listen_fd, 128);
+    assert(ok == 0 && "listen failed.");
+    (void)ok;
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+}
+
+template <typename T>
+BasicInferenceServer<T>::~BasicInferenceServer() {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+template <typename T>
+void BasicInferenceServer<T>::RequestStop() {
+    stop_requested.store(true);
+}
+
+template <typename T>
+uint64_t BasicInferenceServer<T>::RequestsServed() const {
+    return served.load();
+}
+
+template <typename T>
+uint64_t BasicInferenceServer<T>::BatchesRun() const {
+    return batches.load();
+}
+
+template <typename T>
+size_t BasicInferenceServer<T>::FreeSlots() {
+    std::lock_guard <std::mutex> lock(mutex);
+    return pending.size() - count;
+}
+
+template <typename T>
+void BasicInferenceServer<T>::Enqueue(const std::shared_ptr <Connection> &connection, const uint8_t *frame) {
+    std::lock_guard <std::mutex> lock(mutex);
+    assert(count < pending.size() && "The I/O thread read past the queue's free space.");
+    size_t slot = (head + count) % pending.size();
+    Pending &request = pending[slot];
+    request.connection = connection;
+    memcpy(&request.id, frame, sizeof(uint32_t));
+    request.arrival_ns = SteadyNs();
+    memcpy(pixels.data() + slot * input_size, frame + sizeof(uint32_t), input_size);
+    count++;
+}
+
+// Only reads as many bytes as the queue has room for, so a full queue pushes
+// back on the clients through their socket buffers instead of growing.
+template <typename T>
+void BasicInferenceServer<T>::ServeConnections() {
+    const size_t frame_size = sizeof(uint32_t) + input_size;
+    const InferenceHello hello = { (uint32_t)input_size, (uint32_t)nn.GetLayerSizes().back() };
+    std::vector <std::shared_ptr <Connection>> connections;
+    std::vector <pollfd> fds;
+    std::vector <uint8_t> buffer(64 * 1024);
+
+    while (!stop_requested.load()) {
+        size_t free_slots = FreeSlots();
+        fds.clear();
+        fds.push_back({ listen_fd, POLLIN, 0 });
+        for (const std::shared_ptr <Connection> &connection : connections) {
+            fds.push_back({ connection -> fd, (short)(free_slots > 0 ? POLLIN : 0), 0 });
+        }
+        // A short timeout while the queue is full, to resume reading soon
+        // after the workers drain it; otherwise just often enough to notice
+        // RequestStop().
+        if (poll(fds.data(), fds.size(), free_slots > 0 ? 50 : 1) <= 0) continue;
+
+        bool queued = false;
+        size_t polled = connections.size();
+        for (size_t i = 0; i < polled; i++) {
+            std::shared_ptr <Connection> &connection = connections[i];
+            if (fds[i + 1].revents == 0) continue;
+            free_slots = FreeSlots();
+            if (free_slots == 0) break;
+            size_t budget = std::min(buffer.size(), free_slots * frame_size - connection -> filled);
+            ssize_t got = ::recv(connection -> fd, buffer.data(), budget, 0);
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+            if (got <= 0) {
+                connection.reset();
+                continue;
+            }
+            const uint8_t *in = buffer.data();
+            size_t left = (size_t)got;
+            while (left > 0) {
+                size_t take = std::min(left, frame_size - connection -> filled);
+                memcpy(connection -> frame.data() + connection -> filled, in, take);
+                connection -> filled += take;
+                in += take;
+                left -= take;
+                if (connection -> filled == frame_size) {
+                    Enqueue(connection, connection -> frame.data());
+                    connection -> filled = 0;
+                    queued = true;
+                }
+            }
+        }
+        connections.erase(std::remove(connections.begin(), connections.end(), nullptr), connections.end());
+        if (queued) request_ready.notify_all();
+
+        if (fds[0].revents & POLLIN) {
+            for (int fd = accept(listen_fd, nullptr, nullptr); fd >= 0; fd = accept(listen_fd, nullptr, nullptr)) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                if (WriteAll(fd, &hello, sizeof(hello))) {
+                    connections.push_back(std::make_shared <Connection> (fd, frame_size));
+                } else {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        stopping = true;
+    }
+    request_ready.notify_all();
+}
+
+template <typename T>
+void BasicInferenceServer<T>::RunWorker() {
+    const size_t max_batch = options.max_batch;
+    BasicInferenceBuffers<T> buffers;
+    BasicMatrix<T> batch(0, 0);
+    BasicMatrix<T> probs(0, 0);
+    batch.Reserve((int)max_batch, (int)input_size);
+    std::vector <uint8_t> staged(max_batch * input_size);
+    std::vector <Pending> taken(max_batch);
+    std::vector <InferenceResponse> responses(max_batch);
+    std::vector <InferenceResponse> grouped(max_batch);
+    std::vector <size_t> order(max_batch);
+
+    for (;;) {
+        size_t n;
+        {
+            std::unique_lock <std::mutex> lock(mutex);
+            request_ready.wait(lock, [&]() { return stopping || count > 0; });
+            if (count == 0) return;
+            // The oldest request sets the deadline; later arrivals ride along.
+            auto deadline = std::chrono::steady_clock::time_point(std::chrono::duration_cast <std::chrono::steady_clock::duration> (
+                std::chrono::nanoseconds(pending[head].arrival_ns + (uint64_t)options.max_delay_us * 1000)));
+            while (!stopping && count > 0 && count < max_batch && std::chrono::steady_clock::now() < deadline) {
+                request_ready.wait_until(lock, deadline);
+            }
+            // Another worker may have taken them while this one waited.
+            if (count == 0) continue;
+            n = std::min(count, max_batch);
+            for (size_t i = 0; i < n; i++) {
+                size_t slot = (head + i) % pending.size();
+                taken[i] = std::move(pending[slot]);
+                memcpy(staged.data() + i * input_size, pixels.data() + slot * input_size, input_size);
+            }
+            head = (head + n) % pending.size();
+            count -= n;
+        }
+
+        BytesToRows(staged.data(), n, input_size, batch);
+        nn.PredictProbaBatch(batch, probs, buffers);
+        for (size_t i = 0; i < n; i++) {
+            int label = probs.RowArgMax((int)i);
+            responses[i] = { taken[i].id, label, (float)probs((int)i, label) };
+            order[i] = i;
+        }
+
+        // One write per connection rather than one per response.
+        std::sort(order.begin(), order.begin() + n, [&](size_t x, size_t y) {
+            return taken[x].connection.get() < taken[y].connection.get();
+        });
+        for (size_t i = 0; i < n;) {
+            Connection *connection = taken[order[i]].connection.get();
+            size_t run = 0;
+            for (; i < n && taken[order[i]].connection.get() == connection; i++) grouped[run++] = responses[order[i]];
+            std::lock_guard <std::mutex> lock(connection -> write_mutex);
+            // A write that gave up may have left a torn frame, after which
+            // every response would be misaligned for the client. Shut the
+            // connection down instead, so the I/O thread sees it end and
+            // drops it, and write nothing more to it.
+            if (!connection -> broken && !WriteAll(connection -> fd, grouped.data(), run * sizeof(InferenceResponse))) {
+                connection -> broken = true;
+                shutdown(connection -> fd, SHUT_RDWR);
+            }
+        }
+        for (size_t i = 0; i < n; i++) taken[i].connection.reset();
+        served.fetch_add(n);
+        batches.fetch_add(1);
+    }
+}
+
+// Workers form a ParallelTeam, so with several of them the GEMMs in each
+// batch run inline on their worker. A single worker runs on this thread,
+// where a batch can still use every thread of either backend.
+template <typename T>
+void BasicInferenceServer<T>::Run() {
+    std::thread io(&BasicInferenceServer<T>::ServeConnections, this);
+    if (options.workers == 1) {
+        RunWorker();
+    } else {
+        ParallelTeam(options.workers, [&](int, int) { RunWorker(); });
+    }
+    io.join();
+    std::lock_guard <std::mutex> lock(mutex);
+    stopping = false;
+    stop_requested.store(false);
+}
+
+InferenceClient::InferenceClient(const std::string &socket_path) {
+    sockaddr_un address = SocketAddress(socket_path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd >= 0 && "socket failed.");
+    int ok = connect(fd, (const sockaddr *)&address, sizeof(address));
+    assert(ok == 0 && "Cannot connect to the inference server.");
+    ok = ReadAll(fd, &hello, sizeof(hello)) ? 0 : -1;
+    assert(ok == 0 && "The server closed the connection before its hello.");
+    (void)ok;
+}
+
+InferenceClient::~InferenceClient() {
+    close(fd);
+}
+
+const InferenceHello &InferenceClient::Hello() const {
+    return hello;
+}
+
+bool InferenceClient::Send(uint32_t id, const uint8_t *image) {
+    iovec parts[2] = { { &id, sizeof(id) }, { (void *)image, hello.input_size } };
+    size_t left = sizeof(id) + hello.input_size;
+    int first = 0;
+    while (left > 0) {
+        ssize_t sent = writev(fd, parts + first, 2 - first);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        left -= (size_t)sent;
+        // Skip whatever writev already covered.
+        while (first < 2 && (size_t)sent >= parts[first].iov_len) {
+            sent -= (ssize_t)parts[first].iov_len;
+            first++;
+        }
+        if (first < 2) {
+            parts[first].iov_base = (char *)parts[first].iov_base + sent;
+            parts[first].iov_len -= (size_t)sent;
+        }
+    }
+    return true;
+}
+
+bool InferenceClient::Receive(InferenceResponse &response) {
+    return ReadAll(fd, &response, sizeof(response));
+}
+
+int InferenceClient::Predict(const uint8_t *image) {
+    InferenceResponse response;
+    if (!Send(0, image) || !Receive(response)) return -1;
+    return response.label;
+}
+
+template class BasicInferenceServer<float>;
+template class BasicInferenceServer<double>;
+
+#endif
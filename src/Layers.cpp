@@ -0,0 +1,444 @@
+#include "Layers.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+// Widest Conv2D the direct kernel keeps in its accumulator array.
+const int MAX_DIRECT_CHANNELS = 64;
+// Up to this many output channels the direct kernel beats writing out the 9x
+// larger im2col patches and packing them for a GEMM too narrow to fill its
+// tiles (2-5x on MNIST-sized layers); from 64 on the GEMM's reuse wins, at
+// batch 1 as well as 64.
+const int AUTO_DIRECT_CHANNELS = 32;
+
+ConvAlgorithm requested_algorithm = ConvAlgorithm::Auto;
+
+bool DirectConvSupported(const LayerSpec &spec) {
+    return spec.kind == LayerKind::Conv2D && spec.kernel == 3 && spec.stride == 1 && spec.out_c <= MAX_DIRECT_CHANNELS;
+}
+
+// Output pixels the direct kernel computes together; every weight vector it
+// loads is used once per pixel.
+const int DIRECT_PIXELS = 4;
+
+// acc[p][0, K) = bias + the 3x3 patch around (y, x + p) times the weights,
+// for p < pixels. K is a compile-time constant for the common widths, so the
+// accumulators stay in registers. With checked false every tap of the block
+// must lie inside the image; with stride 1 the three taps of a kernel row
+// are then 3 * in_c consecutive inputs, which line up with the weight rows.
+template <typename T, int K, bool checked>
+inline void DirectBlock(const LayerSpec &spec, const T *in, int y, int x, int pixels, const T *weights, const T *bias,
+                        int k_count, T (*acc)[K > 0 ? K : MAX_DIRECT_CHANNELS]) {
+    const int C = spec.in_c;
+    const int k_width = K > 0 ? K : k_count;
+    for (int p = 0; p < pixels; p++) {
+        #pragma omp simd
+        for (int k = 0; k < k_width; k++) acc[p][k] = bias[k];
+    }
+    for (int ky = 0; ky < 3; ky++) {
+        int iy = y + ky - spec.padding;
+        if (iy < 0 || iy >= spec.in_h) continue;
+        const T *row = in + (size_t)iy * spec.in_w * C;
+        const T *w = weights + (size_t)ky * 3 * C * k_width;
+        if (!checked) {
+            const T *first = row + (size_t)(x - spec.padding) * C;
+            for (int j = 0; j < 3 * C; j++) {
+                const T *wj = w + (size_t)j * k_width;
+                for (int p = 0; p < DIRECT_PIXELS; p++) {
+                    const T v = first[p * C + j];
+                    #pragma omp simd
+                    for (int k = 0; k < k_width; k++) acc[p][k] += v * wj[k];
+                }
+            }
+            continue;
+        }
+        for (int p = 0; p < pixels; p++) {
+            for (int kx = 0; kx < 3; kx++) {
+                int ix = x + p + kx - spec.padding;
+                if (ix < 0 || ix >= spec.in_w) continue;
+                const T *pixel = row + (size_t)ix * C;
+                for (int c = 0; c < C; c++) {
+                    const T v = pixel[c];
+                    const T *wc = w + (size_t)(kx * C + c) * k_width;
+                    #pragma omp simd
+                    for (int k = 0; k < k_width; k++) acc[p][k] += v * wc[k];
+                }
+            }
+        }
+    }
+}
+
+template <typename T, int K>
+void DirectRows(const LayerSpec &spec, const T *input, const T *weights, const T *bias, bool relu, T *output,
+                size_t begin, size_t end) {
+    const int k_count = K > 0 ? K : spec.out_c;
+    alignas(64) T acc[DIRECT_PIXELS][K > 0 ? K : MAX_DIRECT_CHANNELS];
+    // Output columns [lo, hi) read no padding.
+    const int lo = std::min(spec.padding, spec.out_w);
+    const int hi = std::max(lo, std::min(spec.out_w, spec.in_w - 2 + spec.padding));
+    for (size_t row = begin; row < end; row++) {
+        size_t image = row / spec.out_h;
+        int y = (int)(row % spec.out_h);
+        const T *in = input + image * spec.InputSize();
+        T *out = output + image * spec.OutputSize() + (size_t)y * spec.out_w * k_count;
+        for (int x = 0; x < spec.out_w;) {
+            int pixels = 1;
+            if (x >= lo && x + DIRECT_PIXELS <= hi) {
+                pixels = DIRECT_PIXELS;
+                DirectBlock<T, K, false>(spec, in, y, x, pixels, weights, bias, k_count, acc);
+            } else {
+                pixels = x < lo ? 1 : std::min(DIRECT_PIXELS, spec.out_w - x);
+                DirectBlock<T, K, true>(spec, in, y, x, pixels, weights, bias, k_count, acc);
+            }
+            for (int p = 0; p < pixels; p++) {
+                T *dst = out + (size_t)(x + p) * k_count;
+                if (relu) {
+                    #pragma omp simd
+                    for (int k = 0; k < k_count; k++) dst[k] = std::max(acc[p][k], T(0));
+                } else {
+                    #pragma omp simd
+                    for (int k = 0; k < k_count; k++) dst[k] = acc[p][k];
+                }
+            }
+            x += pixels;
+        }
+    }
+}
+
+}
+
+int LayerSpec::InputSize() const {
+    return in_h * in_w * in_c;
+}
+
+int LayerSpec::OutputSize() const {
+    return out_h * out_w * out_c;
+}
+
+int LayerSpec::WeightRows() const {
+    switch (kind) {
+        case LayerKind::Conv2D: return kernel * kernel * in_c;
+        case LayerKind::MaxPool: return 0;
+        default: return InputSize();
+    }
+}
+
+int LayerSpec::WeightCols() const {
+    return kind == LayerKind::MaxPool ? 0 : out_c;
+}
+
+int LayerSpec::BiasSize() const {
+    return kind == LayerKind::MaxPool ? 0 : out_c;
+}
+
+bool LayerSpec::operator==(const LayerSpec &other) const {
+    return kind == other.kind && in_h == other.in_h && in_w == other.in_w && in_c == other.in_c &&
+           out_h == other.out_h && out_w == other.out_w && out_c == other.out_c &&
+           kernel == other.kernel && stride == other.stride && padding == other.padding;
+}
+
+bool LayerSpec::operator!=(const LayerSpec &other) const {
+    return !(*this == other);
+}
+
+NetworkTopology::NetworkTopology(int height, int width, int channels) : h(height), w(width), c(channels), flat(false) {
+    assert(height > 0 && width > 0 && channels > 0 && "The input shape must be positive.");
+}
+
+NetworkTopology &NetworkTopology::Conv2D(int filters, int kernel, int stride, int padding) {
+    assert(!flat && "Conv2D needs a feature map; it cannot follow Flatten or Dense.");
+    assert(filters > 0 && kernel > 0 && stride > 0 && "Conv2D sizes must be positive.");
+    LayerSpec spec;
+    spec.kind = LayerKind::Conv2D;
+    spec.in_h = h, spec.in_w = w, spec.in_c = c;
+    spec.kernel = kernel;
+    spec.stride = stride;
+    spec.padding = padding < 0 ? kernel / 2 : padding;
+    spec.out_h = (h + 2 * spec.padding - kernel) / stride + 1;
+    spec.out_w = (w + 2 * spec.padding - kernel) / stride + 1;
+    spec.out_c = filters;
+    assert(spec.out_h > 0 && spec.out_w > 0 && "Conv2D kernel is larger than its padded input.");
+    layers.push_back(spec);
+    h = spec.out_h, w = spec.out_w, c = spec.out_c;
+    return *this;
+}
+
+NetworkTopology &NetworkTopology::MaxPool(int size) {
+    assert(!flat && "MaxPool needs a feature map; it cannot follow Flatten or Dense.");
+    assert(size > 0 && size <= h && size <= w && "MaxPool window must fit the feature map.");
+    LayerSpec spec;
+    spec.kind = LayerKind::MaxPool;
+    spec.in_h = h, spec.in_w = w, spec.in_c = c;
+    spec.kernel = size;
+    spec.stride = size;
+    spec.out_h = h / size, spec.out_w = w / size, spec.out_c = c;
+    layers.push_back(spec);
+    h = spec.out_h, w = spec.out_w;
+    return *this;
+}
+
+NetworkTopology &NetworkTopology::Flatten() {
+    c = h * w * c;
+    h = w = 1;
+    flat = true;
+    return *this;
+}
+
+NetworkTopology &NetworkTopology::Dense(int size) {
+    assert((flat || (h == 1 && w == 1)) && "Flatten the feature maps before the first Dense layer.");
+    assert(size > 0 && "Dense layer sizes must be positive.");
+    LayerSpec spec;
+    spec.in_c = c;
+    spec.out_c = size;
+    layers.push_back(spec);
+    c = size;
+    flat = true;
+    return *this;
+}
+
+const std::vector <LayerSpec> &NetworkTopology::Layers() const {
+    return layers;
+}
+
+std::vector <LayerSpec> DenseLayers(const std::vector <int> &layer_sizes) {
+    std::vector <LayerSpec> layers;
+    for (size_t i = 0; i + 1 < layer_sizes.size(); i++) {
+        LayerSpec spec;
+        spec.in_c = layer_sizes[i];
+        spec.out_c = layer_sizes[i + 1];
+        layers.push_back(spec);
+    }
+    return layers;
+}
+
+std::vector <int> LayerSizes(const std::vector <LayerSpec> &layers) {
+    std::vector <int> sizes;
+    if (layers.empty()) return sizes;
+    sizes.push_back(layers.front().InputSize());
+    for (const LayerSpec &spec : layers) sizes.push_back(spec.OutputSize());
+    return sizes;
+}
+
+void SetConvAlgorithm(ConvAlgorithm algorithm) {
+    requested_algorithm = algorithm;
+}
+
+ConvAlgorithm GetConvAlgorithm() {
+    return requested_algorithm;
+}
+
+const char *ConvAlgorithmName(ConvAlgorithm algorithm) {
+    switch (algorithm) {
+        case ConvAlgorithm::Im2Col: return "im2col";
+        case ConvAlgorithm::Direct: return "direct";
+        default: return "auto";
+    }
+}
+
+bool UseDirectConv(const LayerSpec &spec) {
+    if (!DirectConvSupported(spec)) return false;
+    switch (requested_algorithm) {
+        case ConvAlgorithm::Im2Col: return false;
+        case ConvAlgorithm::Direct: return true;
+        default: return spec.out_c <= AUTO_DIRECT_CHANNELS;
+    }
+}
+
+template <typename T>
+void Im2Col(const LayerSpec &spec, const T *input, size_t n, T *columns) {
+    const int C = spec.in_c;
+    const size_t patch = (size_t)spec.kernel * spec.kernel * C;
+    ParallelFor(n * spec.out_h, n * spec.out_h * spec.out_w * patch, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            size_t image = row / spec.out_h;
+            int y = (int)(row % spec.out_h);
+            const T *in = input + image * spec.InputSize();
+            T *dst = columns + row * spec.out_w * patch;
+            for (int x = 0; x < spec.out_w; x++, dst += patch) {
+                for (int ky = 0; ky < spec.kernel; ky++) {
+                    int iy = y * spec.stride + ky - spec.padding;
+                    T *tap = dst + (size_t)ky * spec.kernel * C;
+                    if (iy < 0 || iy >= spec.in_h) {
+                        std::fill(tap, tap + (size_t)spec.kernel * C, T(0));
+                        continue;
+                    }
+                    int ix = x * spec.stride - spec.padding;
+                    const T *src = in + ((size_t)iy * spec.in_w + ix) * C;
+                    if (ix >= 0 && ix + spec.kernel <= spec.in_w) {
+                        // The whole kernel row is kernel * C consecutive inputs.
+                        for (int i = 0; i < spec.kernel * C; i++) tap[i] = src[i];
+                        continue;
+                    }
+                    for (int kx = 0; kx < spec.kernel; kx++, tap += C, src += C) {
+                        if (ix + kx < 0 || ix + kx >= spec.in_w) std::fill(tap, tap + C, T(0));
+                        else std::copy(src, src + C, tap);
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Images never share input pixels, so each thread owns whole images.
+template <typename T>
+void Col2Im(const LayerSpec &spec, const T *columns, size_t n, T *input_grad) {
+    const int C = spec.in_c;
+    const size_t patch = (size_t)spec.kernel * spec.kernel * C;
+    const size_t pixels = (size_t)spec.out_h * spec.out_w;
+    ParallelFor(n, n * pixels * patch, [&](size_t begin, size_t end) {
+        for (size_t image = begin; image < end; image++) {
+            T *grad = input_grad + image * spec.InputSize();
+            const T *src = columns + image * pixels * patch;
+            for (int y = 0; y < spec.out_h; y++) {
+                for (int x = 0; x < spec.out_w; x++, src += patch) {
+                    for (int ky = 0; ky < spec.kernel; ky++) {
+                        int iy = y * spec.stride + ky - spec.padding;
+                        if (iy < 0 || iy >= spec.in_h) continue;
+                        for (int kx = 0; kx < spec.kernel; kx++) {
+                            int ix = x * spec.stride + kx - spec.padding;
+                            if (ix < 0 || ix >= spec.in_w) continue;
+                            const T *tap = src + ((size_t)ky * spec.kernel + kx) * C;
+                            T *dst = grad + ((size_t)iy * spec.in_w + ix) * C;
+                            #pragma omp simd
+                            for (int c = 0; c < C; c++) dst[c] += tap[c];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+template <typename T>
+void Conv3x3Direct(const LayerSpec &spec, const T *input, size_t n, const T *weights, const T *bias, bool relu, T *output) {
+    assert(DirectConvSupported(spec) && "The direct kernel only runs 3x3 stride-1 layers of up to 64 channels.");
+    size_t rows = n * spec.out_h;
+    size_t work = rows * spec.out_w * 9 * spec.in_c * spec.out_c;
+    ParallelFor(rows, work, [&](size_t begin, size_t end) {
+        switch (spec.out_c) {
+            case 8: DirectRows<T, 8>(spec, input, weights, bias, relu, output, begin, end); break;
+            case 16: DirectRows<T, 16>(spec, input, weights, bias, relu, output, begin, end); break;
+            case 32: DirectRows<T, 32>(spec, input, weights, bias, relu, output, begin, end); break;
+            default: DirectRows<T, 0>(spec, input, weights, bias, relu, output, begin, end); break;
+        }
+    });
+}
+
+template <typename T>
+void MaxPoolForward(const LayerSpec &spec, const T *input, size_t n, T *output) {
+    const int C = spec.in_c;
+    ParallelFor(n * spec.out_h, (size_t)n * spec.InputSize(), [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            size_t image = row / spec.out_h;
+            int y = (int)(row % spec.out_h);
+            const T *in = input + image * spec.InputSize();
+            T *out = output + image * spec.OutputSize() + (size_t)y * spec.out_w * C;
+            for (int x = 0; x < spec.out_w; x++, out += C) {
+                const T *first = in + ((size_t)y * spec.kernel * spec.in_w + (size_t)x * spec.kernel) * C;
+                std::memcpy(out, first, C * sizeof(T));
+                for (int ky = 0; ky < spec.kernel; ky++) {
+                    for (int kx = 0; kx < spec.kernel; kx++) {
+                        const T *pixel = first + ((size_t)ky * spec.in_w + kx) * C;
+                        #pragma omp simd
+                        for (int c = 0; c < C; c++) out[c] = std::max(out[c], pixel[c]);
+                    }
+                }
+            }
+        }
+    });
+}
+
+// The pixels are split into a fixed number of blocks, whatever the thread
+// count, and the block sums added in order, so the result does not depend on
+// how many threads ran it. BIAS_CHANNELS channels are summed at a time, in
+// registers.
+template <typename T>
+void ConvBiasGradient(const LayerSpec &spec, const T *delta, size_t n, T *bias_grad) {
+    const int BIAS_BLOCKS = 32;
+    const int BIAS_CHANNELS = 16;
+    const int C = spec.out_c;
+    const size_t pixels = n * spec.out_h * spec.out_w;
+    const size_t blocks = std::min <size_t> (BIAS_BLOCKS, pixels);
+    T partial[BIAS_BLOCKS][BIAS_CHANNELS];
+    for (int c0 = 0; c0 < C; c0 += BIAS_CHANNELS) {
+        const int width = std::min(BIAS_CHANNELS, C - c0);
+        ParallelFor(blocks, pixels * width, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                T *sum = partial[b];
+                std::fill(sum, sum + BIAS_CHANNELS, T(0));
+                const T *row = delta + pixels * b / blocks * C + c0;
+                const T *last = delta + pixels * (b + 1) / blocks * C + c0;
+                for (; row < last; row += C) {
+                    #pragma omp simd
+                    for (int c = 0; c < width; c++) sum[c] += row[c];
+                }
+            }
+        });
+        for (int c = 0; c < width; c++) {
+            T total = T(0);
+            for (size_t b = 0; b < blocks; b++) total += partial[b][c];
+            bias_grad[c0 + c] = total;
+        }
+    }
+}
+
+// Channels are done POOL_CHANNELS at a time: the window's maximum is found
+// again, then the taps are walked in MaxPoolForward's order and each channel's
+// gradient goes to the first tap equal to it, so the loops stay vectorized.
+template <typename T>
+void MaxPoolBackward(const LayerSpec &spec, const T *input, const T *output_grad, size_t n, T *input_grad) {
+    const int C = spec.in_c;
+    const int POOL_CHANNELS = 16;
+    ParallelFor(n * spec.out_h, (size_t)n * spec.InputSize(), [&](size_t begin, size_t end) {
+        T best[POOL_CHANNELS], taken[POOL_CHANNELS];
+        for (size_t row = begin; row < end; row++) {
+            size_t image = row / spec.out_h;
+            int y = (int)(row % spec.out_h);
+            const T *in = input + image * spec.InputSize();
+            T *grad = input_grad + image * spec.InputSize();
+            const T *out_grad = output_grad + image * spec.OutputSize() + (size_t)y * spec.out_w * C;
+            for (int x = 0; x < spec.out_w; x++, out_grad += C) {
+                size_t first = ((size_t)y * spec.kernel * spec.in_w + (size_t)x * spec.kernel) * C;
+                for (int c0 = 0; c0 < C; c0 += POOL_CHANNELS) {
+                    const int width = std::min(POOL_CHANNELS, C - c0);
+                    std::copy(in + first + c0, in + first + c0 + width, best);
+                    for (int ky = 0; ky < spec.kernel; ky++) {
+                        for (int kx = 0; kx < spec.kernel; kx++) {
+                            const T *pixel = in + first + ((size_t)ky * spec.in_w + kx) * C + c0;
+                            #pragma omp simd
+                            for (int c = 0; c < width; c++) best[c] = std::max(best[c], pixel[c]);
+                        }
+                    }
+                    std::fill(taken, taken + width, T(0));
+                    for (int ky = 0; ky < spec.kernel; ky++) {
+                        for (int kx = 0; kx < spec.kernel; kx++) {
+                            size_t at = first + ((size_t)ky * spec.in_w + kx) * C + c0;
+                            #pragma omp simd
+                            for (int c = 0; c < width; c++) {
+                                bool hit = taken[c] == T(0) && in[at + c] == best[c];
+                                grad[at + c] += hit ? out_grad[c0 + c] : T(0);
+                                taken[c] = hit ? T(1) : taken[c];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+template void Im2Col<float>(const LayerSpec &, const float *, size_t, float *);
+template void Im2Col<double>(const LayerSpec &, const double *, size_t, double *);
+template void Col2Im<float>(const LayerSpec &, const float *, size_t, float *);
+template void Col2Im<double>(const LayerSpec &, const double *, size_t, double *);
+template void Conv3x3Direct<float>(const LayerSpec &, const float *, size_t, const float *, const float *, bool, float *);
+template void Conv3x3Direct<double>(const LayerSpec &, const double *, size_t, const double *, const double *, bool, double *);
+template void ConvBiasGradient<float>(const LayerSpec &, const float *, size_t, float *);
+template void ConvBiasGradient<double>(const LayerSpec &, const double *, size_t, double *);
+template void MaxPoolForward<float>(const LayerSpec &, const float *, size_t, float *);
+template void MaxPoolForward<double>(const LayerSpec &, const double *, size_t, double *);
+template void MaxPoolBackward<float>(const LayerSpec &, const float *, const float *, size_t, float *);
+template void MaxPoolBackward<double>(const LayerSpec &, const double *, const double *, size_t, double *);
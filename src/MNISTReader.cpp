@@ -8,50 +8,29 @@ int ReverseInt(int i) {
     return ((b0 << 24) + (b1 << 16) + (b2 << 8) + b3);
 }
 
+// Eager loaders kept for callers that want every image as its own Matrix;
+// new code should use IdxDataset directly and gather batches on demand.
 std::vector <Matrix> ReadImages(std::string path) {
-    std::ifstream file(path, std::ios::binary);
-    assert(file.is_open() && ("Failed to open file " + path).c_str());
+    IdxDataset dataset(path);
+    assert(dataset.Dims().size() == 3 && "Image IDX files must be 3-dimensional.");
+    int rows = dataset.Dims()[1];
+    int cols = dataset.Dims()[2];
     std::vector <Matrix> images;
-    int MagicNumber;
-    int NumberOfImages;
-    int Rows;
-    int Cols;
-    file.read((char*)&MagicNumber, sizeof(MagicNumber));
-    MagicNumber = ReverseInt(MagicNumber);
-    file.read((char*)&NumberOfImages, sizeof(NumberOfImages));
-    NumberOfImages = ReverseInt(NumberOfImages);
-    file.read((char*)&Rows, sizeof(Rows));
-    Rows = ReverseInt(Rows);
-    file.read((char*)&Cols, sizeof(Cols));
-    Cols = ReverseInt(Cols);
-    for (int i = 0; i < NumberOfImages; i++) {
-        Matrix img(Rows, Cols);
-        for (int r = 0; r < Rows; r++) {
-            for (int c = 0; c < Cols; c++) {
-                unsigned char tmp = 0;
-                file.read((char*)&tmp, sizeof(tmp));
-                img(r, c) = static_cast <double> (tmp) / 255.0;
-            }
-        }
+    images.reserve(dataset.Count());
+    for (size_t i = 0; i < dataset.Count(); i++) {
+        Matrix img(0, 0);
+        dataset.GatherRange(i, i + 1, img);
+        img.Resize(rows, cols);
         images.push_back(img);
     }
     return images;
 }
 
 std::vector <int> ReadLabels(std::string path) {
-    std::ifstream file(path, std::ios::binary);
-    assert(file.is_open() && ("Failed to open file " + path).c_str());
-    std::vector <int> labels;
-    int MagicNumber;
-    int NumberOfLabels;
-    file.read((char*)&MagicNumber, sizeof(MagicNumber));
-    MagicNumber = ReverseInt(MagicNumber);
-    file.read((char*)&NumberOfLabels, sizeof(NumberOfLabels));
-    NumberOfLabels = ReverseInt(NumberOfLabels);
-    for (int i = 0; i < NumberOfLabels; i++) {
-        unsigned char tmp = 0;
-        file.read((char*)&tmp, sizeof(tmp));
-        labels.push_back(static_cast <int> (tmp));
+    IdxDataset dataset(path);
+    std::vector <int> labels(dataset.Count());
+    for (size_t i = 0; i < dataset.Count(); i++) {
+        labels[i] = dataset.Label(i);
     }
     return labels;
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Opening and mapping fail at run time (a missing file, a bad path), so they
+// are reported in release builds too rather than asserted.
+static void CheckMapping(bool ok, const std::string &path, const char *what, int error) {
+    if (ok) return;
+    fprintf(stderr, "%s: Failed to %s file: %s\n", path.c_str(), what, std::strerror(error));
+    std::exit(1);
+}
+
+MappedFile::MappedFile(const std::string &path) {
+    mapping = nullptr;
+    mapping_size = 0;
+    file_handle = nullptr;
+    map_handle = nullptr;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CheckMapping(file != INVALID_HANDLE_VALUE, path, "open", ENOENT);
+    LARGE_INTEGER size;
+    CheckMapping(GetFileSizeEx(file, &size) != 0, path, "stat", EIO);
+    file_handle = file;
+    mapping_size = (size_t)size.QuadPart;
+    // An empty file cannot be mapped; it is left as an empty view.
+    if (mapping_size == 0) return;
+    HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CheckMapping(map != nullptr, path, "map", EIO);
+    mapping = (const uint8_t *)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    CheckMapping(mapping != nullptr, path, "map", EIO);
+    map_handle = map;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    CheckMapping(fd >= 0, path, "open", errno);
+    struct stat st;
+    int stat_result = fstat(fd, &st);
+    CheckMapping(stat_result == 0, path, "stat", errno);
+    mapping_size = (size_t)st.st_size;
+    // An empty file cannot be mapped; it is left as an empty view.
+    if (mapping_size == 0) {
+        close(fd);
+        return;
+    }
+    void *addr = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int map_error = errno;
+    close(fd);
+    CheckMapping(addr != MAP_FAILED, path, "map", map_error);
+    mapping = (const uint8_t *)addr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (map_handle) CloseHandle((HANDLE)map_handle);
+    if (file_handle) CloseHandle((HANDLE)file_handle);
+#else
+    if (mapping) munmap((void *)mapping, mapping_size);
+#endif
+}
+
+const uint8_t *MappedFile::Data() const {
+    return mapping;
+}
+
+size_t MappedFile::Size() const {
+    return mapping_size;
+}
@@ -1,13 +1,24 @@
 #include "Math.h"
+#include <cstring>
+#include <cstdint>
+#include <limits>
 
 double Sigmoid(double x) {
     return 1.0 / (1.0 + std::exp(-x));
 }
 
+float Sigmoid(float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
 double SigmoidDerivative(double y) {
     return y * (1.0 - y);
 }
 
+float SigmoidDerivative(float y) {
+    return y * (1.0f - y);
+}
+
 double Random() {
     return static_cast<double>(std::rand()) / RAND_MAX * 2.0 - 1.0;
 }
@@ -16,21 +27,239 @@ double ReLU(double x) {
     return x > 0.0 ? x : 0.0;
 }
 
+float ReLU(float x) {
+    return x > 0.0f ? x : 0.0f;
+}
+
 double ReLUDerivative(double x) {
     return x > 0.0 ? 1.0 : 0.0;
 }
 
-std::vector <double> Softmax(const std::vector <double> &u) {
-    double mx = *std::max_element(u.begin(), u.end());
-    std::vector <double> res;
-    double sum = 0.0;
-    for (const double &x : u) {
-        double val = std::exp(x - mx);
-        res.push_back(val);
-        sum += val;        
+float ReLUDerivative(float x) {
+    return x > 0.0f ? 1.0f : 0.0f;
+}
+
+// Vector kernels. Each one is a straight-line loop over the array with no
+// calls and no data-dependent branches, so `omp simd` turns it into packed
+// AVX2/AVX-512 code for whatever -march the build targets. Bit patterns are
+// moved between floating point and integer lanes with memcpy, which the
+// compiler lowers to plain register moves.
+
+template <typename To, typename From>
+static inline To BitCast(From value) {
+    To res;
+    std::memcpy(&res, &value, sizeof(res));
+    return res;
+}
+
+// Per-precision constants. exp: x = n ln2 + r with |r| <= ln2 / 2 via a
+// Cody-Waite split of ln2, then exp(r) from a polynomial and 2^n built in the
+// exponent field. log: x = 2^e m with m in [sqrt(1/2), sqrt(2)), then
+// log(m) = 2 atanh(s), s = (m - 1) / (m + 1), from its odd series in s.
+template <typename T> struct MathTraits;
+
+template <> struct MathTraits <double> {
+    typedef int64_t Int;
+    static constexpr int MANTISSA_BITS = 52;
+    static constexpr Int EXPONENT_BIAS = 1023;
+    static constexpr Int EXPONENT_MASK = 0x7ff;
+    static constexpr double EXP_MIN = -708.0;       // below this exp() returns 0
+    static constexpr double EXP_MAX = 709.0;        // above this exp() saturates at exp(709)
+    static constexpr double SHIFTER = 6755399441055744.0;   // 1.5 * 2^52
+    static constexpr double LN2_HI = 6.93145751953125e-1;
+    static constexpr double LN2_LO = 1.42860682030941723212e-6;
+
+    static inline double ExpPoly(double r) {
+        // Taylor series to r^13; the truncation error is below 1e-17 for |r| <= ln2 / 2.
+        double p = 1.0 / 6227020800.0;
+        p = p * r + 1.0 / 479001600.0;
+        p = p * r + 1.0 / 39916800.0;
+        p = p * r + 1.0 / 3628800.0;
+        p = p * r + 1.0 / 362880.0;
+        p = p * r + 1.0 / 40320.0;
+        p = p * r + 1.0 / 5040.0;
+        p = p * r + 1.0 / 720.0;
+        p = p * r + 1.0 / 120.0;
+        p = p * r + 1.0 / 24.0;
+        p = p * r + 1.0 / 6.0;
+        p = p * r + 0.5;
+        return (p * r) * r + r + 1.0;
+    }
+
+    static inline double AtanhPoly(double s2) {
+        // 1 + s2/3 + s2^2/5 + ... + s2^10/21; |s2| <= 0.0295.
+        double p = 1.0 / 21.0;
+        p = p * s2 + 1.0 / 19.0;
+        p = p * s2 + 1.0 / 17.0;
+        p = p * s2 + 1.0 / 15.0;
+        p = p * s2 + 1.0 / 13.0;
+        p = p * s2 + 1.0 / 11.0;
+        p = p * s2 + 1.0 / 9.0;
+        p = p * s2 + 1.0 / 7.0;
+        p = p * s2 + 1.0 / 5.0;
+        p = p * s2 + 1.0 / 3.0;
+        return p * s2;
+    }
+};
+
+template <> struct MathTraits <float> {
+    typedef int32_t Int;
+    static constexpr int MANTISSA_BITS = 23;
+    static constexpr Int EXPONENT_BIAS = 127;
+    static constexpr Int EXPONENT_MASK = 0xff;
+    static constexpr float EXP_MIN = -87.0f;
+    static constexpr float EXP_MAX = 88.0f;
+    static constexpr float SHIFTER = 12582912.0f;           // 1.5 * 2^23
+    static constexpr float LN2_HI = 0.693359375f;
+    static constexpr float LN2_LO = -2.12194440e-4f;
+
+    static inline float ExpPoly(float r) {
+        // Cephes expf minimax polynomial.
+        float p = 1.9875691500e-4f;
+        p = p * r + 1.3981999507e-3f;
+        p = p * r + 8.3334519073e-3f;
+        p = p * r + 4.1665795894e-2f;
+        p = p * r + 1.6666665459e-1f;
+        p = p * r + 5.0000001201e-1f;
+        return (p * r) * r + r + 1.0f;
+    }
+
+    static inline float AtanhPoly(float s2) {
+        float p = 1.0f / 9.0f;
+        p = p * s2 + 1.0f / 7.0f;
+        p = p * s2 + 1.0f / 5.0f;
+        p = p * s2 + 1.0f / 3.0f;
+        return p * s2;
+    }
+};
+
+template <typename T>
+static inline T ExpKernel(T x) {
+    typedef MathTraits <T> M;
+    typedef typename M::Int Int;
+    T clamped = std::min(std::max(x, M::EXP_MIN), M::EXP_MAX);
+    // Adding 1.5 * 2^mantissa rounds x / ln2 to an integer that lands in the
+    // low bits of the sum.
+    T shifted = clamped * T(1.4426950408889634) + M::SHIFTER;
+    T n = shifted - M::SHIFTER;
+    Int ni = BitCast <Int> (shifted) - BitCast <Int> (M::SHIFTER);
+    T r = clamped - n * M::LN2_HI;
+    r = r - n * M::LN2_LO;
+    T scale = BitCast <T> ((Int)((ni + M::EXPONENT_BIAS) << M::MANTISSA_BITS));
+    T res = M::ExpPoly(r) * scale;
+    return x < M::EXP_MIN ? T(0) : res;
+}
+
+template <typename T>
+static inline T LogKernel(T x) {
+    typedef MathTraits <T> M;
+    typedef typename M::Int Int;
+    const Int one_bits = BitCast <Int> (T(1));
+    const Int mantissa_mask = ((Int)1 << M::MANTISSA_BITS) - 1;
+    // Work on a positive normal stand-in and add the special value at the end;
+    // selecting between two full results makes GCC branch instead of blend.
+    T safe = std::max(x, std::numeric_limits <T>::min());
+    Int bits = BitCast <Int> (safe);
+    Int e = ((bits >> M::MANTISSA_BITS) & M::EXPONENT_MASK) - M::EXPONENT_BIAS;
+    T m = BitCast <T> ((Int)((bits & mantissa_mask) | one_bits));
+    bool big = m > T(1.4142135623730951);
+    m = big ? m * T(0.5) : m;
+    e = big ? e + 1 : e;
+    T s = (m - T(1)) / (m + T(1));
+    T s2 = s * s;
+    T fe = (T)e;
+    T log_m = T(2) * s + T(2) * s * M::AtanhPoly(s2);
+    T res = fe * M::LN2_HI + (log_m + fe * M::LN2_LO);
+    T special = x == T(0) ? -std::numeric_limits <T>::infinity() : std::numeric_limits <T>::quiet_NaN();
+    return res + (x > T(0) ? T(0) : special);
+}
+
+template <typename T>
+static void ExpArray(T *values, size_t n) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        values[i] = ExpKernel(values[i]);
     }
-    for (double &val : res) {
-        val /= sum;
+}
+
+template <typename T>
+static void LogArray(T *values, size_t n) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        values[i] = LogKernel(values[i]);
     }
+}
+
+template <typename T>
+static void SigmoidArray(T *values, size_t n) {
+    #pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        values[i] = T(1) / (T(1) + ExpKernel(-values[i]));
+    }
+}
+
+void ExpInPlace(double *values, size_t n) { ExpArray(values, n); }
+void ExpInPlace(float *values, size_t n) { ExpArray(values, n); }
+void LogInPlace(double *values, size_t n) { LogArray(values, n); }
+void LogInPlace(float *values, size_t n) { LogArray(values, n); }
+void SigmoidInPlace(double *values, size_t n) { SigmoidArray(values, n); }
+void SigmoidInPlace(float *values, size_t n) { SigmoidArray(values, n); }
+
+std::vector <double> Softmax(const std::vector <double> &u) {
+    std::vector <double> res = u;
+    SoftmaxInPlace(res.data(), res.size());
     return res;
-}
\ No newline at end of file
+}
+
+template <typename T>
+static void SoftmaxRow(T *values, size_t n) {
+    T mx = *std::max_element(values, values + n);
+    T sum = 0;
+    #pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < n; i++) {
+        values[i] = ExpKernel(values[i] - mx);
+        sum += values[i];
+    }
+    T inv = T(1) / sum;
+    #pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        values[i] *= inv;
+    }
+}
+
+void SoftmaxInPlace(double *values, size_t n) {
+    SoftmaxRow(values, n);
+}
+
+void SoftmaxInPlace(float *values, size_t n) {
+    SoftmaxRow(values, n);
+}
+
+// loss = logsumexp(z) - z[label], accumulated in the log domain so it stays
+// finite when softmax(z)[label] underflows to 0.
+template <typename T>
+static T SoftmaxCrossEntropyRow(T *logits, size_t n, int label) {
+    T mx = *std::max_element(logits, logits + n);
+    T label_logit = logits[label];
+    T sum = 0;
+    #pragma omp simd reduction(+:sum)
+    for (size_t i = 0; i < n; i++) {
+        logits[i] = ExpKernel(logits[i] - mx);
+        sum += logits[i];
+    }
+    T inv = T(1) / sum;
+    #pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        logits[i] *= inv;
+    }
+    logits[label] -= T(1);
+    return mx + LogKernel(sum) - label_logit;
+}
+
+double SoftmaxCrossEntropyInPlace(double *logits, size_t n, int label) {
+    return SoftmaxCrossEntropyRow(logits, n, label);
+}
+
+float SoftmaxCrossEntropyInPlace(float *logits, size_t n, int label) {
+    return SoftmaxCrossEntropyRow(logits, n, label);
+}
@@ -1,188 +1,376 @@
 #include "Matrix.h"
+#include "Gemm.h"
+#include "Parallel.h"
 #include <cassert>
-#include <omp.h>
 
-Matrix::Matrix(int rows, int cols, bool rand) {
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int rows, int cols, bool rand) {
     this -> rows = rows;
     this -> cols = cols;
+    // resize() value-initializes, so the matrix starts zeroed.
     data.resize(rows * cols);
     if (rand) {
         for (int i = 0; i < rows; i++) {
             for (int j = 0; j < cols; j++) {
-                (*this)(i, j) = -0.1 + static_cast <double> (std::rand()) / RAND_MAX * 0.2;
-            }
-        }
-    } else {
-        #pragma omp parallel for collapse(2) schedule(static)
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < cols; j++) {
-                (*this)(i, j) = 0.0;
+                (*this)(i, j) = static_cast <T> (-0.1 + static_cast <double> (std::rand()) / RAND_MAX * 0.2);
             }
         }
     }
 }
 
-Matrix::Matrix(int rows, int cols, const std::vector <double> &values) {
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int rows, int cols, const std::vector <T> &values) {
     this -> rows = rows;
     this -> cols = cols;
     data = values;
 }
 
-double &Matrix::operator()(int row, int col) {
+template <typename T>
+T &BasicMatrix<T>::operator()(int row, int col) {
     return this -> data[row * cols + col];
 }
 
-const double &Matrix::operator()(int row, int col) const {
+template <typename T>
+const T &BasicMatrix<T>::operator()(int row, int col) const {
     return this -> data[row * cols + col];
 }
 
-Matrix Matrix::operator=(const Matrix &other) {
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::operator=(const BasicMatrix &other) {
     this -> rows = other.rows;
     this -> cols = other.cols;
     this -> data = other.data;
     return *this;
 }
 
-Matrix Matrix::Flatten(int axis) const {
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::Flatten(int axis) const {
     if (axis == 0) {
-        Matrix res = *this;
+        BasicMatrix res = *this;
         res.rows = 1;
         res.cols = rows * cols;
         return res;
     } else {
-        Matrix res = *this;
+        BasicMatrix res = *this;
         res.rows = rows * cols;
         res.cols = 1;
         return res;
     }
 }
 
-Matrix Matrix::operator+(const Matrix &other) const {
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::operator+(const BasicMatrix &other) const {
     assert(rows == other.rows && cols == other.cols && "Matrix dimensions must match for addition.");
-    Matrix res(rows, cols);
-    #pragma omp parallel for collapse(2) schedule(static)
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            res(i, j) = (*this)(i, j) + other(i, j);
-        }
-    }
+    BasicMatrix res(rows, cols);
+    const T *lhs = data.data();
+    const T *rhs = other.data.data();
+    T *dst = res.data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) dst[i] = lhs[i] + rhs[i];
+    });
     return res;
 }
 
-Matrix Matrix::operator*(const Matrix &other) const {
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::operator*(const BasicMatrix &other) const {
     assert(cols == other.rows && "Matrix dimensions are not compatible for multiplication.");
-    Matrix res(rows, other.cols);
-    #pragma omp parallel for collapse(2) schedule(static)
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < other.cols; j++) {
-            double sum = 0.0;
-            #pragma omp simd
-            for (int k = 0; k < cols; k++) {
-                sum += (*this)(i, k) * other(k, j);
-            }
-            res(i, j) = sum;
-        }
-    }
+    BasicMatrix res(rows, other.cols);
+    Gemm(rows, other.cols, cols, data.data(), cols, other.data.data(), other.cols, res.data.data(), res.cols);
     return res;
 }
 
-Matrix Matrix::operator-(const Matrix &other) const {
+// Same as operator* but writes into res, reusing its storage when it is large enough.
+template <typename T>
+void BasicMatrix<T>::MultiplyInto(const BasicMatrix &other, BasicMatrix &res) const {
+    assert(cols == other.rows && "Matrix dimensions are not compatible for multiplication.");
+    assert(&res != this && &res != &other && "MultiplyInto cannot write into one of its operands.");
+    res.Resize(rows, other.cols);
+    Gemm(rows, other.cols, cols, data.data(), cols, other.data.data(), other.cols, res.data.data(), res.cols);
+}
+
+// res = activation(this * weights + bias) for a 1 x weights.cols bias row. The
+// bias add and activation run in the GEMM epilogue, so res is written once.
+template <typename T>
+void BasicMatrix<T>::LinearInto(const BasicMatrix &weights, const BasicMatrix &bias, GemmActivation activation, BasicMatrix &res) const {
+    assert(cols == weights.rows && "Matrix dimensions are not compatible for multiplication.");
+    assert(bias.rows == 1 && bias.cols == weights.cols && "Bias must be 1 x weights.cols.");
+    assert(&res != &weights && "LinearInto cannot write into one of its operands.");
+    LinearInto(weights.data.data(), bias.data.data(), (int)weights.cols, activation, res);
+}
+
+// Same with the parameters given as raw row-major storage (cols x out_cols
+// weights, out_cols biases), e.g. straight from a memory-mapped model file.
+template <typename T>
+void BasicMatrix<T>::LinearInto(const T *weights, const T *bias, int out_cols, GemmActivation activation, BasicMatrix &res) const {
+    assert(&res != this && "LinearInto cannot write into one of its operands.");
+    res.Resize(rows, out_cols);
+    GemmEpilogue<T> epilogue;
+    epilogue.bias = bias;
+    epilogue.activation = activation;
+    Gemm(rows, out_cols, cols, data.data(), cols, weights, out_cols, res.data.data(), res.cols, epilogue);
+}
+
+// res = this^T * other, reading this in place; e.g. the weight gradient
+// activation^T * delta.
+template <typename T>
+void BasicMatrix<T>::TransposeMultiplyInto(const BasicMatrix &other, BasicMatrix &res) const {
+    assert(rows == other.rows && "Matrix dimensions are not compatible for multiplication.");
+    assert(&res != this && &res != &other && "TransposeMultiplyInto cannot write into one of its operands.");
+    res.Resize(cols, other.cols);
+    Gemm(GemmTranspose::A, cols, other.cols, rows, data.data(), cols, other.data.data(), other.cols, res.data.data(), res.cols);
+}
+
+// res = this * other^T, reading other in place.
+template <typename T>
+void BasicMatrix<T>::MultiplyTransposedInto(const BasicMatrix &other, BasicMatrix &res) const {
+    assert(cols == other.cols && "Matrix dimensions are not compatible for multiplication.");
+    assert(&res != this && &res != &other && "MultiplyTransposedInto cannot write into one of its operands.");
+    res.Resize(rows, other.rows);
+    Gemm(GemmTranspose::B, rows, other.rows, cols, data.data(), cols, other.data.data(), other.cols, res.data.data(), res.cols);
+}
+
+// res = this * other, zeroed wherever mask <= 0. With mask holding ReLU
+// outputs this is the backward step (delta * W^T) .* ReLU'(a) in one pass.
+template <typename T>
+void BasicMatrix<T>::MultiplyMaskedInto(const BasicMatrix &other, const BasicMatrix &mask, BasicMatrix &res) const {
+    assert(cols == other.rows && "Matrix dimensions are not compatible for multiplication.");
+    assert(mask.rows == rows && mask.cols == other.cols && "Mask must have the shape of the product.");
+    assert(&res != this && &res != &other && &res != &mask && "MultiplyMaskedInto cannot write into one of its operands.");
+    res.Resize(rows, other.cols);
+    GemmEpilogue<T> epilogue;
+    epilogue.mask = mask.data.data();
+    epilogue.ldmask = mask.cols;
+    Gemm(rows, other.cols, cols, data.data(), cols, other.data.data(), other.cols, res.data.data(), res.cols, epilogue);
+}
+
+// res = this * other^T, zeroed wherever mask <= 0: the backward step
+// (delta * W^T) .* ReLU'(a) without materializing W^T.
+template <typename T>
+void BasicMatrix<T>::MultiplyTransposedMaskedInto(const BasicMatrix &other, const BasicMatrix &mask, BasicMatrix &res) const {
+    assert(cols == other.cols && "Matrix dimensions are not compatible for multiplication.");
+    assert(mask.rows == rows && mask.cols == other.rows && "Mask must have the shape of the product.");
+    assert(&res != this && &res != &other && &res != &mask && "MultiplyTransposedMaskedInto cannot write into one of its operands.");
+    res.Resize(rows, other.rows);
+    GemmEpilogue<T> epilogue;
+    epilogue.mask = mask.data.data();
+    epilogue.ldmask = mask.cols;
+    Gemm(GemmTranspose::B, rows, other.rows, cols, data.data(), cols, other.data.data(), other.cols, res.data.data(), res.cols,
+         epilogue);
+}
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::operator-(const BasicMatrix &other) const {
     assert(rows == other.rows && cols == other.cols && "Matrix dimensions must match for subtraction.");
-    Matrix res(rows, cols);
-    #pragma omp parallel for collapse(2) schedule(static)
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            res(i, j) = (*this)(i, j) - other(i, j);
-        }
-    }
+    BasicMatrix res(rows, cols);
+    const T *lhs = data.data();
+    const T *rhs = other.data.data();
+    T *dst = res.data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) dst[i] = lhs[i] - rhs[i];
+    });
     return res;
 }
 
-void Matrix::AddInPlace(const Matrix &other) {
+template <typename T>
+void BasicMatrix<T>::AddInPlace(const BasicMatrix &other) {
     assert(rows == other.rows && cols == other.cols && "Matrix dimensions must match for addition.");
-    #pragma omp parallel for collapse(2) schedule(static)
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            (*this)(i, j) += other(i, j);
-        }
-    }
+    T *dst = data.data();
+    const T *src = other.data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) dst[i] += src[i];
+    });
 }
 
-void Matrix::Fill(double value) {
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < static_cast<int>(data.size()); i++) {
-        data[i] = value;
-    }
+// this += scale * other, e.g. a gradient step W -= lr * dW without temporaries.
+template <typename T>
+void BasicMatrix<T>::AddScaledInPlace(const BasicMatrix &other, T scale) {
+    assert(rows == other.rows && cols == other.cols && "Matrix dimensions must match for addition.");
+    T *dst = data.data();
+    const T *src = other.data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) dst[i] += scale * src[i];
+    });
 }
 
-Matrix Matrix::HadamardMul(const Matrix &other) const {
-    assert(rows == other.rows && cols == other.cols && "Matrix dimensions must match for Hadamard multiplication.");
-    Matrix res(rows, cols);
-    #pragma omp parallel for collapse(2) schedule(static)
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            res(i, j) = (*this)(i, j) * other(i, j);
+// Adds a 1 x cols row (e.g. a bias) to every row of the matrix.
+template <typename T>
+void BasicMatrix<T>::AddRowInPlace(const BasicMatrix &row) {
+    assert(row.rows == 1 && row.cols == cols && "Row must be 1 x cols for broadcast addition.");
+    const T *bias = row.data.data();
+    ParallelFor(rows, rows * cols, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            T *dst = data.data() + i * cols;
+            #pragma omp simd
+            for (size_t j = 0; j < cols; j++) dst[j] += bias[j];
         }
-    }
-    return res;
+    });
 }
 
-Matrix Matrix::ScalarMul(double scalar) const {
-    Matrix res(rows, cols);
-    #pragma omp parallel for collapse(2) schedule(static)
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::ColumnSum() const {
+    BasicMatrix res(1, cols);
     for (int i = 0; i < rows; i++) {
+        #pragma omp simd
         for (int j = 0; j < cols; j++) {
-            res(i, j) = (*this)(i, j) * scalar;
+            res(0, j) += (*this)(i, j);
         }
     }
     return res;
 }
 
-Matrix Matrix::Transpose() const {
-    Matrix res(cols, rows);
-    #pragma omp parallel for collapse(2) schedule(static)
+template <typename T>
+void BasicMatrix<T>::ColumnSumInto(BasicMatrix &res) const {
+    res.Resize(1, cols);
+    std::fill(res.data.begin(), res.data.end(), T(0));
     for (int i = 0; i < rows; i++) {
+        #pragma omp simd
         for (int j = 0; j < cols; j++) {
-            res(j, i) = (*this)(i, j);
+            res(0, j) += (*this)(i, j);
         }
     }
+}
+
+template <typename T>
+void BasicMatrix<T>::SetRow(int row, const BasicMatrix &values) {
+    assert(values.rows * values.cols == cols && "Row values must have cols elements.");
+    std::copy(values.data.begin(), values.data.end(), data.begin() + row * cols);
+}
+
+// Changes the shape without releasing capacity; the contents are left unspecified.
+template <typename T>
+void BasicMatrix<T>::Resize(int rows, int cols) {
+    this -> rows = rows;
+    this -> cols = cols;
+    data.resize(rows * cols);
+}
+
+// Grows capacity to rows x cols without changing the shape, so later
+// Resize calls up to that size do not allocate.
+template <typename T>
+void BasicMatrix<T>::Reserve(int rows, int cols) {
+    data.reserve(rows * cols);
+}
+
+template <typename T>
+int BasicMatrix<T>::RowArgMax(int row) const {
+    const T *values = data.data() + row * cols;
+    return (int)(std::max_element(values, values + cols) - values);
+}
+
+template <typename T>
+void BasicMatrix<T>::Fill(T value) {
+    T *dst = data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        std::fill(dst + begin, dst + end, value);
+    });
+}
+
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::HadamardMul(const BasicMatrix &other) const {
+    assert(rows == other.rows && cols == other.cols && "Matrix dimensions must match for Hadamard multiplication.");
+    BasicMatrix res(rows, cols);
+    const T *lhs = data.data();
+    const T *rhs = other.data.data();
+    T *dst = res.data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) dst[i] = lhs[i] * rhs[i];
+    });
     return res;
 }
 
-void Matrix::ApplySigmoid() {
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < static_cast<int>(data.size()); i++) {
-        data[i] = Sigmoid(data[i]);
-    }
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::ScalarMul(T scalar) const {
+    BasicMatrix res(rows, cols);
+    const T *src = data.data();
+    T *dst = res.data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) dst[i] = src[i] * scalar;
+    });
+    return res;
 }
 
-void Matrix::ApplySigmoidDerivative() {
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < static_cast<int>(data.size()); i++) {
-        data[i] = SigmoidDerivative(data[i]);
-    }
+template <typename T>
+BasicMatrix<T> BasicMatrix<T>::Transpose() const {
+    BasicMatrix res(cols, rows);
+    TransposeInto(res);
+    return res;
+}
+
+template <typename T>
+void BasicMatrix<T>::TransposeInto(BasicMatrix &res) const {
+    assert(&res != this && "TransposeInto cannot write into its operand.");
+    res.Resize(cols, rows);
+    TransposeCopy(rows, cols, data.data(), cols, res.data.data(), rows);
+}
+
+template <typename T>
+void BasicMatrix<T>::ApplySigmoid() {
+    SigmoidInPlace(data.data(), data.size());
+}
+
+template <typename T>
+void BasicMatrix<T>::ApplySigmoidDerivative() {
+    T *values = data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) values[i] = values[i] * (T(1) - values[i]);
+    });
+}
+
+template <typename T>
+void BasicMatrix<T>::ApplyReLU() {
+    T *values = data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) values[i] = values[i] > T(0) ? values[i] : T(0);
+    });
 }
 
-void Matrix::ApplyReLU() {
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < static_cast<int>(data.size()); i++) {
-        data[i] = ReLU(data[i]);
+template <typename T>
+void BasicMatrix<T>::ApplyReLUDerivative() {
+    T *values = data.data();
+    ParallelFor(data.size(), data.size(), [&](size_t begin, size_t end) {
+        #pragma omp simd
+        for (size_t i = begin; i < end; i++) values[i] = values[i] > T(0) ? T(1) : T(0);
+    });
+}
+
+// Softmax is taken over each row independently, so a batch of N outputs
+// stacked as an N x classes matrix is normalized sample by sample.
+template <typename T>
+void BasicMatrix<T>::ApplySoftmax() {
+    for (int i = 0; i < rows; i++) {
+        SoftmaxInPlace(data.data() + i * cols, cols);
     }
 }
 
-void Matrix::ApplyReLUDerivative() {
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < static_cast<int>(data.size()); i++) {
-        data[i] = ReLUDerivative(data[i]);
+// Treats each row as logits for labels[row]: replaces it with the
+// cross-entropy gradient softmax(row) - onehot(label) and returns the summed
+// loss, computed as log-sum-exp so confident mistakes stay finite.
+template <typename T>
+T BasicMatrix<T>::ApplySoftmaxCrossEntropy(const std::vector <int> &labels) {
+    assert(labels.size() == rows && "Need one label per row.");
+    T loss = 0;
+    for (int i = 0; i < rows; i++) {
+        loss += SoftmaxCrossEntropyInPlace(data.data() + i * cols, cols, labels[i]);
     }
+    return loss;
 }
 
-void Matrix::ApplySoftmax() {
-    std::vector <double> vec = Softmax(data);
-    data = vec;
+template <typename T>
+template <typename U>
+BasicMatrix<U> BasicMatrix<T>::Cast() const {
+    return BasicMatrix<U>((int)rows, (int)cols, std::vector <U> (data.begin(), data.end()));
 }
 
-void Matrix::Print() {
+template <typename T>
+void BasicMatrix<T>::Print() {
     for (int i = 0; i < rows; i++) {
         for (int j = 0; j < cols; j++) {
             std::cout << (*this)(i, j) << " ";
@@ -191,10 +379,29 @@ void Matrix::Print() {
     }
 }
 
-size_t Matrix::GetRows() const {
+template <typename T>
+size_t BasicMatrix<T>::GetRows() const {
     return rows;
 }
 
-size_t Matrix::GetCols() const {
+template <typename T>
+size_t BasicMatrix<T>::GetCols() const {
     return cols;
-}
\ No newline at end of file
+}
+
+template <typename T>
+T *BasicMatrix<T>::Data() {
+    return data.data();
+}
+
+template <typename T>
+const T *BasicMatrix<T>::Data() const {
+    return data.data();
+}
+
+template class BasicMatrix<float>;
+template class BasicMatrix<double>;
+template BasicMatrix<float> BasicMatrix<double>::Cast<float>() const;
+template BasicMatrix<double> BasicMatrix<float>::Cast<double>() const;
+template BasicMatrix<float> BasicMatrix<float>::Cast<float>() const;
+template BasicMatrix<double> BasicMatrix<double>::Cast<double>() const;
\ No newline at end of file
@@ -1,197 +1,891 @@
 #include "NeuralNetwork.h"
+#include "Telemetry.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <omp.h>
 
-NeuralNetwork::NeuralNetwork(const std::vector <int> &layer_sizes) {
-    this -> layer_sizes = layer_sizes;
-    for (size_t i = 0; i < (int)layer_sizes.size() - 1; i++) {
-        int from = layer_sizes[i];
-        int to = layer_sizes[i + 1];
-        Matrix w(from, to, true);
-        Matrix b(1, to, true);
-        weights.push_back(w);
-        biases.push_back(b);
+template <typename T>
+BasicNeuralNetwork<T>::BasicNeuralNetwork(const std::vector <int> &layer_sizes)
+    : layers(DenseLayers(layer_sizes)), layer_sizes(layer_sizes) {
+    InitParameters();
+}
+
+template <typename T>
+BasicNeuralNetwork<T>::BasicNeuralNetwork(std::initializer_list <int> layer_sizes)
+    : BasicNeuralNetwork(std::vector <int> (layer_sizes)) {}
+
+template <typename T>
+BasicNeuralNetwork<T>::BasicNeuralNetwork(const NetworkTopology &topology)
+    : layers(topology.Layers()), layer_sizes(LayerSizes(topology.Layers())) {
+    assert(!layers.empty() && "A network needs at least one layer.");
+    InitParameters();
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::InitParameters() {
+    for (const LayerSpec &spec : layers) {
+        weights.emplace_back(spec.WeightRows(), spec.WeightCols(), true);
+        biases.emplace_back(1, spec.BiasSize(), true);
     }
 }
 
-Matrix NeuralNetwork::FeedForward(const Matrix &input) {
-    Matrix res = input;
-    layer_outputs.clear();
-    layer_outputs.push_back(res);
-    for (int i = 0; i < weights.size(); i++) {
-        res = (res * weights[i]) + biases[i];
-        if (i != (int)weights.size() - 1) res.ApplyReLU();
-        else res.ApplySoftmax();
-        layer_outputs.push_back(res);   
+// A mapped model has no matrices of its own; its parameters live in the file.
+template <typename T>
+const T *BasicNeuralNetwork<T>::LayerWeights(size_t layer) const {
+    return mapped_file ? mapped_weights[layer] : weights[layer].Data();
+}
+
+template <typename T>
+const T *BasicNeuralNetwork<T>::LayerBias(size_t layer) const {
+    return mapped_file ? mapped_biases[layer] : biases[layer].Data();
+}
+
+template <typename T>
+bool BasicNeuralNetwork<T>::IsMapped() const {
+    return mapped_file != nullptr;
+}
+
+template <typename T>
+BasicMatrix<T> BasicNeuralNetwork<T>::FeedForward(const BasicMatrix<T> &input) {
+    return ForwardPass(input, layer_outputs, layer_columns, false);
+}
+
+// A Conv2D over n images is one GEMM of the im2col patches,
+// (n * out_h * out_w) x (kernel^2 * in_c), by its weights, with the same
+// bias + ReLU epilogue as a dense layer. Its NHWC output is exactly the next
+// activation, so no reshape follows.
+template <typename T>
+void BasicNeuralNetwork<T>::LayerForward(size_t layer, const BasicMatrix<T> &in, BasicMatrix<T> &out, BasicMatrix<T> &columns,
+                                         bool for_training) const {
+    const LayerSpec &spec = layers[layer];
+    GemmActivation activation = layer + 1 == layers.size() ? GemmActivation::None : GemmActivation::ReLU;
+    size_t n = in.GetRows();
+    if (spec.kind == LayerKind::Dense) {
+        in.LinearInto(LayerWeights(layer), LayerBias(layer), spec.out_c, activation, out);
+        return;
+    }
+    out.Resize((int)n, spec.OutputSize());
+    if (spec.kind == LayerKind::MaxPool) {
+        MaxPoolForward(spec, in.Data(), n, out.Data());
+        return;
     }
-    return res;
+    if (!for_training && UseDirectConv(spec)) {
+        Conv3x3Direct(spec, in.Data(), n, LayerWeights(layer), LayerBias(layer), activation == GemmActivation::ReLU, out.Data());
+        return;
+    }
+    size_t pixels = n * spec.out_h * spec.out_w;
+    size_t patch = spec.WeightRows();
+    columns.Resize((int)pixels, (int)patch);
+    Im2Col(spec, in.Data(), n, columns.Data());
+    GemmEpilogue<T> epilogue;
+    epilogue.bias = LayerBias(layer);
+    epilogue.activation = activation;
+    Gemm(pixels, spec.out_c, patch, columns.Data(), patch, LayerWeights(layer), spec.out_c, out.Data(), spec.out_c, epilogue);
 }
 
-Matrix NeuralNetwork::FeedForwardWithCache(const Matrix &input, std::vector <Matrix> &cache) const {
-    Matrix res = input;
-    cache.clear();
-    cache.push_back(res);
-    for (int i = 0; i < weights.size(); i++) {
-        res = (res * weights[i]) + biases[i];
-        if (i != (int)weights.size() - 1) res.ApplyReLU();
-        else res.ApplySoftmax();
-        cache.push_back(res);
+// activations[i] receives the output of layer i; the last one holds the
+// softmax probabilities, or the raw logits when softmax is false. columns[i]
+// holds layer i's im2col patches if it is a Conv2D. Storage is reused when it
+// is already large enough.
+template <typename T>
+const BasicMatrix<T> &BasicNeuralNetwork<T>::ForwardPass(const BasicMatrix<T> &input, std::vector <BasicMatrix<T>> &activations,
+                                                         std::vector <BasicMatrix<T>> &columns, bool for_training, bool softmax) const {
+    assert((int)input.GetCols() == layer_sizes.front() && "Input width must match the first layer.");
+    TELEMETRY_SCOPE(telemetry::Phase::Forward);
+    int count = (int)layers.size();
+    activations.resize(count, BasicMatrix<T>(0, 0));
+    columns.resize(count, BasicMatrix<T>(0, 0));
+    const BasicMatrix<T> *res = &input;
+    for (int i = 0; i < count; i++) {
+        TELEMETRY_LAYER_SCOPE(telemetry::Phase::Forward, i);
+        LayerForward(i, *res, activations[i], columns[i], for_training);
+        res = &activations[i];
     }
-    return res;
+    if (softmax) activations.back().ApplySoftmax();
+    return activations.back();
 }
 
-Matrix NeuralNetwork::FeedForward(const std::vector <double> &input) {
-    Matrix input_matrix(1, input.size(), input);
+template <typename T>
+BasicMatrix<T> BasicNeuralNetwork<T>::FeedForward(const std::vector <T> &input) {
+    BasicMatrix<T> input_matrix(1, input.size(), input);
     return FeedForward(input_matrix);
 }
 
-void NeuralNetwork::BackPropagate(const Matrix &input, const Matrix &target, double learning_rate) {
-    std::vector <Matrix> weight_grads;
-    std::vector <Matrix> bias_grads;
-    ComputeGradients(input, target, weight_grads, bias_grads);
-    for (int layer = (int)weights.size() - 1; layer >= 0; layer--) {
-        weights[layer] = weights[layer] - weight_grads[layer].ScalarMul(learning_rate);
-        biases[layer] = biases[layer] - bias_grads[layer].ScalarMul(learning_rate);
+// Runs inputs (N x layer_sizes[0]) through every layer and leaves the softmax
+// probabilities in probs (N x layer_sizes.back()). Touches no member state, so
+// any number of threads may call it concurrently with their own buffers.
+template <typename T>
+void BasicNeuralNetwork<T>::PredictProbaBatch(const BasicMatrix<T> &inputs, BasicMatrix<T> &probs, BasicInferenceBuffers<T> &buffers) const {
+    assert((int)inputs.GetCols() == layer_sizes.front() && "Input width must match the first layer.");
+    int count = (int)layers.size();
+    buffers.activations.resize(count - 1, BasicMatrix<T>(0, 0));
+    const BasicMatrix<T> *res = &inputs;
+    for (int i = 0; i < count; i++) {
+        BasicMatrix<T> &out = i == count - 1 ? probs : buffers.activations[i];
+        LayerForward(i, *res, out, buffers.columns, false);
+        res = &out;
     }
+    probs.ApplySoftmax();
 }
 
-void NeuralNetwork::InitGradientBuffers(std::vector <Matrix> &weight_grads, std::vector <Matrix> &bias_grads) const {
-    weight_grads.clear();
-    bias_grads.clear();
-    weight_grads.reserve(weights.size());
-    bias_grads.reserve(biases.size());
-    for (size_t i = 0; i < weights.size(); i++) {
-        weight_grads.emplace_back((int)weights[i].GetRows(), (int)weights[i].GetCols());
-        bias_grads.emplace_back((int)biases[i].GetRows(), (int)biases[i].GetCols());
+template <typename T>
+void BasicNeuralNetwork<T>::PredictBatch(const BasicMatrix<T> &inputs, std::vector <int> &labels, BasicInferenceBuffers<T> &buffers) const {
+    PredictProbaBatch(inputs, buffers.output, buffers);
+    labels.resize(inputs.GetRows());
+    for (size_t i = 0; i < inputs.GetRows(); i++) {
+        labels[i] = buffers.output.RowArgMax((int)i);
     }
 }
 
-void NeuralNetwork::ComputeGradients(const Matrix &input, const Matrix &target,
-                                     std::vector <Matrix> &weight_grads, std::vector <Matrix> &bias_grads) const {
-    if (weight_grads.empty() || bias_grads.empty()) {
-        InitGradientBuffers(weight_grads, bias_grads);
+template <typename T>
+std::vector <int> BasicNeuralNetwork<T>::PredictBatch(const BasicMatrix<T> &inputs) const {
+    BasicInferenceBuffers<T> buffers;
+    std::vector <int> labels;
+    PredictBatch(inputs, labels, buffers);
+    return labels;
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::BackPropagate(const BasicMatrix<T> &input, const BasicMatrix<T> &target, double learning_rate) {
+    ComputeGradients(input, target, workspace);
+    BasicSgdOptimizer<T> sgd(learning_rate);
+    ApplyGradients(workspace, sgd, 1.0);
+}
+
+// Reserves every buffer for batches of up to batch_size rows, so steps with
+// that many rows or fewer never touch the heap.
+template <typename T>
+void BasicTrainingWorkspace<T>::Reserve(const std::vector <LayerSpec> &layers, size_t batch_size) {
+    size_t count = layers.size();
+    std::vector <int> layer_sizes = LayerSizes(layers);
+    int widest = *std::max_element(layer_sizes.begin(), layer_sizes.end());
+    int widest_patches = 0;
+    activations.resize(count, BasicMatrix<T>(0, 0));
+    weight_grads.resize(count, BasicMatrix<T>(0, 0));
+    bias_grads.resize(count, BasicMatrix<T>(0, 0));
+    columns.resize(count, BasicMatrix<T>(0, 0));
+    for (size_t i = 0; i < count; i++) {
+        const LayerSpec &spec = layers[i];
+        activations[i].Reserve((int)batch_size, layer_sizes[i + 1]);
+        weight_grads[i].Resize(spec.WeightRows(), spec.WeightCols());
+        bias_grads[i].Resize(1, spec.BiasSize());
+        if (spec.kind == LayerKind::Conv2D) {
+            int patches = spec.out_h * spec.out_w * spec.WeightRows();
+            columns[i].Reserve((int)batch_size, patches);
+            widest_patches = std::max(widest_patches, patches);
+        }
     }
+    delta.Reserve((int)batch_size, widest);
+    column_grad.Reserve((int)batch_size, widest_patches);
+    this -> batch_size = std::max(this -> batch_size, batch_size);
+}
+
+template <typename T>
+void BasicTrainingWorkspace<T>::Reserve(const std::vector <int> &layer_sizes, size_t batch_size) {
+    Reserve(DenseLayers(layer_sizes), batch_size);
+}
 
-    std::vector <Matrix> cache;
-    Matrix output = FeedForwardWithCache(input, cache);
-    Matrix delta = output - target;
+template <typename T>
+void BasicShardedWorkspace<T>::Reserve(const std::vector <int> &layer_sizes, size_t batch_size, int threads) {
+    Reserve(DenseLayers(layer_sizes), batch_size, threads);
+}
+
+template <typename T>
+void BasicShardedWorkspace<T>::Reserve(const std::vector <LayerSpec> &layers, size_t batch_size, int threads) {
+    assert(threads > 0 && "A sharded workspace needs at least one thread.");
+    size_t shard_rows = (batch_size + threads - 1) / threads;
+    shards.resize(threads);
+    shard_inputs.resize(threads, BasicMatrix<T>(0, 0));
+    shard_labels.resize(threads);
+    // Each shard is allocated by the team member that trains on it, so with
+    // the pool backend its pages are first touched on that member's node.
+    ParallelTeam(threads, [&](int member, int members) {
+        for (int t = member; t < threads; t += members) {
+            shards[t].Reserve(layers, shard_rows);
+            shard_inputs[t].Reserve((int)shard_rows, layers.front().InputSize());
+            shard_labels[t].reserve(shard_rows);
+        }
+    });
+}
+
+// Works on a whole batch at once: input is N x layer_sizes[0] and target is
+// N x layer_sizes.back(), one sample per row. The gradients left in
+// workspace.weight_grads/bias_grads are summed over the batch, so each layer
+// costs one GEMM forward and two back.
+template <typename T>
+void BasicNeuralNetwork<T>::ComputeGradients(const BasicMatrix<T> &input, const BasicMatrix<T> &target,
+                                     BasicTrainingWorkspace<T> &workspace) const {
+    assert(!mapped_file && "A memory-mapped model is read-only; load it with ModelLoad::Copy to train.");
+    assert(input.GetRows() == target.GetRows() && "Inputs and targets must have the same number of rows.");
+    if (workspace.batch_size < input.GetRows()) workspace.Reserve(layers, input.GetRows());
+    ForwardPass(input, workspace.activations, workspace.columns, true);
+    workspace.activations.back().AddScaledInPlace(target, T(-1));
+    BackwardPass(input, workspace);
+}
+
+// Same as above with the targets given as class indices, one per row. The
+// softmax + cross-entropy delta is output - onehot(label); it is formed from
+// the logits in one fused pass that also yields the loss, without
+// materializing one-hot rows.
+template <typename T>
+void BasicNeuralNetwork<T>::ComputeGradients(const BasicMatrix<T> &input, const std::vector <int> &labels,
+                                     BasicTrainingWorkspace<T> &workspace, BasicGradientSink<T> *sink) const {
+    assert(!mapped_file && "A memory-mapped model is read-only; load it with ModelLoad::Copy to train.");
+    assert(input.GetRows() == labels.size() && "Inputs and labels must have the same number of rows.");
+    if (workspace.batch_size < input.GetRows()) workspace.Reserve(layers, input.GetRows());
+    ForwardPass(input, workspace.activations, workspace.columns, true, false);
+#if MNIST_TELEMETRY
+    size_t correct = 0;
+    for (size_t i = 0; i < labels.size(); i++) {
+        correct += workspace.activations.back().RowArgMax((int)i) == labels[i];
+    }
+    TELEMETRY_ADD(telemetry::Metric::Correct, correct);
+    TELEMETRY_ADD(telemetry::Metric::Samples, labels.size());
+#endif
+    workspace.loss = workspace.activations.back().ApplySoftmaxCrossEntropy(labels);
+    TELEMETRY_ADD(telemetry::Metric::LossMilli, workspace.loss * 1000.0);
+    BackwardPass(input, workspace, sink);
+}
 
-    for (int layer = (int)weights.size() - 1; layer >= 0; layer--) {
-        Matrix prev_activation = cache[layer];
+// Expects the output delta in workspace.activations.back() and overwrites it.
+// The delta ping-pongs between that buffer and workspace.delta on the way
+// down, so nothing is allocated.
+template <typename T>
+void BasicNeuralNetwork<T>::BackwardPass(const BasicMatrix<T> &input, BasicTrainingWorkspace<T> &workspace,
+                                         BasicGradientSink<T> *sink) const {
+    TELEMETRY_SCOPE(telemetry::Phase::Backward);
+    BasicMatrix<T> *delta = &workspace.activations.back();
+    BasicMatrix<T> *next_delta = &workspace.delta;
+    for (int layer = (int)layers.size() - 1; layer >= 0; layer--) {
+        TELEMETRY_LAYER_SCOPE(telemetry::Phase::Backward, layer);
+        const LayerSpec &spec = layers[layer];
+        const BasicMatrix<T> &prev_activation = layer > 0 ? workspace.activations[layer - 1] : input;
+        size_t n = prev_activation.GetRows();
 
-        weight_grads[layer] = prev_activation.Transpose() * delta;
-        bias_grads[layer] = delta;
+        if (spec.kind == LayerKind::Dense) {
+            prev_activation.TransposeMultiplyInto(*delta, workspace.weight_grads[layer]);
+            delta -> ColumnSumInto(workspace.bias_grads[layer]);
+        } else if (spec.kind == LayerKind::Conv2D) {
+            // The delta is (pixels x out_c) and the forward pass left the
+            // patches in columns, so dW = columns^T * delta and db sums the rows.
+            size_t pixels = n * spec.out_h * spec.out_w;
+            size_t patch = spec.WeightRows();
+            Gemm(GemmTranspose::A, patch, spec.out_c, pixels, workspace.columns[layer].Data(), patch,
+                 delta -> Data(), spec.out_c, workspace.weight_grads[layer].Data(), spec.out_c);
+            ConvBiasGradient(spec, delta -> Data(), n, workspace.bias_grads[layer].Data());
+        }
+        if (sink) sink -> LayerReady(workspace, (size_t)layer);
 
-        if (layer > 0) {
-            Matrix prev_derivative = prev_activation;
-            prev_derivative.ApplyReLUDerivative();
-            delta = (delta * (weights[layer].Transpose())).HadamardMul(prev_derivative);
+        // prev_activation is a ReLU output (or the max-pool of one), so ReLU'(z)
+        // is just prev_activation > 0 and the derivative is applied as a mask,
+        // in the GEMM epilogue for a dense layer. Both dense GEMMs read their
+        // transposed operand in place.
+        if (layer == 0) break;
+        if (spec.kind == LayerKind::Dense) {
+            delta -> MultiplyTransposedMaskedInto(weights[layer], prev_activation, *next_delta);
+        } else {
+            next_delta -> Resize((int)n, spec.InputSize());
+            next_delta -> Fill(T(0));
+            if (spec.kind == LayerKind::MaxPool) {
+                // A window's maximum is positive exactly when the ReLU let it
+                // through, so the mask already applied to delta suffices.
+                MaxPoolBackward(spec, prev_activation.Data(), delta -> Data(), n, next_delta -> Data());
+            } else {
+                size_t pixels = n * spec.out_h * spec.out_w;
+                size_t patch = spec.WeightRows();
+                workspace.column_grad.Resize((int)pixels, (int)patch);
+                Gemm(GemmTranspose::B, pixels, patch, spec.out_c, delta -> Data(), spec.out_c,
+                     weights[layer].Data(), spec.out_c, workspace.column_grad.Data(), patch);
+                Col2Im(spec, workspace.column_grad.Data(), n, next_delta -> Data());
+                T *grad = next_delta -> Data();
+                const T *mask = prev_activation.Data();
+                size_t count = n * spec.InputSize();
+                #pragma omp simd
+                for (size_t i = 0; i < count; i++) grad[i] = mask[i] > T(0) ? grad[i] : T(0);
+            }
         }
+        std::swap(delta, next_delta);
     }
 }
 
-void NeuralNetwork::BackPropagateBatch(const std::vector <Matrix> &inputs, const std::vector <Matrix> &targets, double learning_rate) {
-    if (inputs.empty()) return;
-    assert(inputs.size() == targets.size() && "Inputs and targets must be the same size.");
+// Sizes the optimizer state for every parameter tensor; a no-op, and safe to
+// call from several threads, once it has run.
+template <typename T>
+void BasicNeuralNetwork<T>::ReserveOptimizer(BasicOptimizer<T> &optimizer) const {
+    for (size_t layer = 0; layer < weights.size(); layer++) {
+        optimizer.Reserve(2 * layer, weights[layer].GetRows() * weights[layer].GetCols());
+        optimizer.Reserve(2 * layer + 1, biases[layer].GetCols());
+    }
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::ApplyGradients(const BasicTrainingWorkspace<T> &workspace, BasicOptimizer<T> &optimizer, double grad_scale) {
+    TELEMETRY_SCOPE(telemetry::Phase::Update);
+    ReserveOptimizer(optimizer);
+    optimizer.BeginStep();
+    T scale = static_cast<T>(grad_scale);
+    for (size_t layer = 0; layer < weights.size(); layer++) {
+        const BasicMatrix<T> &weight_grad = workspace.weight_grads[layer];
+        optimizer.Update(2 * layer, 0, weights[layer].Data(), weight_grad.Data(),
+                         weight_grad.GetRows() * weight_grad.GetCols(), scale);
+        optimizer.Update(2 * layer + 1, 0, biases[layer].Data(), workspace.bias_grads[layer].Data(),
+                         workspace.bias_grads[layer].GetCols(), scale);
+    }
+}
+
+// Calls fn(param, tensor, offset, count) for the piece of every parameter
+// tensor that falls in slice `part` of `parts` of the flattened parameters.
+template <typename T>
+template <typename F>
+void BasicNeuralNetwork<T>::ForEachParameterSlice(int part, int parts, F fn) {
+    size_t total = 0;
+    for (size_t layer = 0; layer < weights.size(); layer++) {
+        total += weights[layer].GetRows() * weights[layer].GetCols() + biases[layer].GetCols();
+    }
+    size_t lo = total * part / parts;
+    size_t hi = total * (part + 1) / parts;
 
-    std::vector <Matrix> weight_grads_sum;
-    std::vector <Matrix> bias_grads_sum;
-    InitGradientBuffers(weight_grads_sum, bias_grads_sum);
-
-    #pragma omp parallel
-    {
-        std::vector <Matrix> local_w;
-        std::vector <Matrix> local_b;
-        std::vector <Matrix> sample_w;
-        std::vector <Matrix> sample_b;
-        InitGradientBuffers(local_w, local_b);
-        InitGradientBuffers(sample_w, sample_b);
-
-        #pragma omp for schedule(static)
-        for (int i = 0; i < (int)inputs.size(); i++) {
-            ComputeGradients(inputs[i], targets[i], sample_w, sample_b);
-            for (size_t layer = 0; layer < local_w.size(); layer++) {
-                local_w[layer].AddInPlace(sample_w[layer]);
-                local_b[layer].AddInPlace(sample_b[layer]);
+    size_t offset = 0;
+    for (size_t layer = 0; layer < weights.size() && offset < hi; layer++) {
+        for (int is_bias = 0; is_bias < 2; is_bias++) {
+            BasicMatrix<T> &param = is_bias ? biases[layer] : weights[layer];
+            size_t size = param.GetRows() * param.GetCols();
+            size_t begin = std::max(lo, offset);
+            size_t end = std::min(hi, offset + size);
+            if (begin < end) fn(param, 2 * layer + is_bias, begin - offset, end - begin);
+            offset += size;
+        }
+    }
+}
+
+// Thread `part` of `parts` sums its slice of the flattened parameters across
+// the shards' gradients, accumulating into shard 0's buffers, and hands the
+// summed slice to the optimizer. Slices are disjoint, so no locking.
+template <typename T>
+void BasicNeuralNetwork<T>::ApplyShardGradients(BasicShardedWorkspace<T> &workspace, int shards, int part, int parts,
+                                                BasicOptimizer<T> &optimizer, double grad_scale) {
+    T scale = static_cast<T>(grad_scale);
+    ForEachParameterSlice(part, parts, [&](BasicMatrix<T> &param, size_t tensor, size_t offset, size_t count) {
+        size_t layer = tensor / 2;
+        bool is_bias = tensor % 2 == 1;
+        BasicTrainingWorkspace<T> &first = workspace.shards[0];
+        T *sum = (is_bias ? first.bias_grads[layer] : first.weight_grads[layer]).Data() + offset;
+        if (shards > 1) {
+            TELEMETRY_SCOPE(telemetry::Phase::Reduce);
+            for (int s = 1; s < shards; s++) {
+                const BasicTrainingWorkspace<T> &shard = workspace.shards[s];
+                const T *grad = (is_bias ? shard.bias_grads[layer] : shard.weight_grads[layer]).Data() + offset;
+                #pragma omp simd
+                for (size_t i = 0; i < count; i++) {
+                    sum[i] += grad[i];
+                }
             }
         }
+        TELEMETRY_SCOPE(telemetry::Phase::Update);
+        optimizer.Update(tensor, offset, param.Data() + offset, sum, count, scale);
+    });
+}
 
-        #pragma omp critical
-        {
-            for (size_t layer = 0; layer < weight_grads_sum.size(); layer++) {
-                weight_grads_sum[layer].AddInPlace(local_w[layer]);
-                bias_grads_sum[layer].AddInPlace(local_b[layer]);
+// The parameters and optimizer state are allocated before the training team
+// exists, so they cannot be first-touched by their owners; instead each
+// member's ApplyShardGradients slice is migrated to the member's node.
+template <typename T>
+void BasicNeuralNetwork<T>::PlaceParameters(BasicOptimizer<T> &optimizer, int parts) {
+    assert(!mapped_file && "A memory-mapped model cannot be placed.");
+    ReserveOptimizer(optimizer);
+    if (!UsingThreadPool()) return;
+    ThreadPool &pool = GlobalThreadPool();
+    if (pool.Nodes() < 2) return;
+    for (int part = 0; part < parts; part++) {
+        int node = pool.TeamNode(part);
+        ForEachParameterSlice(part, parts, [&](BasicMatrix<T> &param, size_t tensor, size_t offset, size_t count) {
+            pool.MoveToNode(param.Data() + offset, count * sizeof(T), node);
+            for (size_t buffer = 0; buffer < optimizer.StateBuffers(); buffer++) {
+                pool.MoveToNode(optimizer.StateData(buffer, tensor) + offset, count * sizeof(T), node);
             }
+        });
+    }
+}
+
+// Data-parallel step over workspace.shards.size() threads. Each thread
+// computes gradients for its slice of the batch into its own workspace; once
+// the whole team has finished, every thread reduces and applies its slice of
+// the parameters. There is no critical section and no per-batch allocation.
+template <typename T>
+double BasicNeuralNetwork<T>::BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, BasicOptimizer<T> &optimizer,
+                                         BasicShardedWorkspace<T> &workspace) {
+    size_t rows = inputs.GetRows();
+    if (rows == 0) return 0.0;
+    assert(rows == labels.size() && "Inputs and labels must have the same number of rows.");
+    assert(!workspace.shards.empty() && "Reserve the sharded workspace before training.");
+    int threads = (int)std::min(workspace.shards.size(), rows);
+    double grad_scale = 1.0 / static_cast<double>(rows);
+    size_t cols = inputs.GetCols();
+    ReserveOptimizer(optimizer);
+    optimizer.BeginStep();
+
+    int shards = threads;
+    ParallelTeam(threads, [&](int t, int nt) {
+        if (t == 0) shards = nt;
+        if (nt == 1) {
+            ComputeGradients(inputs, labels, workspace.shards[0]);
+            return;
         }
+        size_t begin = rows * t / nt;
+        size_t end = rows * (t + 1) / nt;
+        BasicMatrix<T> &shard_input = workspace.shard_inputs[t];
+        shard_input.Resize((int)(end - begin), (int)cols);
+        std::memcpy(shard_input.Data(), inputs.Data() + begin * cols, (end - begin) * cols * sizeof(T));
+        workspace.shard_labels[t].assign(labels.begin() + begin, labels.begin() + end);
+        ComputeGradients(shard_input, workspace.shard_labels[t], workspace.shards[t]);
+    });
+    ParallelTeam(threads, [&](int t, int nt) {
+        ApplyShardGradients(workspace, shards, t, nt, optimizer, grad_scale);
+    });
+
+    double loss = 0.0;
+    for (int s = 0; s < shards; s++) loss += workspace.shards[s].loss;
+    workspace.loss = loss / static_cast<double>(rows);
+    return workspace.loss;
+}
+
+template <typename T>
+double BasicNeuralNetwork<T>::BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, double learning_rate,
+                                         BasicShardedWorkspace<T> &workspace) {
+    BasicSgdOptimizer<T> sgd(learning_rate);
+    return BackPropagateBatch(inputs, labels, sgd, workspace);
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::BackPropagateBatch(const BasicMatrix<T> &inputs, const BasicMatrix<T> &targets, double learning_rate) {
+    if (inputs.GetRows() == 0) return;
+    ComputeGradients(inputs, targets, workspace);
+    BasicSgdOptimizer<T> sgd(learning_rate);
+    ApplyGradients(workspace, sgd, 1.0 / static_cast<double>(inputs.GetRows()));
+}
+
+template <typename T>
+double BasicNeuralNetwork<T>::BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, double learning_rate) {
+    return BackPropagateBatch(inputs, labels, learning_rate, workspace);
+}
+
+// Same step with caller-owned scratch space. Reserve the workspace for the
+// largest batch up front and the step does no heap allocation at all.
+template <typename T>
+double BasicNeuralNetwork<T>::BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, double learning_rate,
+                                         BasicTrainingWorkspace<T> &workspace) {
+    BasicSgdOptimizer<T> sgd(learning_rate);
+    return BackPropagateBatch(inputs, labels, sgd, workspace);
+}
+
+template <typename T>
+double BasicNeuralNetwork<T>::BackPropagateBatch(const BasicMatrix<T> &inputs, const std::vector <int> &labels, BasicOptimizer<T> &optimizer,
+                                         BasicTrainingWorkspace<T> &workspace) {
+    if (inputs.GetRows() == 0) return 0.0;
+    ComputeGradients(inputs, labels, workspace);
+    ApplyGradients(workspace, optimizer, 1.0 / static_cast<double>(inputs.GetRows()));
+    return workspace.loss / static_cast<double>(inputs.GetRows());
+}
+
+template <typename T>
+double BasicNeuralNetwork<T>::ComputeBatchGradients(const BasicMatrix<T> &inputs, const std::vector <int> &labels,
+                                            BasicTrainingWorkspace<T> &workspace, BasicGradientSink<T> *sink) const {
+    if (inputs.GetRows() == 0) return 0.0;
+    ComputeGradients(inputs, labels, workspace, sink);
+    return workspace.loss / static_cast<double>(inputs.GetRows());
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::ApplyBatchGradients(const BasicTrainingWorkspace<T> &workspace, BasicOptimizer<T> &optimizer,
+                                          double grad_scale) {
+    ApplyGradients(workspace, optimizer, grad_scale);
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::BackPropagateBatch(const std::vector <BasicMatrix<T>> &inputs, const std::vector <BasicMatrix<T>> &targets, double learning_rate) {
+    if (inputs.empty()) return;
+    assert(inputs.size() == targets.size() && "Inputs and targets must be the same size.");
+
+    BasicMatrix<T> input_batch((int)inputs.size(), layer_sizes.front());
+    BasicMatrix<T> target_batch((int)targets.size(), layer_sizes.back());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        input_batch.SetRow((int)i, inputs[i]);
+        target_batch.SetRow((int)i, targets[i]);
     }
+    BackPropagateBatch(input_batch, target_batch, learning_rate);
+}
+
+template <typename T>
+const std::vector <BasicMatrix<T>> &BasicNeuralNetwork<T>::GetWeights() const {
+    assert(!mapped_file && "A memory-mapped model has no weight matrices; load it with ModelLoad::Copy.");
+    return weights;
+}
 
-    double scale = learning_rate / static_cast<double>(inputs.size());
-    for (int layer = (int)weights.size() - 1; layer >= 0; layer--) {
-        weights[layer] = weights[layer] - weight_grads_sum[layer].ScalarMul(scale);
-        biases[layer] = biases[layer] - bias_grads_sum[layer].ScalarMul(scale);
+template <typename T>
+const std::vector <BasicMatrix<T>> &BasicNeuralNetwork<T>::GetBiases() const {
+    assert(!mapped_file && "A memory-mapped model has no bias matrices; load it with ModelLoad::Copy.");
+    return biases;
+}
+
+template <typename T>
+const std::vector <int> &BasicNeuralNetwork<T>::GetLayerSizes() const {
+    return layer_sizes;
+}
+
+template <typename T>
+const std::vector <LayerSpec> &BasicNeuralNetwork<T>::GetLayers() const {
+    return layers;
+}
+
+template <typename T>
+bool BasicNeuralNetwork<T>::IsDenseOnly() const {
+    for (const LayerSpec &spec : layers) {
+        if (spec.kind != LayerKind::Dense) return false;
     }
+    return true;
 }
 
-void NeuralNetwork::SaveModel(const std::string &filepath) {
-    std::ofstream file(filepath, std::ios::binary);
-    assert(file.is_open() && ("Failed to open file " + filepath).c_str());
-    int num_layers = layer_sizes.size();
-    file.write((char*)&num_layers, sizeof(num_layers));
+template <typename T>
+void BasicNeuralNetwork<T>::MaskWeights(size_t layer, const T *mask) {
+    assert(!mapped_file && "A memory-mapped model is read-only; load it with ModelLoad::Copy.");
+    T *w = weights[layer].Data();
+    size_t count = weights[layer].GetRows() * weights[layer].GetCols();
+    #pragma omp simd
+    for (size_t i = 0; i < count; i++) w[i] *= mask[i];
+}
+
+// Model file layout, every field in native byte order:
+//
+//   ModelFileHeader                      64 bytes
+//   int32 layer_sizes[num_layers]
+//   version 2: per layer, int32 kind, in_h, in_w, in_c, out_h, out_w, out_c,
+//              kernel, stride, padding
+//   per layer: weights (WeightRows x WeightCols, row-major), then biases
+//
+// Networks of dense layers only are written as version 1, which has no layer
+// descriptors. Each tensor starts on a MODEL_ALIGN boundary, so a mapped file
+// can feed the GEMM in place. The checksum is FNV-1a over every byte after
+// the header. Files without the magic are read as the older unversioned
+// formats: double (layer count, sizes, values) or float (FLOAT_MODEL_TAG first).
+struct ModelFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t dtype_size;
+    uint32_t num_layers;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(ModelFileHeader) == 64, "ModelFileHeader must stay 64 bytes.");
+
+static const char MODEL_MAGIC[8] = { 'M', 'N', 'I', 'S', 'T', 'N', 'N', 0 };
+static const uint32_t MODEL_VERSION_DENSE = 1;
+static const uint32_t MODEL_VERSION_LAYERS = 2;
+static const size_t LAYER_FIELDS = 10;
+static const uint32_t MODEL_ENDIAN_MARKER = 0x01020304;
+static const size_t MODEL_ALIGN = 64;
+static const int FLOAT_MODEL_TAG = 0x3233464E;
+
+static size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint64_t Fnv1a(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Fills offsets with the start of each tensor (weights of layer 0, biases of
+// layer 0, weights of layer 1, ...) and returns the total file size.
+static size_t ModelLayout(const std::vector <LayerSpec> &layers, uint32_t version, size_t dtype_size, std::vector <size_t> &offsets) {
+    size_t fields = layers.size() + 1 + (version == MODEL_VERSION_LAYERS ? layers.size() * LAYER_FIELDS : 0);
+    size_t offset = AlignUp(sizeof(ModelFileHeader) + fields * sizeof(int32_t), MODEL_ALIGN);
+    offsets.clear();
+    for (const LayerSpec &spec : layers) {
+        offsets.push_back(offset);
+        offset = AlignUp(offset + (size_t)spec.WeightRows() * spec.WeightCols() * dtype_size, MODEL_ALIGN);
+        offsets.push_back(offset);
+        offset = AlignUp(offset + (size_t)spec.BiasSize() * dtype_size, MODEL_ALIGN);
+    }
+    return offset;
+}
+
+void CheckModelFile(bool ok, const std::string &filepath, const char *problem) {
+    if (ok) return;
+    fprintf(stderr, "%s: %s\n", filepath.c_str(), problem);
+    std::exit(1);
+}
+
+// Whether a * b * c of positive sizes fits in an int, as the tensor sizes
+// computed from a layer's shape must.
+static bool FitsInt(int64_t a, int64_t b, int64_t c) {
+    return a * b <= INT_MAX && a * b * c <= INT_MAX;
+}
+
+// A descriptor read from a file must describe a layer NetworkTopology could
+// have built, so that its tensor sizes can be trusted.
+static bool ValidLayerSpec(const LayerSpec &spec) {
+    if (spec.in_h <= 0 || spec.in_w <= 0 || spec.in_c <= 0 || spec.out_h <= 0 || spec.out_w <= 0 || spec.out_c <= 0) return false;
+    if (!FitsInt(spec.in_h, spec.in_w, spec.in_c) || !FitsInt(spec.out_h, spec.out_w, spec.out_c)) return false;
+    switch (spec.kind) {
+        case LayerKind::Dense:
+            return spec.in_h == 1 && spec.in_w == 1 && spec.out_h == 1 && spec.out_w == 1;
+        case LayerKind::Conv2D: {
+            if (spec.kernel <= 0 || spec.stride <= 0 || spec.padding < 0) return false;
+            if (!FitsInt(spec.kernel, spec.kernel, spec.in_c)) return false;
+            int64_t padded_h = spec.in_h + 2 * (int64_t)spec.padding;
+            int64_t padded_w = spec.in_w + 2 * (int64_t)spec.padding;
+            return spec.kernel <= padded_h && spec.kernel <= padded_w &&
+                   spec.out_h == (padded_h - spec.kernel) / spec.stride + 1 &&
+                   spec.out_w == (padded_w - spec.kernel) / spec.stride + 1;
+        }
+        case LayerKind::MaxPool:
+            return spec.kernel > 0 && spec.stride == spec.kernel && spec.padding == 0 && spec.out_c == spec.in_c &&
+                   spec.out_h == spec.in_h / spec.kernel && spec.out_w == spec.in_w / spec.kernel;
+        default:
+            return false;
+    }
+}
+
+// Checks everything that can be checked before trusting the payload and
+// returns the layers, their sizes and the tensor offsets. Every offset it
+// returns lies inside the file.
+static const ModelFileHeader &ValidateModelFile(const MappedFile &file, const std::string &filepath, std::vector <LayerSpec> &layers,
+                                                std::vector <int> &layer_sizes, std::vector <size_t> &offsets) {
+    CheckModelFile(file.Size() >= sizeof(ModelFileHeader), filepath, "Model file is truncated.");
+    const ModelFileHeader &header = *(const ModelFileHeader *)file.Data();
+    CheckModelFile(std::memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) == 0, filepath, "Not a model file.");
+    CheckModelFile(header.endian == MODEL_ENDIAN_MARKER, filepath, "Model file was written with the other byte order.");
+    CheckModelFile(header.version == MODEL_VERSION_DENSE || header.version == MODEL_VERSION_LAYERS, filepath,
+                   "Unsupported model file version.");
+    CheckModelFile(header.dtype_size == sizeof(float) || header.dtype_size == sizeof(double), filepath, "Unknown model element type.");
+    CheckModelFile(header.num_layers >= 2 && header.file_size == file.Size(), filepath, "Model file is truncated.");
+    size_t fields = header.num_layers + (header.version == MODEL_VERSION_LAYERS ? (header.num_layers - 1) * LAYER_FIELDS : 0);
+    CheckModelFile(fields <= (file.Size() - sizeof(ModelFileHeader)) / sizeof(int32_t), filepath, "Model file is truncated.");
+    CheckModelFile(header.checksum == Fnv1a(file.Data() + sizeof(ModelFileHeader), file.Size() - sizeof(ModelFileHeader)),
+                   filepath, "Model file checksum mismatch.");
+
+    const int32_t *sizes = (const int32_t *)(file.Data() + sizeof(ModelFileHeader));
+    layer_sizes.assign(sizes, sizes + header.num_layers);
     for (int size : layer_sizes) {
-        file.write((char*)&size, sizeof(size));
+        CheckModelFile(size > 0, filepath, "Model layer sizes must be positive.");
     }
-    for (const Matrix &w : weights) {
-        for (size_t i = 0; i < w.GetRows(); i++) {
-            for (size_t j = 0; j < w.GetCols(); j++) {
-                double val = w(i, j);
-                file.write((char*)&val, sizeof(val));
-            }
+    if (header.version == MODEL_VERSION_DENSE) {
+        layers = DenseLayers(layer_sizes);
+        for (const LayerSpec &spec : layers) {
+            CheckModelFile(ValidLayerSpec(spec), filepath, "Model file has an invalid layer size.");
+        }
+    } else {
+        const int32_t *field = sizes + header.num_layers;
+        layers.assign(header.num_layers - 1, LayerSpec());
+        for (LayerSpec &spec : layers) {
+            spec.kind = (LayerKind)field[0];
+            spec.in_h = field[1], spec.in_w = field[2], spec.in_c = field[3];
+            spec.out_h = field[4], spec.out_w = field[5], spec.out_c = field[6];
+            spec.kernel = field[7], spec.stride = field[8], spec.padding = field[9];
+            CheckModelFile(ValidLayerSpec(spec), filepath, "Model file has an invalid layer descriptor.");
+            field += LAYER_FIELDS;
+        }
+        // Each layer must take exactly what the one before it produces; a
+        // Dense layer takes the previous feature map flattened.
+        for (size_t i = 1; i < layers.size(); i++) {
+            const LayerSpec &prev = layers[i - 1], &spec = layers[i];
+            bool chained = spec.kind == LayerKind::Dense ? spec.in_c == prev.OutputSize()
+                         : spec.in_h == prev.out_h && spec.in_w == prev.out_w && spec.in_c == prev.out_c;
+            CheckModelFile(chained, filepath, "Model layer shapes do not chain.");
         }
+        CheckModelFile(LayerSizes(layers) == layer_sizes, filepath, "Model layer descriptors do not match the layer sizes.");
     }
-    for (const Matrix &b : biases) {
-        for (size_t i = 0; i < b.GetRows(); i++) {
-            for (size_t j = 0; j < b.GetCols(); j++) {
-                double val = b(i, j);
-                file.write((char*)&val, sizeof(val));
-            }
+    // Bounds every tensor by the file before ModelLayout adds them up.
+    for (const LayerSpec &spec : layers) {
+        CheckModelFile((size_t)spec.WeightRows() * spec.WeightCols() <= file.Size() / header.dtype_size, filepath,
+                       "Model file size does not match its layers.");
+    }
+    CheckModelFile(ModelLayout(layers, header.version, header.dtype_size, offsets) == header.file_size, filepath,
+                   "Model file size does not match its layers.");
+    return header;
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::SaveModel(const std::string &filepath) const {
+    uint32_t version = IsDenseOnly() ? MODEL_VERSION_DENSE : MODEL_VERSION_LAYERS;
+    std::vector <size_t> offsets;
+    size_t file_size = ModelLayout(layers, version, sizeof(T), offsets);
+    std::vector <uint8_t> buffer(file_size, 0);
+
+    ModelFileHeader &header = *(ModelFileHeader *)buffer.data();
+    std::memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version = version;
+    header.endian = MODEL_ENDIAN_MARKER;
+    header.dtype_size = sizeof(T);
+    header.num_layers = (uint32_t)layer_sizes.size();
+    header.file_size = file_size;
+    std::vector <int32_t> fields(layer_sizes.begin(), layer_sizes.end());
+    if (version == MODEL_VERSION_LAYERS) {
+        for (const LayerSpec &spec : layers) {
+            const int32_t descriptor[LAYER_FIELDS] = { (int32_t)spec.kind, spec.in_h, spec.in_w, spec.in_c, spec.out_h, spec.out_w,
+                                                       spec.out_c, spec.kernel, spec.stride, spec.padding };
+            fields.insert(fields.end(), descriptor, descriptor + LAYER_FIELDS);
         }
     }
+    std::memcpy(buffer.data() + sizeof(ModelFileHeader), fields.data(), fields.size() * sizeof(int32_t));
+    for (size_t layer = 0; layer < layers.size(); layer++) {
+        const LayerSpec &spec = layers[layer];
+        std::memcpy(buffer.data() + offsets[2 * layer], LayerWeights(layer), (size_t)spec.WeightRows() * spec.WeightCols() * sizeof(T));
+        std::memcpy(buffer.data() + offsets[2 * layer + 1], LayerBias(layer), (size_t)spec.BiasSize() * sizeof(T));
+    }
+    header.checksum = Fnv1a(buffer.data() + sizeof(ModelFileHeader), file_size - sizeof(ModelFileHeader));
+
+    std::ofstream file(filepath, std::ios::binary);
+    CheckModelFile(file.is_open(), filepath, "Failed to open model file for writing.");
+    file.write((const char *)buffer.data(), file_size);
     file.close();
+    CheckModelFile(!file.fail(), filepath, "Failed to write model file.");
 }
 
-void NeuralNetwork::LoadModel(const std::string &filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    assert(file.is_open() && ("Failed to open file " + filepath).c_str());
+// A network that already has a shape only accepts a file with that shape; an
+// empty one (see FromFile) takes the shape from the file.
+template <typename T>
+void BasicNeuralNetwork<T>::LoadModel(const std::string &filepath, ModelLoad mode) {
+    std::shared_ptr <MappedFile> file = std::make_shared <MappedFile> (filepath);
+    bool versioned = file -> Size() >= sizeof(MODEL_MAGIC) && std::memcmp(file -> Data(), MODEL_MAGIC, sizeof(MODEL_MAGIC)) == 0;
+    if (!versioned) {
+        CheckModelFile(mode == ModelLoad::Copy, filepath, "Only versioned model files can be memory-mapped; re-save the model.");
+        file.reset();
+        LoadLegacyModel(filepath);
+        return;
+    }
+
+    std::vector <LayerSpec> file_layers;
+    std::vector <int> file_sizes;
+    std::vector <size_t> offsets;
+    const ModelFileHeader &header = ValidateModelFile(*file, filepath, file_layers, file_sizes, offsets);
+    CheckModelFile(layers.empty() || layers == file_layers, filepath, "Model file shape does not match this network.");
+    layers = file_layers;
+    layer_sizes = file_sizes;
+
+    weights.clear();
+    biases.clear();
+    mapped_weights.clear();
+    mapped_biases.clear();
+    mapped_file.reset();
+    if (mode == ModelLoad::Map) {
+        CheckModelFile(header.dtype_size == sizeof(T), filepath, "A mapped model must have the network's element type.");
+        for (size_t layer = 0; layer < layers.size(); layer++) {
+            mapped_weights.push_back((const T *)(file -> Data() + offsets[2 * layer]));
+            mapped_biases.push_back((const T *)(file -> Data() + offsets[2 * layer + 1]));
+        }
+        mapped_file = file;
+        return;
+    }
+
+    auto read_tensor = [&](size_t offset, BasicMatrix<T> &m) {
+        size_t count = m.GetRows() * m.GetCols();
+        if (header.dtype_size == sizeof(float)) {
+            const float *src = (const float *)(file -> Data() + offset);
+            std::copy(src, src + count, m.Data());
+        } else {
+            const double *src = (const double *)(file -> Data() + offset);
+            std::copy(src, src + count, m.Data());
+        }
+    };
+    for (size_t layer = 0; layer < layers.size(); layer++) {
+        weights.emplace_back(layers[layer].WeightRows(), layers[layer].WeightCols());
+        read_tensor(offsets[2 * layer], weights.back());
+        biases.emplace_back(1, layers[layer].BiasSize());
+        read_tensor(offsets[2 * layer + 1], biases.back());
+    }
+}
+
+template <typename T>
+BasicNeuralNetwork<T> BasicNeuralNetwork<T>::FromFile(const std::string &filepath, ModelLoad mode) {
+    BasicNeuralNetwork<T> nn(std::vector <int> {});
+    nn.LoadModel(filepath, mode);
+    return nn;
+}
+
+template <typename T>
+void BasicNeuralNetwork<T>::LoadLegacyModel(const std::string &filepath) {
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    CheckModelFile(file.is_open(), filepath, "Failed to open model file.");
+    size_t file_size = (size_t)file.tellg();
+    file.seekg(0);
     int num_layers;
     file.read((char*)&num_layers, sizeof(num_layers));
-    layer_sizes.clear();
+    bool stored_float = num_layers == FLOAT_MODEL_TAG;
+    if (stored_float) {
+        file.read((char*)&num_layers, sizeof(num_layers));
+    }
+    auto read_value = [&]() -> T {
+        if (stored_float) {
+            float val;
+            file.read((char*)&val, sizeof(val));
+            return static_cast <T> (val);
+        }
+        double val;
+        file.read((char*)&val, sizeof(val));
+        return static_cast <T> (val);
+    };
+    CheckModelFile(file.good() && num_layers >= 2 && num_layers < 1024, filepath, "Corrupt legacy model file.");
+    std::vector <int> file_sizes;
     for (int i = 0; i < num_layers; i++) {
         int size;
         file.read((char*)&size, sizeof(size));
-        layer_sizes.push_back(size);
+        CheckModelFile(file.good() && size > 0, filepath, "Corrupt legacy model file.");
+        file_sizes.push_back(size);
+    }
+    // Sizes the matrices only after the file is known to hold them.
+    size_t values = 0;
+    for (int i = 0; i < num_layers - 1; i++) {
+        values += ((size_t)file_sizes[i] + 1) * file_sizes[i + 1];
     }
+    size_t value_size = stored_float ? sizeof(float) : sizeof(double);
+    size_t header_size = (stored_float ? 2 + num_layers : 1 + num_layers) * sizeof(int);
+    CheckModelFile(values <= (file_size - header_size) / value_size && header_size + values * value_size == file_size, filepath,
+                   "Legacy model file size does not match its layers.");
+    std::vector <LayerSpec> file_layers = DenseLayers(file_sizes);
+    CheckModelFile(layers.empty() || layers == file_layers, filepath, "Model file shape does not match this network.");
+    layers = file_layers;
+    layer_sizes = file_sizes;
+    mapped_file.reset();
+    mapped_weights.clear();
+    mapped_biases.clear();
     weights.clear();
     biases.clear();
     for (int i = 0; i < num_layers - 1; i++) {
         int from = layer_sizes[i];
         int to = layer_sizes[i + 1];
-        Matrix w(from, to);
+        BasicMatrix<T> w(from, to);
         for (size_t r = 0; r < from; r++) {
             for (size_t c = 0; c < to; c++) {
-                double val;
-                file.read((char*)&val, sizeof(val));
-                w(r, c) = val;
+                w(r, c) = read_value();
             }
         }
         weights.push_back(w);
     }
     for (int i = 0; i < num_layers - 1; i++) {
         int to = layer_sizes[i + 1];
-        Matrix b(1, to);
+        BasicMatrix<T> b(1, to);
         for (size_t c = 0; c < to; c++) {
-            double val;
-            file.read((char*)&val, sizeof(val));
-            b(0, c) = val;
+            b(0, c) = read_value();
         }
         biases.push_back(b);
     }
+    CheckModelFile(file.good(), filepath, "Legacy model file is truncated.");
     file.close();
-}
\ No newline at end of file
+}
+
+template struct BasicTrainingWorkspace<float>;
+template struct BasicTrainingWorkspace<double>;
+template struct BasicShardedWorkspace<float>;
+template struct BasicShardedWorkspace<double>;
+template class BasicNeuralNetwork<float>;
+template class BasicNeuralNetwork<double>;
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "Parallel.h"
+#include <atomic>
+
+namespace {
+
+std::atomic <size_t> min_work_setting(ParallelPolicy().min_work);
+std::atomic <bool> enabled_setting(ParallelPolicy().enabled);
+std::atomic <bool> nested_setting(ParallelPolicy().nested);
+std::atomic <bool> pool_setting(ParallelPolicy().backend == ParallelBackend::Pool);
+
+}
+
+void SetParallelPolicy(const ParallelPolicy &policy) {
+    min_work_setting.store(policy.min_work, std::memory_order_relaxed);
+    enabled_setting.store(policy.enabled, std::memory_order_relaxed);
+    nested_setting.store(policy.nested, std::memory_order_relaxed);
+    pool_setting.store(policy.backend == ParallelBackend::Pool, std::memory_order_relaxed);
+}
+
+ParallelPolicy GetParallelPolicy() {
+    ParallelPolicy policy;
+    policy.min_work = min_work_setting.load(std::memory_order_relaxed);
+    policy.enabled = enabled_setting.load(std::memory_order_relaxed);
+    policy.nested = nested_setting.load(std::memory_order_relaxed);
+    policy.backend = pool_setting.load(std::memory_order_relaxed) ? ParallelBackend::Pool : ParallelBackend::OpenMP;
+    return policy;
+}
+
+bool ShouldParallelize(size_t work, size_t min_work) {
+    if (!enabled_setting.load(std::memory_order_relaxed)) return false;
+    if (min_work == 0) min_work = min_work_setting.load(std::memory_order_relaxed);
+    if (work < min_work) return false;
+    if (!nested_setting.load(std::memory_order_relaxed) && (omp_in_parallel() || ThreadPool::InsideTask())) return false;
+    return ParallelThreads() > 1;
+}
+
+bool UsingThreadPool() {
+    return pool_setting.load(std::memory_order_relaxed);
+}
+
+int ParallelThreads() {
+    return UsingThreadPool() ? GlobalThreadPool().Threads() : omp_get_max_threads();
+}
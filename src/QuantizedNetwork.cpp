@@ -0,0 +1,374 @@
+#include "QuantizedNetwork.h"
+#include <fstream>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <immintrin.h>
+#include "Parallel.h"
+
+namespace {
+
+// Input widths are padded to a whole number of 512-bit loads.
+const int K_ALIGN = 64;
+const int ACTIVATION_MAX = 127;
+const int QUANTIZED_MODEL_TAG = 0x3851524E;
+// int8 multiply-adds retire 32-64 per instruction, so a row loop needs far
+// more of them than the default threshold before forking pays off.
+const size_t PARALLEL_INT8_WORK = 1024 * 1024;
+
+typedef void (*DotKernel)(const uint8_t *a, const int8_t *w, size_t k, size_t out, int32_t *acc);
+
+int PadK(int k) {
+    return (k + K_ALIGN - 1) / K_ALIGN * K_ALIGN;
+}
+
+// acc[j] = sum_p a[p] * w[j * k + p] for every output j; k is a multiple of K_ALIGN.
+void DotScalar(const uint8_t *a, const int8_t *w, size_t k, size_t out, int32_t *acc) {
+    for (size_t j = 0; j < out; j++) {
+        const int8_t *wj = w + j * k;
+        int32_t sum = 0;
+        for (size_t p = 0; p < k; p++) {
+            sum += (int32_t)a[p] * (int32_t)wj[p];
+        }
+        acc[j] = sum;
+    }
+}
+
+__attribute__((target("avx2")))
+int32_t HorizontalSum(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+// vpmaddubsw multiplies u8 by s8 and adds adjacent pairs into int16, then
+// vpmaddwd against ones widens to int32. Four outputs share each load of a.
+__attribute__((target("avx2")))
+void DotAvx2(const uint8_t *a, const int8_t *w, size_t k, size_t out, int32_t *acc) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    size_t j = 0;
+    for (; j + 4 <= out; j += 4) {
+        const int8_t *w0 = w + j * k;
+        __m256i s0 = _mm256_setzero_si256();
+        __m256i s1 = _mm256_setzero_si256();
+        __m256i s2 = _mm256_setzero_si256();
+        __m256i s3 = _mm256_setzero_si256();
+        for (size_t p = 0; p < k; p += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i *)(a + p));
+            __m256i p0 = _mm256_maddubs_epi16(va, _mm256_loadu_si256((const __m256i *)(w0 + p)));
+            __m256i p1 = _mm256_maddubs_epi16(va, _mm256_loadu_si256((const __m256i *)(w0 + k + p)));
+            __m256i p2 = _mm256_maddubs_epi16(va, _mm256_loadu_si256((const __m256i *)(w0 + 2 * k + p)));
+            __m256i p3 = _mm256_maddubs_epi16(va, _mm256_loadu_si256((const __m256i *)(w0 + 3 * k + p)));
+            s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(p0, ones));
+            s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(p1, ones));
+            s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(p2, ones));
+            s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(p3, ones));
+        }
+        acc[j] = HorizontalSum(s0);
+        acc[j + 1] = HorizontalSum(s1);
+        acc[j + 2] = HorizontalSum(s2);
+        acc[j + 3] = HorizontalSum(s3);
+    }
+    for (; j < out; j++) {
+        const int8_t *wj = w + j * k;
+        __m256i s = _mm256_setzero_si256();
+        for (size_t p = 0; p < k; p += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i *)(a + p));
+            __m256i pj = _mm256_maddubs_epi16(va, _mm256_loadu_si256((const __m256i *)(wj + p)));
+            s = _mm256_add_epi32(s, _mm256_madd_epi16(pj, ones));
+        }
+        acc[j] = HorizontalSum(s);
+    }
+}
+
+// vpdpbusd does the u8 x s8 multiply and the four-way int32 accumulate in one
+// instruction, with no intermediate int16 saturation.
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+void DotAvx512Vnni(const uint8_t *a, const int8_t *w, size_t k, size_t out, int32_t *acc) {
+    size_t j = 0;
+    for (; j + 4 <= out; j += 4) {
+        const int8_t *w0 = w + j * k;
+        __m512i s0 = _mm512_setzero_si512();
+        __m512i s1 = _mm512_setzero_si512();
+        __m512i s2 = _mm512_setzero_si512();
+        __m512i s3 = _mm512_setzero_si512();
+        for (size_t p = 0; p < k; p += 64) {
+            __m512i va = _mm512_loadu_si512(a + p);
+            s0 = _mm512_dpbusd_epi32(s0, va, _mm512_loadu_si512(w0 + p));
+            s1 = _mm512_dpbusd_epi32(s1, va, _mm512_loadu_si512(w0 + k + p));
+            s2 = _mm512_dpbusd_epi32(s2, va, _mm512_loadu_si512(w0 + 2 * k + p));
+            s3 = _mm512_dpbusd_epi32(s3, va, _mm512_loadu_si512(w0 + 3 * k + p));
+        }
+        acc[j] = _mm512_reduce_add_epi32(s0);
+        acc[j + 1] = _mm512_reduce_add_epi32(s1);
+        acc[j + 2] = _mm512_reduce_add_epi32(s2);
+        acc[j + 3] = _mm512_reduce_add_epi32(s3);
+    }
+    for (; j < out; j++) {
+        const int8_t *wj = w + j * k;
+        __m512i s = _mm512_setzero_si512();
+        for (size_t p = 0; p < k; p += 64) {
+            s = _mm512_dpbusd_epi32(s, _mm512_loadu_si512(a + p), _mm512_loadu_si512(wj + p));
+        }
+        acc[j] = _mm512_reduce_add_epi32(s);
+    }
+}
+
+Int8Isa requested_isa = Int8Isa::Auto;
+
+Int8Isa ResolveIsa(Int8Isa isa) {
+    if (isa != Int8Isa::Auto && Int8IsaSupported(isa)) return isa;
+    if (Int8IsaSupported(Int8Isa::Avx512Vnni)) return Int8Isa::Avx512Vnni;
+    if (Int8IsaSupported(Int8Isa::Avx2)) return Int8Isa::Avx2;
+    return Int8Isa::Scalar;
+}
+
+DotKernel SelectKernel() {
+    switch (ResolveIsa(requested_isa)) {
+        case Int8Isa::Avx512Vnni: return DotAvx512Vnni;
+        case Int8Isa::Avx2: return DotAvx2;
+        default: return DotScalar;
+    }
+}
+
+// Activations are never negative after clamping, so adding 0.5 and truncating
+// rounds to nearest; this stays vectorizable, unlike lround.
+inline uint8_t QuantizeActivation(float value, float inv_scale) {
+    float q = std::min(std::max(value * inv_scale, 0.0f), (float)ACTIVATION_MAX);
+    return (uint8_t)(q + 0.5f);
+}
+
+double MaxValue(const Matrix &m) {
+    const double *values = m.Data();
+    size_t count = m.GetRows() * m.GetCols();
+    double mx = 0.0;
+    for (size_t i = 0; i < count; i++) mx = std::max(mx, values[i]);
+    return mx;
+}
+
+}
+
+void SetInt8Isa(Int8Isa isa) {
+    requested_isa = isa;
+}
+
+Int8Isa GetInt8Isa() {
+    return ResolveIsa(requested_isa);
+}
+
+const char *Int8IsaName(Int8Isa isa) {
+    switch (isa) {
+        case Int8Isa::Scalar: return "scalar";
+        case Int8Isa::Avx2: return "avx2";
+        case Int8Isa::Avx512Vnni: return "avx512vnni";
+        default: return "auto";
+    }
+}
+
+bool Int8IsaSupported(Int8Isa isa) {
+    switch (isa) {
+        case Int8Isa::Scalar: return true;
+        case Int8Isa::Avx2: return __builtin_cpu_supports("avx2");
+        case Int8Isa::Avx512Vnni:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+        default: return true;
+    }
+}
+
+QuantizedNetwork::QuantizedNetwork() {
+}
+
+QuantizedNetwork QuantizedNetwork::Quantize(const NeuralNetwork &nn, const Matrix &calibration) {
+    assert(nn.IsDenseOnly() && "Only networks of dense layers can be quantized.");
+    QuantizedNetwork res;
+    res.layer_sizes = nn.GetLayerSizes();
+    const std::vector <Matrix> &weights = nn.GetWeights();
+    const std::vector <Matrix> &biases = nn.GetBiases();
+
+    InferenceBuffers buffers;
+    Matrix probs(0, 0);
+    nn.PredictProbaBatch(calibration, probs, buffers);
+
+    for (size_t l = 0; l < weights.size(); l++) {
+        const Matrix &w = weights[l];
+        QuantizedLayer layer;
+        layer.in = (int)w.GetRows();
+        layer.out = (int)w.GetCols();
+        layer.in_padded = PadK(layer.in);
+
+        double input_max = MaxValue(l == 0 ? calibration : buffers.activations[l - 1]);
+        layer.input_scale = (float)(input_max > 0.0 ? input_max / ACTIVATION_MAX : 1.0);
+
+        layer.weight_scales.resize(layer.out);
+        layer.biases.resize(layer.out);
+        layer.weights.assign((size_t)layer.out * layer.in_padded, 0);
+        for (int j = 0; j < layer.out; j++) {
+            double w_max = 0.0;
+            for (int i = 0; i < layer.in; i++) w_max = std::max(w_max, std::fabs(w(i, j)));
+            double scale = w_max > 0.0 ? w_max / 127.0 : 1.0;
+            layer.weight_scales[j] = (float)scale;
+            layer.biases[j] = (float)biases[l](0, j);
+            for (int i = 0; i < layer.in; i++) {
+                long q = std::lround(w(i, j) / scale);
+                layer.weights[(size_t)j * layer.in_padded + i] = (int8_t)std::min<long>(std::max<long>(q, -127), 127);
+            }
+        }
+        res.layers.push_back(layer);
+    }
+    return res;
+}
+
+// Leaves the float logits of the last layer in buffers.logits (N x out).
+void QuantizedNetwork::Forward(const Matrix &inputs, QuantizedBuffers &buffers) const {
+    assert((int)inputs.GetCols() == layer_sizes.front() && "Input width must match the first layer.");
+    const int rows = (int)inputs.GetRows();
+    const DotKernel dot = SelectKernel();
+
+    const QuantizedLayer &first = layers.front();
+    buffers.input.assign((size_t)rows * first.in_padded, 0);
+    float inv_input_scale = 1.0f / first.input_scale;
+    for (int r = 0; r < rows; r++) {
+        const double *row = inputs.Data() + (size_t)r * first.in;
+        uint8_t *dst = buffers.input.data() + (size_t)r * first.in_padded;
+        for (int i = 0; i < first.in; i++) {
+            dst[i] = QuantizeActivation((float)row[i], inv_input_scale);
+        }
+    }
+
+    for (size_t l = 0; l < layers.size(); l++) {
+        const QuantizedLayer &layer = layers[l];
+        bool last = l + 1 == layers.size();
+        buffers.accumulators.resize((size_t)rows * layer.out);
+
+        ParallelFor(rows, (size_t)rows * layer.in_padded * layer.out, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++) {
+                dot(buffers.input.data() + r * layer.in_padded, layer.weights.data(),
+                    layer.in_padded, layer.out, buffers.accumulators.data() + r * layer.out);
+            }
+        }, PARALLEL_INT8_WORK);
+
+        if (last) {
+            buffers.logits.resize((size_t)rows * layer.out);
+            for (int r = 0; r < rows; r++) {
+                for (int j = 0; j < layer.out; j++) {
+                    size_t idx = (size_t)r * layer.out + j;
+                    buffers.logits[idx] = buffers.accumulators[idx] * layer.input_scale * layer.weight_scales[j] + layer.biases[j];
+                }
+            }
+            break;
+        }
+
+        // Dequantize, add bias, ReLU, and requantize with the next layer's scale.
+        const QuantizedLayer &next = layers[l + 1];
+        float inv_next_scale = 1.0f / next.input_scale;
+        buffers.output.assign((size_t)rows * next.in_padded, 0);
+        for (int r = 0; r < rows; r++) {
+            const int32_t *acc = buffers.accumulators.data() + (size_t)r * layer.out;
+            uint8_t *dst = buffers.output.data() + (size_t)r * next.in_padded;
+            for (int j = 0; j < layer.out; j++) {
+                float z = acc[j] * layer.input_scale * layer.weight_scales[j] + layer.biases[j];
+                dst[j] = QuantizeActivation(z, inv_next_scale);
+            }
+        }
+        buffers.input.swap(buffers.output);
+    }
+}
+
+void QuantizedNetwork::PredictProbaBatch(const Matrix &inputs, Matrix &probs, QuantizedBuffers &buffers) const {
+    Forward(inputs, buffers);
+    int out = layers.back().out;
+    probs.Resize((int)inputs.GetRows(), out);
+    std::copy(buffers.logits.begin(), buffers.logits.end(), probs.Data());
+    probs.ApplySoftmax();
+}
+
+// Softmax preserves the argmax, so labels come straight from the logits.
+void QuantizedNetwork::PredictBatch(const Matrix &inputs, std::vector <int> &labels, QuantizedBuffers &buffers) const {
+    Forward(inputs, buffers);
+    int out = layers.back().out;
+    labels.resize(inputs.GetRows());
+    for (size_t r = 0; r < inputs.GetRows(); r++) {
+        const float *row = buffers.logits.data() + r * out;
+        labels[r] = (int)(std::max_element(row, row + out) - row);
+    }
+}
+
+size_t QuantizedNetwork::ParameterBytes() const {
+    size_t bytes = 0;
+    for (const QuantizedLayer &layer : layers) {
+        bytes += (size_t)layer.in * layer.out * sizeof(int8_t);
+        bytes += layer.out * (sizeof(float) * 2) + sizeof(float);
+    }
+    return bytes;
+}
+
+// Layout: tag, layer count, layer sizes, then per layer the input scale, the
+// output-channel weight scales, the biases and the unpadded out x in weights.
+void QuantizedNetwork::SaveModel(const std::string &filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    CheckModelFile(file.is_open(), filepath, "Failed to open model file for writing.");
+    int num_layers = layer_sizes.size();
+    file.write((char*)&QUANTIZED_MODEL_TAG, sizeof(QUANTIZED_MODEL_TAG));
+    file.write((char*)&num_layers, sizeof(num_layers));
+    file.write((char*)layer_sizes.data(), num_layers * sizeof(int));
+    for (const QuantizedLayer &layer : layers) {
+        file.write((char*)&layer.input_scale, sizeof(layer.input_scale));
+        file.write((char*)layer.weight_scales.data(), layer.out * sizeof(float));
+        file.write((char*)layer.biases.data(), layer.out * sizeof(float));
+        for (int j = 0; j < layer.out; j++) {
+            file.write((char*)(layer.weights.data() + (size_t)j * layer.in_padded), layer.in);
+        }
+    }
+    file.close();
+    CheckModelFile(!file.fail(), filepath, "Failed to write model file.");
+}
+
+// Layout: tag, layer count, layer sizes, then per layer the input scale,
+// out weight scales, out biases and out rows of in int8 weights.
+void QuantizedNetwork::LoadModel(const std::string &filepath) {
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    CheckModelFile(file.is_open(), filepath, "Failed to open model file.");
+    size_t file_size = (size_t)file.tellg();
+    file.seekg(0);
+    int tag = 0;
+    int num_layers = 0;
+    file.read((char*)&tag, sizeof(tag));
+    CheckModelFile(file.good() && tag == QUANTIZED_MODEL_TAG, filepath, "Not a quantized model file.");
+    file.read((char*)&num_layers, sizeof(num_layers));
+    CheckModelFile(file.good() && num_layers >= 2 && (size_t)num_layers <= file_size / sizeof(int), filepath,
+                   "Corrupt quantized model file.");
+    std::vector <int> file_sizes(num_layers);
+    file.read((char*)file_sizes.data(), num_layers * sizeof(int));
+    CheckModelFile(file.good(), filepath, "Quantized model file is truncated.");
+    // Sizes the layers only after the file is known to hold them.
+    size_t expected = (2 + (size_t)num_layers) * sizeof(int);
+    for (int l = 0; l < num_layers; l++) {
+        CheckModelFile(file_sizes[l] > 0 && (size_t)file_sizes[l] <= file_size, filepath, "Quantized model layer sizes are out of range.");
+        if (l + 1 < num_layers) {
+            expected += sizeof(float) + (size_t)file_sizes[l + 1] * (2 * sizeof(float) + (size_t)file_sizes[l]);
+        }
+    }
+    CheckModelFile(expected == file_size, filepath, "Quantized model file size does not match its layers.");
+
+    layer_sizes = file_sizes;
+    layers.clear();
+    for (int l = 0; l < num_layers - 1; l++) {
+        QuantizedLayer layer;
+        layer.in = layer_sizes[l];
+        layer.out = layer_sizes[l + 1];
+        layer.in_padded = PadK(layer.in);
+        layer.weight_scales.resize(layer.out);
+        layer.biases.resize(layer.out);
+        layer.weights.assign((size_t)layer.out * layer.in_padded, 0);
+        file.read((char*)&layer.input_scale, sizeof(layer.input_scale));
+        file.read((char*)layer.weight_scales.data(), layer.out * sizeof(float));
+        file.read((char*)layer.biases.data(), layer.out * sizeof(float));
+        for (int j = 0; j < layer.out; j++) {
+            file.read((char*)(layer.weights.data() + (size_t)j * layer.in_padded), layer.in);
+        }
+        layers.push_back(layer);
+    }
+    CheckModelFile(file.good(), filepath, "Quantized model file is truncated.");
+    file.close();
+}
\ No newline at end of file
@@ -0,0 +1,204 @@
+#ifndef _WIN32
+
+#include "RingAllReduce.h"
+#include "Telemetry.h"
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+template <typename T>
+BasicRingAllReduce<T>::BasicRingAllReduce(int rank, int size, int send_fd, int recv_fd)
+    : rank(rank), size(size), send_fd(send_fd), recv_fd(recv_fd) {
+    assert(size > 0 && rank >= 0 && rank < size && "Rank must be within the ring.");
+    if (size > 1) {
+        fcntl(send_fd, F_SETFL, fcntl(send_fd, F_GETFL) | O_NONBLOCK);
+        fcntl(recv_fd, F_SETFL, fcntl(recv_fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+template <typename T>
+BasicRingAllReduce<T>::~BasicRingAllReduce() {
+    if (send_fd >= 0) close(send_fd);
+    if (recv_fd >= 0 && recv_fd != send_fd) close(recv_fd);
+}
+
+template <typename T>
+void BasicRingAllReduce<T>::Reserve(size_t n) {
+    size_t chunk = (n + size - 1) / size;
+    if (scratch.size() < chunk) scratch.resize(chunk);
+}
+
+// A rank that lost a neighbour cannot finish the reduction, and returning
+// would let training go on with partially reduced gradients on every rank,
+// so the failure is printed and the process exits. The neighbours then see
+// their sockets close and stop the same way.
+static void RingFailed(int rank, const char *problem, int error) {
+    fprintf(stderr, "Rank %d: %s (%s)\n", rank, problem, error ? std::strerror(error) : "connection closed");
+    std::exit(1);
+}
+
+// Sends send[0, send_count) to the next rank while receiving recv_count
+// elements from the previous one, whichever side is ready first.
+template <typename T>
+void BasicRingAllReduce<T>::Exchange(const T *send, size_t send_count, T *recv, size_t recv_count) {
+    const char *out = (const char *)send;
+    char *in = (char *)recv;
+    size_t out_left = send_count * sizeof(T);
+    size_t in_left = recv_count * sizeof(T);
+    while (out_left > 0 || in_left > 0) {
+        pollfd fds[2];
+        int count = 0;
+        if (out_left > 0) fds[count++] = { send_fd, POLLOUT, 0 };
+        if (in_left > 0) fds[count++] = { recv_fd, POLLIN, 0 };
+        if (poll(fds, count, -1) < 0) {
+            if (errno != EINTR) RingFailed(rank, "poll failed on a ring socket", errno);
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            if (fds[i].revents == 0) continue;
+            if (fds[i].fd == send_fd && out_left > 0) {
+                ssize_t sent = ::send(send_fd, out, out_left, MSG_NOSIGNAL);
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+                if (sent <= 0) RingFailed(rank, "Lost the connection to the next rank", sent < 0 ? errno : 0);
+                out += sent;
+                out_left -= (size_t)sent;
+            } else if (in_left > 0) {
+                ssize_t got = ::recv(recv_fd, in, in_left, 0);
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+                if (got <= 0) RingFailed(rank, "Lost the connection to the previous rank", got < 0 ? errno : 0);
+                in += got;
+                in_left -= (size_t)got;
+            }
+        }
+    }
+}
+
+template <typename T>
+void BasicRingAllReduce<T>::AllReduce(T *data, size_t n) {
+    if (size == 1 || n == 0) return;
+    Reserve(n);
+    auto chunk_begin = [&](int c) { return n * (size_t)c / (size_t)size; };
+    auto chunk_size = [&](int c) { return chunk_begin(c + 1) - chunk_begin(c); };
+
+    // Reduce-scatter: after step s, rank r holds the partial sum of chunk
+    // (r - s - 1) over s + 2 ranks; after size - 1 steps it owns the full
+    // sum of chunk r + 1.
+    for (int step = 0; step < size - 1; step++) {
+        int send_chunk = ((rank - step) % size + size) % size;
+        int recv_chunk = ((rank - step - 1) % size + size) % size;
+        size_t count = chunk_size(recv_chunk);
+        Exchange(data + chunk_begin(send_chunk), chunk_size(send_chunk), scratch.data(), count);
+        T *dst = data + chunk_begin(recv_chunk);
+        #pragma omp simd
+        for (size_t i = 0; i < count; i++) dst[i] += scratch[i];
+    }
+    // All-gather: pass the finished chunks around the ring.
+    for (int step = 0; step < size - 1; step++) {
+        int send_chunk = ((rank - step + 1) % size + size) % size;
+        int recv_chunk = ((rank - step) % size + size) % size;
+        Exchange(data + chunk_begin(send_chunk), chunk_size(send_chunk), data + chunk_begin(recv_chunk), chunk_size(recv_chunk));
+    }
+}
+
+template <typename T>
+int BasicRingAllReduce<T>::Rank() const {
+    return rank;
+}
+
+template <typename T>
+int BasicRingAllReduce<T>::Size() const {
+    return size;
+}
+
+void CreateLocalRing(int size, std::vector <int> &send_fds, std::vector <int> &recv_fds) {
+    send_fds.assign(size, -1);
+    recv_fds.assign(size, -1);
+    if (size < 2) return;
+    for (int r = 0; r < size; r++) {
+        int pair[2];
+        int ok = socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+        assert(ok == 0 && "socketpair failed.");
+        (void)ok;
+        send_fds[r] = pair[0];
+        recv_fds[(r + 1) % size] = pair[1];
+    }
+}
+
+template <typename T>
+BasicGradientExchange<T>::BasicGradientExchange(BasicRingAllReduce<T> &ring, size_t layers)
+    : ring(ring), workspace(nullptr), queue(layers), queued(0), reduced(0), stopping(false) {
+    worker = std::thread(&BasicGradientExchange<T>::Run, this);
+}
+
+template <typename T>
+BasicGradientExchange<T>::~BasicGradientExchange() {
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        stopping = true;
+    }
+    layer_ready.notify_one();
+    worker.join();
+}
+
+template <typename T>
+void BasicGradientExchange<T>::LayerReady(BasicTrainingWorkspace<T> &workspace, size_t layer) {
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        assert(queued < queue.size() && "More layers reported than the exchange was built for.");
+        this -> workspace = &workspace;
+        queue[queued++] = layer;
+    }
+    layer_ready.notify_one();
+}
+
+template <typename T>
+void BasicGradientExchange<T>::Wait() {
+    TELEMETRY_SCOPE(telemetry::Phase::Reduce);
+    std::unique_lock <std::mutex> lock(mutex);
+    layer_reduced.wait(lock, [&]() { return reduced == queued; });
+    queued = 0;
+    reduced = 0;
+}
+
+template <typename T>
+void BasicGradientExchange<T>::Run() {
+    for (;;) {
+        size_t layer;
+        BasicTrainingWorkspace<T> *target;
+        {
+            std::unique_lock <std::mutex> lock(mutex);
+            layer_ready.wait(lock, [&]() { return stopping || reduced < queued; });
+            if (reduced == queued) return;
+            layer = queue[reduced];
+            target = workspace;
+        }
+        // The backward pass is done with this layer's gradients, so they are
+        // reduced in place while it computes the next one.
+        BasicMatrix<T> &weight_grad = target -> weight_grads[layer];
+        BasicMatrix<T> &bias_grad = target -> bias_grads[layer];
+        ring.AllReduce(weight_grad.Data(), weight_grad.GetRows() * weight_grad.GetCols());
+        ring.AllReduce(bias_grad.Data(), bias_grad.GetCols());
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            reduced++;
+        }
+        layer_reduced.notify_one();
+    }
+}
+
+template class BasicRingAllReduce<float>;
+template class BasicRingAllReduce<double>;
+template class BasicGradientExchange<float>;
+template class BasicGradientExchange<double>;
+
+#endif
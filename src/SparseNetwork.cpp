@@ -0,0 +1,349 @@
+#include "SparseNetwork.h"
+#include "Gemm.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+
+namespace {
+
+// Batch columns per register tile. A Csr row keeps one tile of accumulators,
+// a 4x4 block four and an 8x1 block eight, so the widths shrink to keep
+// every block's accumulators within the sixteen 256-bit AVX2 registers.
+template <typename T> constexpr int CSR_TILE = 128 / sizeof(T);
+template <typename T> constexpr int BLOCK4_TILE = 64 / sizeof(T);
+template <typename T> constexpr int BLOCK8_TILE = 32 / sizeof(T);
+
+int BlockHeight(SparseFormat format) {
+    switch (format) {
+        case SparseFormat::Block4x4: return 4;
+        case SparseFormat::Block8x1: return 8;
+        default: return 1;
+    }
+}
+
+int BlockWidth(SparseFormat format) {
+    return format == SparseFormat::Block4x4 ? 4 : 1;
+}
+
+int PadTo(int n, int multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+// Calls tile(n0, width) for every full NT-column tile of an n-column batch,
+// then once per leftover column with width 1, so a single image runs the
+// narrow kernels instead of a mostly empty tile.
+template <int NT, typename F>
+void ForEachTile(size_t n, F tile) {
+    size_t n0 = 0;
+    for (; n0 + NT <= n; n0 += NT) tile(n0, std::integral_constant <int, NT>());
+    for (; n0 < n; n0++) tile(n0, std::integral_constant <int, 1>());
+}
+
+template <typename T, int NT>
+inline void StoreTile(const T *acc, T *y, bool relu) {
+    if (relu) {
+        #pragma omp simd
+        for (int c = 0; c < NT; c++) y[c] = std::max(acc[c], T(0));
+    } else {
+        #pragma omp simd
+        for (int c = 0; c < NT; c++) y[c] = acc[c];
+    }
+}
+
+// The kernels compute rows [begin, end) of y = act(W^T x + b) for batch
+// columns [n0, n0 + NT). x and y are feature-major with row stride ld, so
+// every stored weight multiplies a contiguous run of NT activations.
+template <typename T, int NT>
+void CsrTile(const BasicSparseLayer<T> &layer, const T *x, T *y, size_t ld, size_t n0, size_t begin, size_t end, bool relu) {
+    for (size_t r = begin; r < end; r++) {
+        T acc[NT];
+        for (int c = 0; c < NT; c++) acc[c] = layer.bias[r];
+        for (int e = layer.row_start[r]; e < layer.row_start[r + 1]; e++) {
+            const T v = layer.values[e];
+            const T *xe = x + (size_t)layer.columns[e] * ld + n0;
+            #pragma omp simd
+            for (int c = 0; c < NT; c++) acc[c] += v * xe[c];
+        }
+        StoreTile<T, NT>(acc, y + r * ld + n0, relu);
+    }
+}
+
+// Each block loads four input rows once and feeds all four outputs.
+template <typename T, int NT>
+void Block4x4Tile(const BasicSparseLayer<T> &layer, const T *x, T *y, size_t ld, size_t n0, size_t begin, size_t end, bool relu) {
+    for (size_t b = begin; b < end; b++) {
+        T acc[4][NT];
+        for (int h = 0; h < 4; h++) {
+            for (int c = 0; c < NT; c++) acc[h][c] = layer.bias[b * 4 + h];
+        }
+        for (int e = layer.row_start[b]; e < layer.row_start[b + 1]; e++) {
+            const T *v = layer.values.data() + (size_t)e * 16;
+            const T *x0 = x + (size_t)layer.columns[e] * ld + n0;
+            const T *x1 = x0 + ld;
+            const T *x2 = x1 + ld;
+            const T *x3 = x2 + ld;
+            for (int h = 0; h < 4; h++) {
+                const T *vh = v + h * 4;
+                #pragma omp simd
+                for (int c = 0; c < NT; c++) acc[h][c] += vh[0] * x0[c] + vh[1] * x1[c] + vh[2] * x2[c] + vh[3] * x3[c];
+            }
+        }
+        for (int h = 0; h < 4; h++) StoreTile<T, NT>(acc[h], y + (b * 4 + h) * ld + n0, relu);
+    }
+}
+
+// Each block loads one input row and feeds eight outputs. With a single
+// column the eight outputs themselves form the vector.
+template <typename T, int NT>
+void Block8x1Tile(const BasicSparseLayer<T> &layer, const T *x, T *y, size_t ld, size_t n0, size_t begin, size_t end, bool relu) {
+    for (size_t b = begin; b < end; b++) {
+        T acc[8][NT];
+        for (int h = 0; h < 8; h++) {
+            for (int c = 0; c < NT; c++) acc[h][c] = layer.bias[b * 8 + h];
+        }
+        for (int e = layer.row_start[b]; e < layer.row_start[b + 1]; e++) {
+            const T *v = layer.values.data() + (size_t)e * 8;
+            const T *xe = x + (size_t)layer.columns[e] * ld + n0;
+            if constexpr (NT == 1) {
+                const T xv = xe[0];
+                #pragma omp simd
+                for (int h = 0; h < 8; h++) acc[h][0] += v[h] * xv;
+            } else {
+                for (int h = 0; h < 8; h++) {
+                    #pragma omp simd
+                    for (int c = 0; c < NT; c++) acc[h][c] += v[h] * xe[c];
+                }
+            }
+        }
+        for (int h = 0; h < 8; h++) StoreTile<T, NT>(acc[h], y + (b * 8 + h) * ld + n0, relu);
+    }
+}
+
+template <typename T>
+void LayerRows(SparseFormat format, const BasicSparseLayer<T> &layer, const T *x, T *y, size_t n, size_t begin, size_t end,
+               bool relu) {
+    switch (format) {
+        case SparseFormat::Csr:
+            ForEachTile<CSR_TILE<T>>(n, [&](size_t n0, auto width) {
+                CsrTile<T, decltype(width)::value>(layer, x, y, n, n0, begin, end, relu);
+            });
+            break;
+        case SparseFormat::Block4x4:
+            ForEachTile<BLOCK4_TILE<T>>(n, [&](size_t n0, auto width) {
+                Block4x4Tile<T, decltype(width)::value>(layer, x, y, n, n0, begin, end, relu);
+            });
+            break;
+        case SparseFormat::Block8x1:
+            ForEachTile<BLOCK8_TILE<T>>(n, [&](size_t n0, auto width) {
+                Block8x1Tile<T, decltype(width)::value>(layer, x, y, n, n0, begin, end, relu);
+            });
+            break;
+    }
+}
+
+}
+
+const char *SparseFormatName(SparseFormat format) {
+    switch (format) {
+        case SparseFormat::Csr: return "csr";
+        case SparseFormat::Block4x4: return "block4x4";
+        case SparseFormat::Block8x1: return "block8x1";
+        default: return "?";
+    }
+}
+
+template <typename T>
+std::vector <std::vector <T>> MagnitudeMasks(const BasicNeuralNetwork<T> &nn, const std::vector <double> &sparsity,
+                                              SparseFormat blocks) {
+    const std::vector <BasicMatrix<T>> &weights = nn.GetWeights();
+    assert(sparsity.size() == weights.size() && "Need one sparsity per layer.");
+    const int height = BlockHeight(blocks);
+    const int width = BlockWidth(blocks);
+    std::vector <std::vector <T>> masks(weights.size());
+    for (size_t l = 0; l < weights.size(); l++) {
+        assert(sparsity[l] >= 0.0 && sparsity[l] <= 1.0 && "Sparsity must be in [0, 1].");
+        const BasicMatrix<T> &w = weights[l];
+        const int in = (int)w.GetRows(), out = (int)w.GetCols();
+        const int block_rows = PadTo(in, width) / width, block_cols = PadTo(out, height) / height;
+        // Block (bi, bj) covers inputs [bi * width, ...) and outputs [bj * height, ...).
+        std::vector <double> score((size_t)block_rows * block_cols, 0.0);
+        std::vector <int> members((size_t)block_rows * block_cols, 0);
+        for (int i = 0; i < in; i++) {
+            for (int j = 0; j < out; j++) {
+                size_t b = (size_t)(i / width) * block_cols + j / height;
+                score[b] += std::fabs((double)w(i, j));
+                members[b]++;
+            }
+        }
+        for (size_t b = 0; b < score.size(); b++) score[b] /= members[b];
+
+        size_t pruned = std::min(score.size(), (size_t)std::llround(sparsity[l] * score.size()));
+        std::vector <size_t> order(score.size());
+        std::iota(order.begin(), order.end(), (size_t)0);
+        std::nth_element(order.begin(), order.begin() + pruned, order.end(), [&](size_t a, size_t b) {
+            return score[a] < score[b];
+        });
+        std::vector <uint8_t> drop(score.size(), 0);
+        for (size_t k = 0; k < pruned; k++) drop[order[k]] = 1;
+        masks[l].assign((size_t)in * out, T(1));
+        for (int i = 0; i < in; i++) {
+            for (int j = 0; j < out; j++) {
+                if (drop[(size_t)(i / width) * block_cols + j / height]) masks[l][(size_t)i * out + j] = T(0);
+            }
+        }
+    }
+    return masks;
+}
+
+template <typename T>
+void MaskDeadInputs(const IdxDataset &images, int out, std::vector <T> &mask) {
+    size_t in = images.ItemSize();
+    assert(mask.size() == in * (size_t)out && "The mask must be the first layer's, in x out.");
+    std::vector <uint8_t> seen(in, 0);
+    for (size_t n = 0; n < images.Count(); n++) {
+        const uint8_t *pixels = images.Item(n);
+        #pragma omp simd
+        for (size_t i = 0; i < in; i++) seen[i] |= pixels[i];
+    }
+    for (size_t i = 0; i < in; i++) {
+        if (!seen[i]) std::fill(mask.begin() + i * out, mask.begin() + (i + 1) * out, T(0));
+    }
+}
+
+template <typename T>
+double Sparsity(const BasicMatrix<T> &weights) {
+    size_t count = weights.GetRows() * weights.GetCols();
+    size_t zeros = std::count(weights.Data(), weights.Data() + count, T(0));
+    return count ? (double)zeros / count : 0.0;
+}
+
+template <typename T>
+BasicSparseNetwork<T>::BasicSparseNetwork() : format(SparseFormat::Csr) {}
+
+template <typename T>
+BasicSparseNetwork<T> BasicSparseNetwork<T>::FromNetwork(const BasicNeuralNetwork<T> &nn, SparseFormat format) {
+    assert(nn.IsDenseOnly() && "Only networks of dense layers have a sparse form.");
+    BasicSparseNetwork<T> res;
+    res.format = format;
+    res.layer_sizes = nn.GetLayerSizes();
+    const int height = BlockHeight(format);
+    const int width = BlockWidth(format);
+    for (size_t l = 0; l < nn.GetWeights().size(); l++) {
+        const BasicMatrix<T> &w = nn.GetWeights()[l];
+        const BasicMatrix<T> &bias = nn.GetBiases()[l];
+        BasicSparseLayer<T> layer;
+        layer.in = (int)w.GetRows();
+        layer.out = (int)w.GetCols();
+        layer.rows = PadTo(layer.out, height) / height;
+        layer.bias.assign((size_t)layer.rows * height, T(0));
+        std::copy(bias.Data(), bias.Data() + layer.out, layer.bias.begin());
+        layer.row_start.push_back(0);
+        std::vector <T> block(height * width);
+        for (int r = 0; r < layer.rows; r++) {
+            for (int i0 = 0; i0 < layer.in; i0 += width) {
+                bool any = false;
+                for (int h = 0; h < height; h++) {
+                    for (int c = 0; c < width; c++) {
+                        int j = r * height + h, i = i0 + c;
+                        T v = j < layer.out && i < layer.in ? w(i, j) : T(0);
+                        block[h * width + c] = v;
+                        any |= v != T(0);
+                    }
+                }
+                if (!any) continue;
+                layer.columns.push_back(i0);
+                layer.values.insert(layer.values.end(), block.begin(), block.end());
+            }
+            layer.row_start.push_back((int)layer.columns.size());
+        }
+        res.layers.push_back(layer);
+    }
+    return res;
+}
+
+// Inputs are transposed once into feature-major form, with the rows a 4x4
+// block reads past the last input zeroed. Padded output rows have zero
+// weights and bias, so they stay zero and serve as the next layer's padding.
+template <typename T>
+void BasicSparseNetwork<T>::Forward(const BasicMatrix<T> &inputs, BasicSparseBuffers<T> &buffers) const {
+    assert((int)inputs.GetCols() == layer_sizes.front() && "Input width must match the first layer.");
+    const size_t n = inputs.GetRows();
+    const int in = layer_sizes.front();
+    const size_t in_rows = PadTo(in, BlockWidth(format));
+    buffers.input.resize(in_rows * n);
+    std::fill(buffers.input.begin() + (size_t)in * n, buffers.input.begin() + in_rows * n, T(0));
+    TransposeCopy(n, in, inputs.Data(), in, buffers.input.data(), n);
+
+    const int height = BlockHeight(format);
+    for (size_t l = 0; l < layers.size(); l++) {
+        const BasicSparseLayer<T> &layer = layers[l];
+        bool relu = l + 1 < layers.size();
+        buffers.output.resize((size_t)layer.rows * height * n);
+        const T *x = buffers.input.data();
+        T *y = buffers.output.data();
+        size_t work = layer.values.size() * n;
+        ParallelFor(layer.rows, work, [&](size_t begin, size_t end) {
+            LayerRows(format, layer, x, y, n, begin, end, relu);
+        });
+        buffers.input.swap(buffers.output);
+    }
+}
+
+template <typename T>
+void BasicSparseNetwork<T>::PredictProbaBatch(const BasicMatrix<T> &inputs, BasicMatrix<T> &probs, BasicSparseBuffers<T> &buffers) const {
+    Forward(inputs, buffers);
+    const size_t n = inputs.GetRows();
+    const int out = layer_sizes.back();
+    probs.Resize((int)n, out);
+    TransposeCopy(out, n, buffers.input.data(), n, probs.Data(), out);
+    probs.ApplySoftmax();
+}
+
+// Softmax preserves the argmax, so labels come straight from the logits.
+template <typename T>
+void BasicSparseNetwork<T>::PredictBatch(const BasicMatrix<T> &inputs, std::vector <int> &labels, BasicSparseBuffers<T> &buffers) const {
+    Forward(inputs, buffers);
+    const size_t n = inputs.GetRows();
+    const int out = layer_sizes.back();
+    const T *logits = buffers.input.data();
+    labels.assign(n, 0);
+    for (int j = 1; j < out; j++) {
+        for (size_t r = 0; r < n; r++) {
+            if (logits[j * n + r] > logits[labels[r] * n + r]) labels[r] = j;
+        }
+    }
+}
+
+template <typename T>
+SparseFormat BasicSparseNetwork<T>::Format() const {
+    return format;
+}
+
+template <typename T>
+size_t BasicSparseNetwork<T>::StoredValues() const {
+    size_t values = 0;
+    for (const BasicSparseLayer<T> &layer : layers) values += layer.values.size();
+    return values;
+}
+
+template <typename T>
+size_t BasicSparseNetwork<T>::ParameterBytes() const {
+    size_t bytes = 0;
+    for (const BasicSparseLayer<T> &layer : layers) {
+        bytes += layer.values.size() * sizeof(T) + layer.bias.size() * sizeof(T);
+        bytes += (layer.columns.size() + layer.row_start.size()) * sizeof(int);
+    }
+    return bytes;
+}
+
+template std::vector <std::vector <float>> MagnitudeMasks<float>(const BasicNeuralNetwork<float> &, const std::vector <double> &, SparseFormat);
+template std::vector <std::vector <double>> MagnitudeMasks<double>(const BasicNeuralNetwork<double> &, const std::vector <double> &, SparseFormat);
+template void MaskDeadInputs<float>(const IdxDataset &, int, std::vector <float> &);
+template void MaskDeadInputs<double>(const IdxDataset &, int, std::vector <double> &);
+template double Sparsity<float>(const BasicMatrix<float> &);
+template double Sparsity<double>(const BasicMatrix<double> &);
+template class BasicSparseNetwork<float>;
+template class BasicSparseNetwork<double>;
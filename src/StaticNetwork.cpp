@@ -0,0 +1,97 @@
+#include "StaticNetwork.h"
+#include "Math.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+template <typename T, int... Sizes>
+BasicStaticNetwork<T, Sizes...>::BasicStaticNetwork() : params() {}
+
+template <typename T, int... Sizes>
+void BasicStaticNetwork<T, Sizes...>::CopyFrom(const BasicNeuralNetwork<T> &nn) {
+    const std::vector <int> &layer_sizes = nn.GetLayerSizes();
+    assert(nn.IsDenseOnly() && layer_sizes.size() == sizeof...(Sizes) && std::equal(layer_sizes.begin(), layer_sizes.end(), SIZES) &&
+           "The model's layer sizes must match the static topology.");
+    for (int layer = 0; layer < LAYERS; layer++) {
+        std::memcpy(params + WeightOffset(layer), nn.GetWeights()[layer].Data(),
+                    (size_t)SIZES[layer] * SIZES[layer + 1] * sizeof(T));
+        std::memcpy(params + BiasOffset(layer), nn.GetBiases()[layer].Data(), (size_t)SIZES[layer + 1] * sizeof(T));
+    }
+}
+
+template <typename T, int... Sizes>
+void BasicStaticNetwork<T, Sizes...>::LoadModel(const std::string &filepath) {
+    CopyFrom(BasicNeuralNetwork<T>::FromFile(filepath));
+}
+
+// Columns [Column, Column + COLUMN_BLOCK) of one layer. The accumulators stay
+// in registers across all In inputs; zero inputs (most MNIST pixels, about
+// half of the ReLU outputs) are skipped.
+template <typename T, int... Sizes>
+template <int In, int Out, int Column>
+void BasicStaticNetwork<T, Sizes...>::DenseColumns(const T *__restrict weights, const T *__restrict input,
+                                                    T *__restrict output) {
+    constexpr int WIDTH = Out - Column < COLUMN_BLOCK ? Out - Column : COLUMN_BLOCK;
+    T acc[WIDTH];
+    for (int j = 0; j < WIDTH; j++) acc[j] = output[Column + j];
+    for (int i = 0; i < In; i++) {
+        T x = input[i];
+        if (x == T(0)) continue;
+        const T *row = weights + (size_t)i * Out + Column;
+        #pragma omp simd
+        for (int j = 0; j < WIDTH; j++) acc[j] += x * row[j];
+    }
+    for (int j = 0; j < WIDTH; j++) output[Column + j] = acc[j];
+}
+
+// output (already holding the bias) += input * weights, one column block at
+// a time.
+template <typename T, int... Sizes>
+template <int In, int Out, int Column>
+void BasicStaticNetwork<T, Sizes...>::Dense(const T *__restrict weights, const T *__restrict input, T *__restrict output) {
+    DenseColumns<In, Out, Column>(weights, input, output);
+    if constexpr (Column + COLUMN_BLOCK < Out) Dense<In, Out, Column + COLUMN_BLOCK>(weights, input, output);
+}
+
+template <typename T, int... Sizes>
+template <int Layer>
+void BasicStaticNetwork<T, Sizes...>::Forward(const T *input, T *probs, T (*scratch)[WIDEST]) const {
+    constexpr int IN = SIZES[Layer];
+    constexpr int OUT = SIZES[Layer + 1];
+    constexpr bool LAST = Layer + 1 == LAYERS;
+    T *output = LAST ? probs : scratch[Layer % 2];
+    std::memcpy(output, params + BiasOffset(Layer), OUT * sizeof(T));
+    Dense<IN, OUT>(params + WeightOffset(Layer), input, output);
+    if constexpr (LAST) {
+        SoftmaxInPlace(output, OUT);
+    } else {
+        #pragma omp simd
+        for (int j = 0; j < OUT; j++) output[j] = std::max(output[j], T(0));
+        Forward<Layer + 1>(output, probs, scratch);
+    }
+}
+
+template <typename T, int... Sizes>
+void BasicStaticNetwork<T, Sizes...>::PredictProba(const T *input, T *probs) const {
+    alignas(64) T scratch[2][WIDEST];
+    Forward<0>(input, probs, scratch);
+}
+
+template <typename T, int... Sizes>
+int BasicStaticNetwork<T, Sizes...>::Predict(const T *input) const {
+    T probs[OUTPUTS];
+    PredictProba(input, probs);
+    return (int)(std::max_element(probs, probs + OUTPUTS) - probs);
+}
+
+template <typename T, int... Sizes>
+int BasicStaticNetwork<T, Sizes...>::Predict(const uint8_t *pixels) const {
+    alignas(64) T input[INPUTS];
+    const T scale = T(1) / T(255);
+    #pragma omp simd
+    for (int i = 0; i < INPUTS; i++) input[i] = static_cast <T> (pixels[i]) * scale;
+    return Predict(input);
+}
+
+template class BasicStaticNetwork<float, 784, 128, 64, 10>;
+template class BasicStaticNetwork<double, 784, 128, 64, 10>;
@@ -0,0 +1,163 @@
+#include "Telemetry.h"
+#include <cstdio>
+
+#if MNIST_TELEMETRY
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <memory>
+#endif
+
+namespace telemetry {
+
+const char *PhaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Data: return "data";
+        case Phase::Forward: return "forward";
+        case Phase::Backward: return "backward";
+        case Phase::Reduce: return "reduce";
+        case Phase::Update: return "update";
+        default: return "?";
+    }
+}
+
+#if MNIST_TELEMETRY
+
+struct TraceEvent {
+    Phase phase;
+    int layer;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+// Written only by its owning thread; read by TakeSnapshot. Relaxed atomics
+// make that well-defined and compile to plain loads and stores.
+struct ThreadBlock {
+    int id = 0;
+    std::atomic <uint64_t> phase_ns[(int)Phase::Count] = {};
+    std::atomic <uint64_t> layer_forward_ns[MAX_LAYERS] = {};
+    std::atomic <uint64_t> layer_backward_ns[MAX_LAYERS] = {};
+    std::atomic <uint64_t> metrics[(int)Metric::Count] = {};
+    std::vector <TraceEvent> events;
+};
+
+// Blocks outlive their threads so totals survive OpenMP team changes.
+static std::mutex registry_mutex;
+static std::vector <std::unique_ptr <ThreadBlock>> registry;
+static std::atomic <bool> tracing(false);
+static size_t trace_capacity = 0;
+static std::string trace_path;
+static const auto epoch = std::chrono::steady_clock::now();
+
+static ThreadBlock &Local() {
+    thread_local ThreadBlock *block = nullptr;
+    if (!block) {
+        std::lock_guard <std::mutex> lock(registry_mutex);
+        registry.emplace_back(new ThreadBlock());
+        block = registry.back().get();
+        block -> id = (int)registry.size() - 1;
+        if (tracing.load()) block -> events.reserve(trace_capacity);
+    }
+    return *block;
+}
+
+static void Bump(std::atomic <uint64_t> &slot, uint64_t value) {
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t NowNs() {
+    return (uint64_t)std::chrono::duration_cast <std::chrono::nanoseconds> (std::chrono::steady_clock::now() - epoch).count();
+}
+
+void AddTime(Phase phase, int layer, uint64_t start_ns, uint64_t end_ns) {
+    ThreadBlock &block = Local();
+    uint64_t duration = end_ns - start_ns;
+    if (layer < 0) {
+        Bump(block.phase_ns[(int)phase], duration);
+    } else if (layer < MAX_LAYERS) {
+        Bump((phase == Phase::Forward ? block.layer_forward_ns : block.layer_backward_ns)[layer], duration);
+    }
+    // Events past the reserved capacity are dropped rather than reallocating
+    // in the middle of a step.
+    if (tracing.load(std::memory_order_relaxed) && block.events.size() < block.events.capacity()) {
+        block.events.push_back({ phase, layer, start_ns, duration });
+    }
+}
+
+void Add(Metric metric, uint64_t value) {
+    Bump(Local().metrics[(int)metric], value);
+}
+
+Snapshot TakeSnapshot() {
+    Snapshot snapshot;
+    std::lock_guard <std::mutex> lock(registry_mutex);
+    for (const std::unique_ptr <ThreadBlock> &block : registry) {
+        for (int i = 0; i < (int)Phase::Count; i++) snapshot.phase_ns[i] += block -> phase_ns[i].load(std::memory_order_relaxed);
+        for (int i = 0; i < MAX_LAYERS; i++) {
+            snapshot.layer_forward_ns[i] += block -> layer_forward_ns[i].load(std::memory_order_relaxed);
+            snapshot.layer_backward_ns[i] += block -> layer_backward_ns[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < (int)Metric::Count; i++) snapshot.metrics[i] += block -> metrics[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void StartTrace(const std::string &path, size_t max_events) {
+    std::lock_guard <std::mutex> lock(registry_mutex);
+    trace_path = path;
+    trace_capacity = max_events;
+    for (std::unique_ptr <ThreadBlock> &block : registry) {
+        block -> events.clear();
+        block -> events.reserve(max_events);
+    }
+    tracing.store(true);
+}
+
+// Call once the traced threads are idle; their buffers are read unlocked.
+void StopTrace() {
+    tracing.store(false);
+    std::lock_guard <std::mutex> lock(registry_mutex);
+    FILE *f = fopen(trace_path.c_str(), "w");
+    if (!f) {
+        printf("Cannot write trace %s\n", trace_path.c_str());
+        return;
+    }
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const std::unique_ptr <ThreadBlock> &block : registry) {
+        for (const TraceEvent &e : block -> events) {
+            fprintf(f, "%s{\"name\":\"%s", first ? "" : ",\n", PhaseName(e.phase));
+            if (e.layer >= 0) fprintf(f, " %d", e.layer);
+            fprintf(f, "\",\"cat\":\"train\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    block -> id, e.start_ns * 1e-3, e.duration_ns * 1e-3);
+            first = false;
+        }
+        block -> events.clear();
+        block -> events.shrink_to_fit();
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+}
+
+#endif
+
+void FormatStats(const Snapshot &before, const Snapshot &now, double seconds, char *line, size_t size) {
+    auto delta = [](uint64_t a, uint64_t b) { return (double)(b - a); };
+    double samples = delta(before.metrics[(int)Metric::Samples], now.metrics[(int)Metric::Samples]);
+    double correct = delta(before.metrics[(int)Metric::Correct], now.metrics[(int)Metric::Correct]);
+    double loss = delta(before.metrics[(int)Metric::LossMilli], now.metrics[(int)Metric::LossMilli]) * 1e-3;
+    double flops = delta(before.metrics[(int)Metric::GemmFlops], now.metrics[(int)Metric::GemmFlops]);
+
+    int used = snprintf(line, size, "%8.0f samples/s  loss %.4f  acc %6.2f%%  %7.2f GFLOP/s ",
+                        seconds > 0 ? samples / seconds : 0.0, samples > 0 ? loss / samples : 0.0,
+                        samples > 0 ? 100.0 * correct / samples : 0.0, seconds > 0 ? flops / seconds * 1e-9 : 0.0);
+    double total = 0.0;
+    for (int i = 0; i < (int)Phase::Count; i++) total += delta(before.phase_ns[i], now.phase_ns[i]);
+    for (int i = 0; i < (int)Phase::Count && used >= 0 && (size_t)used < size; i++) {
+        double share = total > 0 ? 100.0 * delta(before.phase_ns[i], now.phase_ns[i]) / total : 0.0;
+        used += snprintf(line + used, size - used, " %s %4.1f%%", PhaseName((Phase)i), share);
+    }
+}
+
+}
@@ -0,0 +1,363 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// Per-worker queue capacity. ParallelFor queues one chunk per worker, so
+// this is only reached by callers asking for very fine-grained chunks; a
+// task that does not fit runs on the submitting thread instead.
+const size_t QUEUE_CAPACITY = 1024;
+// Polls of the submission counter before an idle worker sleeps, and of a
+// job's counter before a waiting caller starts yielding its CPU.
+const int IDLE_SPINS = 4096;
+const int WAIT_SPINS = 1024;
+
+thread_local int current_worker = -1;
+thread_local int task_depth = 0;
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// CPUs this process may run on.
+std::vector <int> AllowedCpus() {
+    std::vector <int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        int count = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < count; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+std::vector <int> ParseCpuList(const std::string &text) {
+    std::vector <int> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        if (comma == std::string::npos) comma = text.size();
+        int first = 0, last = 0;
+        int fields = std::sscanf(text.substr(pos, comma - pos).c_str(), "%d-%d", &first, &last);
+        if (fields == 1) last = first;
+        if (fields >= 1) {
+            for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        }
+        pos = comma + 1;
+    }
+    return cpus;
+}
+
+std::mutex global_mutex;
+std::unique_ptr <ThreadPool> global_pool;
+std::atomic <ThreadPool *> global_instance(nullptr);
+
+}
+
+std::vector <NumaNode> DetectNumaNodes() {
+    std::vector <int> allowed = AllowedCpus();
+    std::vector <NumaNode> nodes;
+#ifdef __linux__
+    const std::string root = "/sys/devices/system/node/";
+    if (DIR *dir = opendir(root.c_str())) {
+        while (dirent *entry = readdir(dir)) {
+            int id;
+            char tail;
+            if (std::sscanf(entry -> d_name, "node%d%c", &id, &tail) != 1) continue;
+            std::ifstream list(root + entry -> d_name + "/cpulist");
+            std::string text;
+            std::getline(list, text);
+            NumaNode node = { id, {} };
+            for (int cpu : ParseCpuList(text)) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) node.cpus.push_back(cpu);
+            }
+            if (!node.cpus.empty()) nodes.push_back(node);
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+#endif
+    if (nodes.empty()) nodes.push_back({ 0, allowed });
+    return nodes;
+}
+
+bool ThreadPool::TaskQueue::Push(const Task &task) {
+    if (count == slots.size()) return false;
+    slots[(head + count) % slots.size()] = task;
+    count++;
+    return true;
+}
+
+bool ThreadPool::TaskQueue::PopNewest(Task &task) {
+    if (count == 0) return false;
+    count--;
+    task = slots[(head + count) % slots.size()];
+    return true;
+}
+
+bool ThreadPool::TaskQueue::PopOldest(Task &task) {
+    if (count == 0) return false;
+    task = slots[head];
+    head = (head + 1) % slots.size();
+    count--;
+    return true;
+}
+
+ThreadPool::ThreadPool(const ThreadPoolOptions &options) : generation(0), sleeping(0), stopping(false) {
+    std::vector <NumaNode> all = DetectNumaNodes();
+    size_t use = options.nodes > 0 ? std::min(all.size(), (size_t)options.nodes) : all.size();
+    std::vector <std::pair <int, int>> cpus;
+    for (size_t i = 0; i < use; i++) {
+        for (int cpu : all[i].cpus) cpus.push_back({ cpu, all[i].id });
+    }
+    int threads = options.threads > 0 ? options.threads : (int)cpus.size();
+
+    for (int w = 0; w < threads; w++) {
+        std::unique_ptr <Worker> worker(new Worker());
+        const std::pair <int, int> &slot = cpus[w % cpus.size()];
+        worker -> cpu = options.pin ? slot.first : -1;
+        worker -> node = slot.second;
+        worker -> stealable.slots.resize(QUEUE_CAPACITY);
+        worker -> bound.slots.resize(QUEUE_CAPACITY);
+        if (std::find(nodes.begin(), nodes.end(), slot.second) == nodes.end()) nodes.push_back(slot.second);
+        workers.push_back(std::move(worker));
+    }
+
+    steal_order.resize(threads);
+    for (int w = 0; w < threads; w++) {
+        for (int local = 1; local >= 0; local--) {
+            for (int i = 1; i < threads; i++) {
+                int victim = (w + i) % threads;
+                if ((workers[victim] -> node == workers[w] -> node) == (local == 1)) steal_order[w].push_back(victim);
+            }
+        }
+    }
+
+    for (int w = 0; w < threads; w++) {
+        workers[w] -> thread = std::thread(&ThreadPool::WorkerLoop, this, w);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard <std::mutex> lock(sleep_mutex);
+        stopping.store(true);
+    }
+    wake.notify_all();
+    for (std::unique_ptr <Worker> &worker : workers) worker -> thread.join();
+}
+
+int ThreadPool::Threads() const {
+    return (int)workers.size();
+}
+
+int ThreadPool::Nodes() const {
+    return (int)nodes.size();
+}
+
+int ThreadPool::WorkerNode(int w) const {
+    return workers[w] -> node;
+}
+
+int ThreadPool::TeamNode(int t) const {
+    return WorkerNode(t % Threads());
+}
+
+int ThreadPool::CurrentWorker() {
+    return current_worker;
+}
+
+bool ThreadPool::InsideTask() {
+    return task_depth > 0;
+}
+
+void ThreadPool::Execute(const Task &task) {
+    task_depth++;
+    task.job -> function(task.job -> context, task.begin, task.end);
+    task_depth--;
+    // The job lives on the submitter's stack and may be gone after this.
+    task.job -> remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool ThreadPool::StealTask(int thief, Task &task) {
+    int victims = (int)workers.size() - (thief >= 0 ? 1 : 0);
+    for (int i = 0; i < victims; i++) {
+        Worker &victim = *workers[thief >= 0 ? steal_order[thief][i] : i];
+        std::lock_guard <std::mutex> lock(victim.mutex);
+        if (victim.stealable.PopOldest(task)) return true;
+    }
+    return false;
+}
+
+bool ThreadPool::FindTask(int index, Task &task) {
+    Worker &self = *workers[index];
+    {
+        std::lock_guard <std::mutex> lock(self.mutex);
+        if (self.bound.PopNewest(task) || self.stealable.PopNewest(task)) return true;
+    }
+    return StealTask(index, task);
+}
+
+// A worker only sleeps after a full scan found nothing and no submission
+// happened since: Submit() bumps `generation` after queueing and then wakes
+// sleepers, and the sleeper re-checks `generation` under the mutex.
+void ThreadPool::WorkerLoop(int index) {
+    current_worker = index;
+#ifdef __linux__
+    if (workers[index] -> cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(workers[index] -> cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+    Task task;
+    while (true) {
+        uint64_t seen = generation.load();
+        if (FindTask(index, task)) {
+            Execute(task);
+            continue;
+        }
+        for (int spin = 0; spin < IDLE_SPINS && generation.load(std::memory_order_relaxed) == seen; spin++) {
+            CpuRelax();
+        }
+        if (generation.load() != seen) continue;
+
+        std::unique_lock <std::mutex> lock(sleep_mutex);
+        if (stopping.load()) return;
+        sleeping.fetch_add(1);
+        wake.wait(lock, [&]() { return stopping.load() || generation.load() != seen; });
+        sleeping.fetch_sub(1);
+    }
+}
+
+void ThreadPool::Submit(Job &job, size_t items, size_t chunks, bool bind) {
+    for (size_t c = 0; c < chunks; c++) {
+        Task task = { &job, items * c / chunks, items * (c + 1) / chunks };
+        Worker &worker = *workers[c % workers.size()];
+        bool queued;
+        {
+            std::lock_guard <std::mutex> lock(worker.mutex);
+            queued = (bind ? worker.bound : worker.stealable).Push(task);
+        }
+        if (!queued) Execute(task);
+    }
+    generation.fetch_add(1);
+    if (sleeping.load() > 0) {
+        { std::lock_guard <std::mutex> lock(sleep_mutex); }
+        wake.notify_all();
+    }
+}
+
+// The caller steals while it waits, so it is one more worker for Run().
+void ThreadPool::Wait(Job &job, bool help) {
+    int spins = 0;
+    Task task;
+    while (job.remaining.load(std::memory_order_acquire) != 0) {
+        if (help && StealTask(-1, task)) {
+            Execute(task);
+            spins = 0;
+        } else if (++spins < WAIT_SPINS) {
+            CpuRelax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::Run(size_t items, TaskFunction function, void *context, size_t chunks) {
+    if (items == 0) return;
+    if (chunks == 0) chunks = workers.size();
+    chunks = std::min(chunks, items);
+    if (chunks <= 1 || InsideTask()) {
+        function(context, 0, items);
+        return;
+    }
+    Job job;
+    job.function = function;
+    job.context = context;
+    job.remaining.store(chunks, std::memory_order_relaxed);
+    Submit(job, items, chunks, false);
+    Wait(job, true);
+}
+
+void ThreadPool::Team(int members, TaskFunction function, void *context) {
+    if (members <= 0) return;
+    if (InsideTask()) {
+        for (int t = 0; t < members; t++) function(context, (size_t)t, (size_t)t + 1);
+        return;
+    }
+    Job job;
+    job.function = function;
+    job.context = context;
+    job.remaining.store((size_t)members, std::memory_order_relaxed);
+    Submit(job, (size_t)members, (size_t)members, true);
+    Wait(job, false);
+}
+
+// move_pages(2) through syscall(), so the build needs no libnuma.
+void ThreadPool::MoveToNode(const void *data, size_t bytes, int node) const {
+#ifdef __linux__
+    if (nodes.size() < 2 || bytes == 0) return;
+    const int MPOL_MF_MOVE_FLAG = 1 << 1;
+    const size_t BATCH = 256;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)data + page - 1) & ~(page - 1);
+    uintptr_t last = ((uintptr_t)data + bytes) & ~(page - 1);
+    void *pages[BATCH];
+    int targets[BATCH];
+    int status[BATCH];
+    for (uintptr_t address = first; address < last;) {
+        unsigned long count = 0;
+        for (; count < BATCH && address < last; count++, address += page) {
+            pages[count] = (void *)address;
+            targets[count] = node;
+        }
+        syscall(SYS_move_pages, 0, count, pages, targets, status, MPOL_MF_MOVE_FLAG);
+    }
+#else
+    (void)data;
+    (void)bytes;
+    (void)node;
+#endif
+}
+
+ThreadPool &GlobalThreadPool() {
+    if (ThreadPool *pool = global_instance.load(std::memory_order_acquire)) return *pool;
+    std::lock_guard <std::mutex> lock(global_mutex);
+    if (!global_pool) {
+        global_pool.reset(new ThreadPool());
+        global_instance.store(global_pool.get(), std::memory_order_release);
+    }
+    return *global_pool;
+}
+
+void ConfigureGlobalThreadPool(const ThreadPoolOptions &options) {
+    std::lock_guard <std::mutex> lock(global_mutex);
+    global_instance.store(nullptr, std::memory_order_release);
+    global_pool.reset(new ThreadPool(options));
+    global_instance.store(global_pool.get(), std::memory_order_release);
+}
@@ -2,65 +2,211 @@
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
+#include <cctype>
+#include <string>
 #include <ctime>
-#include <numeric>
-#include <random>
-#include "MNISTReader.h"
+#include "IdxDataset.h"
+#include "DataLoader.h"
 #include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "HogwildTrainer.h"
+#include "Telemetry.h"
+#include "Parallel.h"
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <omp.h>
 
-std::vector <double> GetTargetVector(int label) {
-    std::vector <double> v(10, 0.0);
-    v[label] = 1.0;
-    return v;
+// Every heap allocation in the process goes through here, so the training
+// loop can check that steps after the first one allocate nothing.
+static std::atomic <size_t> heap_allocations(0);
+
+void *operator new(std::size_t size) {
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
 }
 
-int main() {
-	std::srand(static_cast <unsigned int> (std::time(0)));
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
 
-	std::string train_img_path = "dataset/train-images.idx3-ubyte";
-	std::string train_lbl_path = "dataset/train-labels.idx1-ubyte";
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+// Waits for the next batch; the wait is the data phase of the step.
+template <typename T>
+const BasicBatch<T> *NextBatch(BasicDataLoader<T> &loader) {
+	TELEMETRY_SCOPE(telemetry::Phase::Data);
+	return loader.Next();
+}
 
-	std::vector <Matrix> train_images = ReadImages(train_img_path);
-	std::vector <int> train_labels = ReadLabels(train_lbl_path);
-	std::vector <Matrix> train_inputs;
-	train_inputs.reserve(train_images.size());
-	for (const Matrix &img : train_images) {
-		train_inputs.push_back(img.Flatten(0));
+// Telemetry builds print a stats line at most every two seconds, or when
+// forced at the end of an epoch; otherwise this does nothing.
+class StatsReporter {
+#if MNIST_TELEMETRY
+	telemetry::Snapshot last = telemetry::TakeSnapshot();
+	std::chrono::steady_clock::time_point last_time = std::chrono::steady_clock::now();
+	size_t last_allocations = heap_allocations.load();
+#endif
+public:
+	void Report(bool force) {
+#if MNIST_TELEMETRY
+		auto now = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration <double> (now - last_time).count();
+		if (!force && seconds < 2.0) return;
+		telemetry::Snapshot snapshot = telemetry::TakeSnapshot();
+		size_t allocations = heap_allocations.load();
+		char line[256];
+		telemetry::FormatStats(last, snapshot, seconds, line, sizeof(line));
+		printf("\r[stats] %s  allocs %zu\n", line, allocations - last_allocations);
+		last = snapshot;
+		last_time = now;
+		last_allocations = allocations;
+#else
+		(void)force;
+#endif
 	}
+};
 
-	NeuralNetwork nn({ 784, 128, 64, 10 });
-	double learning_rate = 0.01;
-	int epochs = 15;
+// Asynchronous variant: every thread pulls its own batches and updates the
+// shared weights without waiting for the others (see HogwildTrainer.h).
+// Returns the heap allocations made after the first (warm-up) epoch.
+template <typename T>
+size_t TrainHogwild(BasicNeuralNetwork<T> &nn, BasicOptimizer<T> &optimizer, const IdxDataset &train_images,
+	const IdxDataset &train_labels, int epochs, int batch_size) {
+	BasicHogwildTrainer<T> trainer(nn, optimizer, train_images, train_labels, batch_size, ParallelThreads(),
+		static_cast<unsigned int>(std::time(0)));
+	StatsReporter stats;
+	size_t warm_allocations = 0;
+	for (int epoch = 0; epoch < epochs; epoch++) {
+		auto t0 = std::chrono::steady_clock::now();
+		double loss = trainer.RunEpoch();
+		double seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - t0).count();
+		stats.Report(true);
+		if (epoch == 0) warm_allocations = heap_allocations.load();
+		printf("Epoch %02d/%d completed, loss %.4f, %.0f samples/s.\n", epoch + 1, epochs, loss,
+			train_images.Count() / seconds);
+	}
+	size_t epoch_allocations = heap_allocations.load() - warm_allocations;
+	printf("Heap allocations after the first epoch: %zu\n", epoch_allocations);
+	return epoch_allocations;
+}
+
+// Trains a network with element type T using the named optimizer for the
+// given number of epochs. Returns the number of heap allocations made after
+// the first (warm-up) step.
+template <typename T>
+size_t Train(const IdxDataset &train_images, const IdxDataset &train_labels, const std::string &optimizer_name, int epochs,
+	bool hogwild) {
+	BasicNeuralNetwork<T> nn({ 784, 128, 64, 10 });
+	std::unique_ptr <BasicOptimizer<T>> optimizer = MakeOptimizer<T>(optimizer_name);
 	int batch_size = 64;
-	std::mt19937 rng(static_cast<unsigned int>(std::time(0)));
-	std::vector <size_t> order(train_inputs.size());
-	std::iota(order.begin(), order.end(), 0);
 
-	printf("Training started...\n");
+	int threads = ParallelThreads();
+	printf("Training started (%s, %s%s, %d epochs, %d %s threads)...\n", sizeof(T) == sizeof(float) ? "float" : "double",
+		optimizer_name.c_str(), hogwild ? ", hogwild" : "", epochs, threads, UsingThreadPool() ? "pool" : "OpenMP");
+	if (hogwild) {
+		size_t epoch_allocations = TrainHogwild(nn, *optimizer, train_images, train_labels, epochs, batch_size);
+		nn.SaveModel("mnist_model.dat");
+		return epoch_allocations;
+	}
 
-	for (int epoch = 0; epoch < epochs; epoch++) {
-		std::shuffle(order.begin(), order.end(), rng);
-		for (size_t start = 0; start < train_inputs.size(); start += batch_size) {
-			size_t end = std::min(start + (size_t)batch_size, train_inputs.size());
-			std::vector <Matrix> batch_inputs;
-			std::vector <Matrix> batch_targets;
-			batch_inputs.reserve(end - start);
-			batch_targets.reserve(end - start);
-			for (size_t idx = start; idx < end; idx++) {
-				size_t sample = order[idx];
-				batch_inputs.push_back(train_inputs[sample]);
-				batch_targets.emplace_back(1, 10, GetTargetVector(train_labels[sample]));
-			}
-			nn.BackPropagateBatch(batch_inputs, batch_targets, learning_rate);
-			if (((start / (size_t)batch_size) + 1) % 10 == 0) {
-				printf("\rEpoch %02d/%d - Batch %zu/%zu", epoch + 1, epochs,
-					((start / (size_t)batch_size) + 1),
-					((train_inputs.size() + batch_size - 1) / (size_t)batch_size));
-			}
+	BasicDataLoader<T> loader(train_images, train_labels, batch_size, epochs, static_cast<unsigned int>(std::time(0)));
+	BasicShardedWorkspace<T> workspace;
+	workspace.Reserve(nn.GetLayerSizes(), batch_size, threads);
+	nn.PlaceParameters(*optimizer, threads);
+
+	StatsReporter stats;
+	bool warm = false;
+	size_t warm_allocations = 0;
+	double epoch_loss = 0.0;
+	size_t epoch_samples = 0;
+	auto epoch_start = std::chrono::steady_clock::now();
+	while (const BasicBatch<T> *batch = NextBatch(loader)) {
+		double loss = nn.BackPropagateBatch(batch -> inputs, batch -> labels, *optimizer, workspace);
+		stats.Report(batch -> index + 1 == loader.BatchesPerEpoch());
+		epoch_loss += loss * batch -> labels.size();
+		epoch_samples += batch -> labels.size();
+		if (!warm) {
+			warm = true;
+			warm_allocations = heap_allocations.load();
+		}
+		if ((batch -> index + 1) % 10 == 0) {
+			printf("\rEpoch %02d/%d - Batch %zu/%zu", batch -> epoch + 1, epochs,
+				batch -> index + 1, loader.BatchesPerEpoch());
+		}
+		if (batch -> index + 1 == loader.BatchesPerEpoch()) {
+			auto now = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration <double> (now - epoch_start).count();
+			printf("     Epoch %02d completed, loss %.4f, %.0f samples/s.\n", batch -> epoch + 1, epoch_loss / epoch_samples,
+				epoch_samples / seconds);
+			epoch_loss = 0.0;
+			epoch_samples = 0;
+			epoch_start = now;
 		}
-		printf("     Epoch %02d completed.\n", epoch + 1);
 	}
+	size_t step_allocations = heap_allocations.load() - warm_allocations;
+	printf("Heap allocations after the first step: %zu\n", step_allocations);
 
 	nn.SaveModel("mnist_model.dat");
-	return 0;
+	return step_allocations;
+}
+
+int main(int argc, char **argv) {
+	std::srand(static_cast <unsigned int> (std::time(0)));
+
+	std::string train_img_path = "dataset/train-images.idx3-ubyte";
+	std::string train_lbl_path = "dataset/train-labels.idx1-ubyte";
+
+	IdxDataset train_images(train_img_path);
+	IdxDataset train_labels(train_lbl_path);
+
+	// Usage: train [float] [hogwild] [pool] [nodes=N] [sgd|momentum|nesterov|adam|adamw] [epochs] [trace=file.json]
+	// trace= only has an effect in telemetry builds (make TELEMETRY=1 train).
+	// pool runs every parallel loop on the pinned work-stealing ThreadPool
+	// instead of OpenMP; nodes= limits it to the first N NUMA nodes.
+	// Adam reaches plain SGD's 15-epoch loss in a few epochs, so it is the
+	// default; an explicit epoch count overrides the per-optimizer default.
+	bool use_float = false;
+	bool hogwild = false;
+	std::string optimizer_name = "adam";
+	int epochs = 0;
+	std::string trace_path;
+	bool pool = false;
+	ThreadPoolOptions pool_options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 6, "trace=") == 0) trace_path = arg.substr(6);
+		else if (arg == "float") use_float = true;
+		else if (arg == "hogwild") hogwild = true;
+		else if (arg == "pool") pool = true;
+		else if (arg.compare(0, 6, "nodes=") == 0) pool_options.nodes = std::atoi(arg.c_str() + 6);
+		else if (std::isdigit((unsigned char)arg[0])) epochs = std::atoi(arg.c_str());
+		else if (IsOptimizerName(arg)) optimizer_name = arg;
+		else {
+			printf("Unknown argument %s\n"
+				"Usage: train [float] [hogwild] [pool] [nodes=N] [sgd|momentum|nesterov|adam|adamw] [epochs] [trace=file.json]\n",
+				arg.c_str());
+			return 1;
+		}
+	}
+	if (epochs <= 0) epochs = optimizer_name == "sgd" ? 15 : 5;
+	if (pool) {
+		ConfigureGlobalThreadPool(pool_options);
+		ParallelPolicy policy = GetParallelPolicy();
+		policy.backend = ParallelBackend::Pool;
+		SetParallelPolicy(policy);
+	}
+
+	if (!trace_path.empty()) telemetry::StartTrace(trace_path);
+	size_t step_allocations;
+	if (use_float) {
+		step_allocations = Train<float>(train_images, train_labels, optimizer_name, epochs, hogwild);
+	} else {
+		step_allocations = Train<double>(train_images, train_labels, optimizer_name, epochs, hogwild);
+	}
+	if (!trace_path.empty()) telemetry::StopTrace();
+	return step_allocations == 0 ? 0 : 1;
 }
\ No newline at end of file
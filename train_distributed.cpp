@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "IdxDataset.h"
+#include "DataLoader.h"
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "RingAllReduce.h"
+
+// Data-parallel training across K local worker processes. Each worker trains
+// on its own 1/K shard of the training set with its own batch of 64, and
+// the K batches' gradients are summed by a ring all-reduce over Unix domain
+// sockets, overlapped with the backward pass layer by layer. All workers
+// start from the same weights and apply the same summed gradient, so the
+// replicas stay identical; rank 0 reports progress and saves the model.
+//
+// Usage: train_distributed [workers] [float] [sgd|momentum|nesterov|adam|adamw] [epochs]
+
+const unsigned int seed = 1234;
+const int batch_size = 64;
+
+template <typename T>
+int Worker(int rank, int workers, int send_fd, int recv_fd, const IdxDataset &train_images, const IdxDataset &train_labels,
+	const std::string &optimizer_name, int epochs) {
+	// Identical initial weights on every rank.
+	std::srand(seed);
+	BasicNeuralNetwork<T> nn({ 784, 128, 64, 10 });
+	std::unique_ptr <BasicOptimizer<T>> optimizer = MakeOptimizer<T>(optimizer_name);
+	BasicRingAllReduce<T> ring(rank, workers, send_fd, recv_fd);
+	BasicGradientExchange<T> exchange(ring, nn.GetLayerSizes().size() - 1);
+	BasicTrainingWorkspace<T> workspace;
+	workspace.Reserve(nn.GetLayerSizes(), batch_size);
+	BasicDataLoader<T> loader(train_images, train_labels, batch_size, epochs, seed + rank, 2, rank, workers);
+
+	T totals[2] = { 0, 0 };
+	auto epoch_start = std::chrono::steady_clock::now();
+	while (const BasicBatch<T> *batch = loader.Next()) {
+		size_t rows = batch -> labels.size();
+		double loss = nn.ComputeBatchGradients(batch -> inputs, batch -> labels, workspace, &exchange);
+		exchange.Wait();
+		// Every shard has the same batch sizes, so the global batch is rows * workers.
+		nn.ApplyBatchGradients(workspace, *optimizer, 1.0 / static_cast<double>(rows * workers));
+		totals[0] += static_cast<T>(loss * rows);
+		totals[1] += static_cast<T>(rows);
+
+		if (batch -> index + 1 == loader.BatchesPerEpoch()) {
+			ring.AllReduce(totals, 2);
+			double seconds = std::chrono::duration <double> (std::chrono::steady_clock::now() - epoch_start).count();
+			if (rank == 0) {
+				printf("Epoch %02d/%d completed, loss %.4f, %.0f samples/s.\n", batch -> epoch + 1, epochs,
+					(double)totals[0] / (double)totals[1], (double)totals[1] / seconds);
+				fflush(stdout);
+			}
+			totals[0] = totals[1] = 0;
+			epoch_start = std::chrono::steady_clock::now();
+		}
+	}
+	if (rank == 0) nn.SaveModel("mnist_model.dat");
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int workers = 2;
+	bool use_float = false;
+	std::string optimizer_name = "adam";
+	int epochs = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "float") use_float = true;
+		else if (std::isdigit((unsigned char)arg[0]) && i == 1) workers = std::atoi(arg.c_str());
+		else if (std::isdigit((unsigned char)arg[0])) epochs = std::atoi(arg.c_str());
+		else if (IsOptimizerName(arg)) optimizer_name = arg;
+		else {
+			printf("Unknown argument %s\n"
+				"Usage: train_distributed [workers] [float] [sgd|momentum|nesterov|adam|adamw] [epochs]\n", arg.c_str());
+			return 1;
+		}
+	}
+	if (epochs <= 0) epochs = optimizer_name == "sgd" ? 15 : 5;
+	if (workers < 1) workers = 1;
+
+	// Mapped before forking, so every worker shares the same page cache pages.
+	IdxDataset train_images("dataset/train-images.idx3-ubyte");
+	IdxDataset train_labels("dataset/train-labels.idx1-ubyte");
+	printf("Training started (%s, %s, %d epochs, %d workers)...\n", use_float ? "float" : "double",
+		optimizer_name.c_str(), epochs, workers);
+	fflush(stdout);
+
+	std::vector <int> send_fds, recv_fds;
+	CreateLocalRing(workers, send_fds, recv_fds);
+	// The workers split this machine's cores between them.
+	int threads = std::max(1, omp_get_max_threads() / workers);
+
+	std::vector <pid_t> pids;
+	for (int rank = 0; rank < workers; rank++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			for (int r = 0; r < workers; r++) {
+				if (r != rank) {
+					if (send_fds[r] >= 0) close(send_fds[r]);
+					if (recv_fds[r] >= 0) close(recv_fds[r]);
+				}
+			}
+			omp_set_num_threads(threads);
+			int status = use_float
+				? Worker<float>(rank, workers, send_fds[rank], recv_fds[rank], train_images, train_labels, optimizer_name, epochs)
+				: Worker<double>(rank, workers, send_fds[rank], recv_fds[rank], train_images, train_labels, optimizer_name, epochs);
+			_exit(status);
+		}
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		pids.push_back(pid);
+	}
+	for (int r = 0; r < workers; r++) {
+		if (send_fds[r] >= 0) close(send_fds[r]);
+		if (recv_fds[r] >= 0) close(recv_fds[r]);
+	}
+
+	int failed = (int)(workers - pids.size());
+	for (pid_t pid : pids) {
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+	}
+	if (failed > 0) {
+		printf("%d worker(s) failed.\n", failed);
+		return 1;
+	}
+	return 0;
+}